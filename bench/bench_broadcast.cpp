@@ -0,0 +1,310 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: broadcast of a pre-encoded frame vs a copy per session
+//
+// A server holds many plain sessions, all connected to one client thread
+// which reads from every socket. The server pushes the same message to
+// every session, one tick at a time. In the copy pass the message is
+// handed to each session with async_send(std::string), so every session
+// copies and frames the payload. In the frame pass a broadcaster encodes
+// the message once and every session writes the shared bytes. The rate
+// of messages delivered to the client is reported for both passes.
+//
+// Both passes are repeated with permessage-deflate and
+// server_no_context_takeover. Half of the clients ask for a smaller
+// server window, so there are two distinct sets of settings. In the
+// copy pass every session compresses the message; in the frame pass it
+// is compressed once per set, and the hit ratio is reported.
+//
+//------------------------------------------------------------------------------
+
+#include "broadcaster.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// A message which compresses like real traffic
+std::string make_payload(std::size_t size)
+{
+    std::string s;
+    unsigned seed = 1;
+    while (s.size() < size) {
+        seed = seed * 1103515245 + 12345;
+        s += "{\"sym\":\"ABC\",\"px\":" + std::to_string(seed % 100000) +
+             ",\"qty\":" + std::to_string((seed >> 16) % 1000) + "}";
+    }
+    s.resize(size);
+    return s;
+}
+
+// Reads the upgrade request, accepts, then reads until the client goes away
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    std::function<void()> on_ready_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws,
+            std::function<void()> on_ready)
+        : ws_(std::move(ws)), on_ready_(std::move(on_ready))
+    {
+    }
+
+    void run()
+    {
+        // Accepting with the request lets the stream record the
+        // negotiated compression
+        http::async_read(ws_->lowest_layer(), buffer_, req_,
+                         beast::bind_front_handler(&session::on_request,
+                                                   shared_from_this()));
+    }
+
+  private:
+    void on_request(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "request");
+        ws_->async_accept(req_, beast::bind_front_handler(&session::on_accept,
+                                                          shared_from_this()));
+    }
+
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        on_ready_();
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The client drops the connections when it has read everything
+        if (ec)
+            return;
+        buffer_.consume(buffer_.size());
+        do_read();
+    }
+};
+
+// Pushes `count` ticks to every session
+class ticker : public std::enable_shared_from_this<ticker>
+{
+    net::io_context& ioc_;
+    std::vector<std::shared_ptr<websocket_stream_base>> streams_;
+    broadcaster broadcaster_;
+    std::string payload_;
+    std::size_t remaining_;
+    bool shared_;
+
+  public:
+    ticker(net::io_context& ioc,
+           std::vector<std::shared_ptr<websocket_stream_base>> streams,
+           std::size_t size, std::size_t count, bool shared)
+        : ioc_(ioc)
+        , streams_(std::move(streams))
+        , payload_(make_payload(size))
+        , remaining_(count)
+        , shared_(shared)
+    {
+    }
+
+    // Called once every session has accepted
+    void start()
+    {
+        for (auto const& ws : streams_)
+            broadcaster_.join(ws);
+        tick();
+    }
+
+    double hit_ratio() const { return broadcaster_.deflate_hit_ratio(); }
+
+    void tick()
+    {
+        if (remaining_ == 0)
+            return;
+
+        // Let the sessions drain before queueing more
+        for (auto const& ws : streams_) {
+            if (ws->send_queue_depth() > 8)
+                return net::post(ioc_, beast::bind_front_handler(
+                                           &ticker::tick, shared_from_this()));
+        }
+
+        --remaining_;
+        if (shared_) {
+            broadcaster_.send(payload_, false);
+        } else {
+            for (auto const& ws : streams_)
+                ws->async_send(payload_, [](beast::error_code ec,
+                                            std::size_t) {
+                    if (ec)
+                        fail(ec, "send");
+                });
+        }
+        net::post(ioc_,
+                  beast::bind_front_handler(&ticker::tick, shared_from_this()));
+    }
+};
+
+// Reads `count` messages on every connection, returns the elapsed time
+double run_client(tcp::endpoint ep, std::size_t sessions, std::size_t count,
+                  bool deflate)
+{
+    net::io_context ioc;
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> streams;
+    std::vector<beast::flat_buffer> buffers(sessions);
+    for (std::size_t i = 0; i < sessions; ++i) {
+        streams.emplace_back(new websocket::stream<tcp::socket>(ioc));
+        if (deflate) {
+            websocket::permessage_deflate pmd;
+            pmd.client_enable = true;
+            pmd.server_max_window_bits = i % 2 == 0 ? 15 : 10;
+            streams.back()->set_option(pmd);
+        }
+        streams.back()->next_layer().connect(ep);
+    }
+    for (auto& ws : streams)
+        ws->handshake("localhost", "/");
+
+    std::size_t const total = sessions * count;
+    std::size_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::function<void(std::size_t)> do_read = [&](std::size_t i) {
+        streams[i]->async_read(
+            buffers[i], [&, i](beast::error_code ec, std::size_t) {
+                if (ec == net::error::operation_aborted)
+                    return;
+                if (ec)
+                    return fail(ec, "client read");
+                if (received++ == 0)
+                    start = std::chrono::steady_clock::now();
+                buffers[i].consume(buffers[i].size());
+                if (received < total)
+                    return do_read(i);
+                for (auto& ws : streams)
+                    ws->next_layer().close();
+            });
+    };
+    for (std::size_t i = 0; i < sessions; ++i)
+        do_read(i);
+    ioc.run();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+struct result
+{
+    double rate = 0;
+    double hit_ratio = 0;
+};
+
+// Runs one pass and returns the messages delivered per second
+result run_pass(bool shared, bool deflate, std::size_t sessions,
+                std::size_t count, std::size_t size)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    double elapsed = 0;
+    std::thread client(
+        [&elapsed, ep = acceptor.local_endpoint(), sessions, count, deflate] {
+            elapsed = run_client(ep, sessions, count, deflate);
+        });
+
+    std::vector<std::shared_ptr<websocket_stream_base>> streams;
+    for (std::size_t i = 0; i < sessions; ++i) {
+        auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+        if (deflate) {
+            websocket::permessage_deflate pmd;
+            pmd.server_enable = true;
+            pmd.server_no_context_takeover = true;
+            ws->set_option(pmd);
+        }
+        streams.push_back(std::move(ws));
+    }
+
+    // Start ticking once every session has accepted
+    auto const t = std::make_shared<ticker>(ioc, streams, size, count, shared);
+    std::size_t ready = 0;
+    for (auto const& ws : streams)
+        std::make_shared<session>(ws, [&ready, sessions, t] {
+            if (++ready == sessions)
+                t->start();
+        })->run();
+    streams.clear();
+
+    ioc.run();
+    client.join();
+
+    result r;
+    r.rate = static_cast<double>(sessions * count) / elapsed;
+    r.hit_ratio = t->hit_ratio();
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 4) {
+        std::cerr << "Usage: bench-broadcast <sessions> <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-broadcast 1000 1000 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const sessions = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const count = static_cast<std::size_t>(std::atol(argv[2]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[3]));
+
+    for (bool deflate : {false, true}) {
+        auto const copied = run_pass(false, deflate, sessions, count, size);
+        auto const shared = run_pass(true, deflate, sessions, count, size);
+        std::cout << sessions << " sessions, " << size << " byte messages"
+                  << (deflate ? ", permessage-deflate:\n" : ":\n")
+                  << "  copy per session: " << copied.rate << " msg/s\n"
+                  << "  shared frame:     " << shared.rate << " msg/s";
+        if (deflate)
+            std::cout << ", hit ratio " << shared.hit_ratio;
+        std::cout << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
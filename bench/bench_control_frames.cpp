@@ -0,0 +1,241 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Harness: heap allocations of the control frame path, and ping times
+//
+// Global operator new is replaced to count calls made on the calling
+// thread. First the allocations made by setting a callback which captures
+// three pointers are counted, through control_callback, which takes a
+// std::function, and through observe_control_frames, which stores the
+// callable inline.
+//
+// Then the server pings a synchronous client on its own thread, which
+// answers each ping with a pong while it waits in a read. The observer
+// counts each pong and sends the next ping, so one cycle is a ping and
+// its pong. After a warm-up the allocations made by the measured cycles
+// are reported, with the round-trip times the stream recorded. The
+// program fails if the measured cycles allocate.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+thread_local std::size_t allocations = 0;
+
+}    // namespace
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns a duration in microseconds
+double micros(ping_tracker::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// Pings the client until enough pongs were seen, then closes
+class ping_session : public std::enable_shared_from_this<ping_session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+    std::size_t warmup_;
+    std::size_t measured_;
+    std::size_t pongs_ = 0;
+    std::size_t start_ = 0;
+    std::size_t& result_;
+
+  public:
+    ping_session(std::shared_ptr<websocket_stream_base> ws,
+                 std::size_t warmup, std::size_t measured,
+                 std::size_t& result)
+        : ws_(std::move(ws))
+        , warmup_(warmup)
+        , measured_(measured)
+        , result_(result)
+    {
+    }
+
+    void run()
+    {
+        ws_->observe_control_frames(
+            [this](websocket::frame_type kind, beast::string_view) {
+                if (kind == websocket::frame_type::pong)
+                    on_pong();
+            });
+        ws_->async_accept(beast::bind_front_handler(&ping_session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        buffer_.reserve(4096);
+        do_read();
+        do_ping();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&ping_session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The close started by on_pong reads the answer itself
+        if (ec == websocket::error::closed ||
+            ec == net::error::operation_aborted)
+            return;
+        if (ec)
+            return fail(ec, "read");
+        buffer_.consume(buffer_.size());
+        do_read();
+    }
+
+    void do_ping()
+    {
+        ws_->async_ping({}, [this](beast::error_code ec) {
+            if (ec)
+                fail(ec, "ping");
+        });
+    }
+
+    void on_pong()
+    {
+        ++pongs_;
+        if (pongs_ == warmup_)
+            start_ = allocations;
+        if (pongs_ < warmup_ + measured_)
+            return do_ping();
+        result_ = allocations - start_;
+        ws_->async_close(websocket::close_code::normal,
+                         [](beast::error_code ec) {
+                             if (ec)
+                                 fail(ec, "close");
+                         });
+    }
+};
+
+// Reads until the server closes, answering its pings
+void run_client(tcp::endpoint ep)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        beast::flat_buffer buffer;
+        beast::error_code ec;
+        ws.read(buffer, ec);
+        if (ec && ec != websocket::error::closed)
+            fail(ec, "client");
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 2) {
+        std::cerr << "Usage: bench-control-frames <pings>\n"
+                  << "Example:\n"
+                  << "    bench-control-frames 10000\n";
+        return EXIT_FAILURE;
+    }
+    auto const measured = static_cast<std::size_t>(std::atol(argv[1]));
+    std::size_t const warmup = 16;
+
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    std::thread client(run_client, acceptor.local_endpoint());
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+
+    // Setting a callback
+    std::size_t a = 0, b = 0, c = 0;
+    auto const callback = [&a, &b, &c](websocket::frame_type,
+                                       beast::string_view) { ++a, ++b, ++c; };
+    auto n = allocations;
+    ws->control_callback(callback);
+    auto const by_function = allocations - n;
+    n = allocations;
+    ws->observe_control_frames(callback);
+    auto const by_observer = allocations - n;
+
+    std::size_t result = static_cast<std::size_t>(-1);
+    std::make_shared<ping_session>(ws, warmup, measured, result)->run();
+    ioc.run();
+    client.join();
+
+    auto const& times = ws->ping_times();
+    std::cout << "allocations setting a callback of " << sizeof(callback)
+              << " bytes:\n"
+              << "  control_callback:        " << by_function << "\n"
+              << "  observe_control_frames:  " << by_observer << "\n"
+              << "allocations per ping/pong cycle after " << warmup
+              << " warm-up cycles: "
+              << static_cast<double>(result) / static_cast<double>(measured)
+              << "\n"
+              << "round-trip time over " << times.samples()
+              << " pings: last " << micros(times.last()) << " us, smoothed "
+              << micros(times.smoothed()) << " us, shortest "
+              << micros(times.shortest()) << " us\n";
+
+    if (by_observer != 0 || result != 0) {
+        std::cerr << "the control frame path allocated\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: closed-set flex_websocket_stream vs virtual websocket_stream_base
+//
+// Runs the observer calls made by an echo loop for every message
+// (got_text, is_message_done, text, binary, is_open) in a tight loop,
+// once through a websocket_stream_base reference and once through a
+// flex_websocket_stream. The stream type is chosen at runtime so the
+// compiler cannot devirtualize the base calls.
+//
+//------------------------------------------------------------------------------
+
+#include "flex_websocket_stream.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ssl/context.hpp>
+#include <boost/beast/core.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl;          // from <boost/asio/ssl.hpp>
+
+//------------------------------------------------------------------------------
+
+// The per-message observer calls of an echo loop
+template <class Stream>
+std::size_t per_message(Stream& ws)
+{
+    std::size_t n = 0;
+    ws.text(ws.got_text());
+    n += ws.is_message_done();
+    n += ws.binary();
+    n += ws.is_open();
+    return n;
+}
+
+template <class Stream>
+double nanoseconds_per_message(Stream& ws, std::size_t count)
+{
+    std::size_t volatile sink = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i)
+        sink = sink + per_message(ws);
+    std::chrono::duration<double, std::nano> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(count);
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-flex-dispatch <iterations> <ssl>\n"
+                  << "Example:\n"
+                  << "    bench-flex-dispatch 100000000 0\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    bool const use_ssl = std::atoi(argv[2]) != 0;
+
+    net::io_context ioc;
+    ssl::context ctx(ssl::context::tlsv12);
+
+    std::unique_ptr<websocket_stream_base> base;
+    std::unique_ptr<flex_websocket_stream> flex;
+    if (use_ssl) {
+        base = std::make_unique<ssl_websocket_stream>(ioc, ctx);
+        flex = std::make_unique<flex_websocket_stream>(
+            beast::ssl_stream<beast::tcp_stream>(ioc, ctx));
+    } else {
+        base = std::make_unique<plain_websocket_stream>(ioc);
+        flex = std::make_unique<flex_websocket_stream>(beast::tcp_stream(ioc));
+    }
+
+    // Warm up both paths before measuring
+    nanoseconds_per_message(*base, count / 10 + 1);
+    nanoseconds_per_message(*flex, count / 10 + 1);
+
+    auto const base_ns = nanoseconds_per_message(*base, count);
+    auto const flex_ns = nanoseconds_per_message(*flex, count);
+
+    std::cout << "websocket_stream_base: " << base_ns << " ns/message\n"
+              << "flex_websocket_stream: " << flex_ns << " ns/message\n"
+              << "speedup:               " << base_ns / flex_ns << "\n";
+
+    return EXIT_SUCCESS;
+}
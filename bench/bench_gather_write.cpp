@@ -0,0 +1,202 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: writing large messages through the write buffer vs gathered
+//
+// The server session writes `count` messages of the given size with the
+// type-erased async_write to a synchronous client on its own thread,
+// which reads each message and checks its size and checksum. The first
+// pass writes through the websocket::stream write buffer, which copies
+// the payload into it a write buffer at a time, the second with the
+// gather_writes option, which writes the frame header and the payload
+// to the socket in one call. The CPU time of the process, the wall time
+// and the number of writes to the transport of each pass are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the checksum of a payload
+std::size_t checksum(unsigned char const* p, std::size_t n)
+{
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < n; i += 4096)
+        sum = sum * 31 + p[i];
+    return sum;
+}
+
+// Returns the CPU time used by the process, in seconds
+double cpu_seconds()
+{
+    struct rusage usage = {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Writes the payload `count` times, then closes
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    std::string const& payload_;
+    std::size_t count_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws,
+            std::string const& payload, std::size_t count)
+        : ws_(std::move(ws)), payload_(payload), count_(count)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        ws_->binary(true);
+        do_write();
+    }
+
+    void do_write()
+    {
+        if (count_-- == 0)
+            return ws_->async_close(
+                websocket::close_code::normal,
+                beast::bind_front_handler(&session::on_close,
+                                          shared_from_this()));
+        ws_->async_write(net::buffer(payload_),
+                         beast::bind_front_handler(&session::on_write,
+                                                   shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        if (ec)
+            return fail(ec, "write");
+        if (bytes_transferred != payload_.size())
+            std::cerr << "write: short\n";
+        do_write();
+    }
+
+    void on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+    }
+};
+
+// Reads messages until the server closes, checking each of them
+void run_client(tcp::endpoint ep, std::size_t size, std::size_t sum)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.read_message_max(size + 1);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        beast::flat_buffer buffer;
+        for (;;) {
+            beast::error_code ec;
+            ws.read(buffer, ec);
+            if (ec == websocket::error::closed)
+                break;
+            if (ec)
+                return fail(ec, "client");
+            auto const data = buffer.data();
+            if (data.size() != size ||
+                checksum(static_cast<unsigned char const*>(data.data()),
+                         data.size()) != sum)
+                std::cerr << "client: bad message\n";
+            buffer.clear();
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and prints its times
+void run_pass(char const* name, std::string const& payload, std::size_t sum,
+              std::size_t count, bool gather)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    auto const cpu = cpu_seconds();
+    auto const start = std::chrono::steady_clock::now();
+    std::thread client(run_client, acceptor.local_endpoint(), payload.size(),
+                       sum);
+
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+    ws->gather_writes(gather);
+    auto const& layer = ws->coalescing_layer();
+    std::make_shared<session>(ws, payload, count)->run();
+    ioc.run();
+    client.join();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << name << elapsed.count() << " s, "
+              << payload.size() * count / elapsed.count() / (1024 * 1024)
+              << " MiB/s, cpu " << cpu_seconds() - cpu << " s, "
+              << layer.write_count() << " writes\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-gather-write <messages> <size in KiB>\n"
+                  << "Example:\n"
+                  << "    bench-gather-write 1000 1024\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2])) * 1024;
+
+    std::string payload(size, '\0');
+    for (std::size_t i = 0; i < size; ++i)
+        payload[i] = static_cast<char>(i * 7 + i / 4096);
+    auto const sum = checksum(
+        reinterpret_cast<unsigned char const*>(payload.data()), size);
+
+    std::cout << count << " messages of " << size / 1024 << " KiB:\n";
+    run_pass("  write buffer: ", payload, sum, count, false);
+    run_pass("  gathered:     ", payload, sum, count, true);
+
+    return EXIT_SUCCESS;
+}
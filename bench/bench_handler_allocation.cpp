@@ -0,0 +1,244 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Harness: heap allocations per echo cycle on the server
+//
+// Global operator new is replaced to count calls made on the calling
+// thread. A synchronous client runs on its own thread, so only the server
+// session is counted. After a warm-up the server echoes a fixed number of
+// messages, each one a read followed by a write, and the allocations made
+// during those cycles are reported. The wrapper paths must not allocate;
+// the program fails if they do. A bare websocket::stream is shown for
+// reference.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+thread_local std::size_t allocations = 0;
+
+}    // namespace
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+enum class path
+{
+    erased,      // virtual operations of websocket_stream_base
+    wrapper,     // templated operations of plain_websocket_stream
+    reference    // websocket::stream with no handler memory
+};
+
+// Echoes messages and counts the allocations made by the measured cycles
+template <class Stream>
+class echo_session
+    : public std::enable_shared_from_this<echo_session<Stream>>
+{
+    std::shared_ptr<Stream> ws_;
+    beast::flat_buffer buffer_;
+    std::size_t warmup_;
+    std::size_t measured_;
+    std::size_t cycles_ = 0;
+    std::size_t start_ = 0;
+    std::size_t& result_;
+
+  public:
+    echo_session(std::shared_ptr<Stream> ws, std::size_t warmup,
+                 std::size_t measured, std::size_t& result)
+        : ws_(std::move(ws))
+        , warmup_(warmup)
+        , measured_(measured)
+        , result_(result)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&echo_session::on_accept,
+                                                    this->shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        // Reserve once, so the buffer itself is not counted
+        buffer_.reserve(64 * 1024);
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&echo_session::on_read,
+                                                  this->shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+
+        ws_->text(ws_->got_text());
+        ws_->async_write(buffer_.data(),
+                         beast::bind_front_handler(&echo_session::on_write,
+                                                   this->shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        buffer_.consume(buffer_.size());
+
+        ++cycles_;
+        if (cycles_ == warmup_)
+            start_ = allocations;
+        else if (cycles_ == warmup_ + measured_)
+            result_ = allocations - start_;
+        do_read();
+    }
+};
+
+// Sends `count` messages and waits for each echo, then closes
+void run_client(tcp::endpoint ep, std::size_t size, std::size_t count)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        std::string const payload(size, 'x');
+        beast::flat_buffer buffer;
+        for (std::size_t i = 0; i < count; ++i) {
+            ws.write(net::buffer(payload));
+            ws.read(buffer);
+            buffer.consume(buffer.size());
+        }
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one echo pass and returns the allocations made by the measured cycles
+std::size_t run_pass(path p, std::size_t size, std::size_t warmup,
+                     std::size_t measured)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(), size,
+                       warmup + measured);
+
+    std::size_t result = static_cast<std::size_t>(-1);
+    auto socket = acceptor.accept();
+    switch (p) {
+    case path::erased:
+        std::make_shared<echo_session<websocket_stream_base>>(
+            std::make_shared<plain_websocket_stream>(std::move(socket)),
+            warmup, measured, result)
+            ->run();
+        break;
+    case path::wrapper:
+        std::make_shared<echo_session<plain_websocket_stream>>(
+            std::make_shared<plain_websocket_stream>(std::move(socket)),
+            warmup, measured, result)
+            ->run();
+        break;
+    case path::reference:
+        std::make_shared<
+            echo_session<websocket::stream<beast::tcp_stream>>>(
+            std::make_shared<websocket::stream<beast::tcp_stream>>(
+                std::move(socket)),
+            warmup, measured, result)
+            ->run();
+        break;
+    }
+    ioc.run();
+    client.join();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-handler-allocation <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-handler-allocation 10000 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const measured = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+    std::size_t const warmup = 16;
+
+    auto const erased = run_pass(path::erased, size, warmup, measured);
+    auto const wrapper = run_pass(path::wrapper, size, warmup, measured);
+    auto const reference = run_pass(path::reference, size, warmup, measured);
+
+    auto const per_cycle = [measured](std::size_t n) {
+        return static_cast<double>(n) / static_cast<double>(measured);
+    };
+    std::cout << "allocations per read/write cycle after " << warmup
+              << " warm-up cycles:\n"
+              << "type-erased path:   " << per_cycle(erased) << "\n"
+              << "template path:      " << per_cycle(wrapper) << "\n"
+              << "websocket::stream:  " << per_cycle(reference) << "\n";
+
+    if (erased != 0 || wrapper != 0) {
+        std::cerr << "the wrapper allocated after warm-up\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
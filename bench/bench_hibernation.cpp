@@ -0,0 +1,267 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: heap bytes per idle connection, awake vs hibernating
+//
+// A server accepts many connections from a client running in a child
+// process, so that only the server's heap is measured. Each session
+// accepts, queues a burst of messages with async_send, reads one message
+// from the client, then waits in a read with a pooled_buffer, as an idle
+// subscriber would. Once every session is idle the heap in use, from
+// mallinfo2, is compared with the heap before the first connection.
+//
+// In the awake pass the sessions keep everything they allocated. In the
+// hibernating pass each stream has hibernate_after set and is measured
+// after it has hibernated. Both passes are run for plain and SSL streams.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+#include "example/common/server_certificate.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl;          // from <boost/asio/ssl.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the bytes of heap in use by the process
+std::size_t heap_bytes()
+{
+    auto const mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+std::size_t const burst = 64;
+std::size_t const message_size = 1024;
+
+// Sends a burst, then reads until the client goes away
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    pooled_buffer buffer_;
+    std::function<void()> on_idle_;
+    bool idle_ = false;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws,
+            std::function<void()> on_idle)
+        : ws_(std::move(ws)), on_idle_(std::move(on_idle))
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(
+            beast::bind_front_handler(&session::on_accept, shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        for (std::size_t i = 0; i < burst; ++i)
+            ws_->async_send(std::string(message_size, 'x'),
+                            [](beast::error_code, std::size_t) {});
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The client goes away once the heap has been measured
+        if (ec)
+            return;
+        buffer_.consume(buffer_.size());
+        if (!idle_) {
+            idle_ = true;
+            on_idle_();
+        }
+        do_read();
+    }
+};
+
+// Runs in the child process: opens the connections, reads each burst,
+// sends one message, then waits until the parent closes the pipe
+void run_client(tcp::endpoint ep, bool use_ssl, std::size_t connections,
+                int fd)
+{
+    net::io_context ioc;
+    ssl::context ctx(ssl::context::tlsv12_client);
+    ctx.set_verify_mode(ssl::verify_none);
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> plain;
+    std::vector<std::unique_ptr<websocket::stream<ssl::stream<tcp::socket>>>>
+        secure;
+    try {
+        beast::flat_buffer buffer;
+        auto const exchange = [&](auto& ws) {
+            ws.handshake("localhost", "/");
+            for (std::size_t i = 0; i < burst; ++i) {
+                ws.read(buffer);
+                buffer.consume(buffer.size());
+            }
+            ws.write(net::buffer(std::string("hello")));
+        };
+        for (std::size_t i = 0; i < connections; ++i) {
+            if (use_ssl) {
+                secure.emplace_back(
+                    new websocket::stream<ssl::stream<tcp::socket>>(ioc, ctx));
+                auto& ws = *secure.back();
+                beast::get_lowest_layer(ws).connect(ep);
+                ws.next_layer().handshake(ssl::stream_base::client);
+                exchange(ws);
+            } else {
+                plain.emplace_back(new websocket::stream<tcp::socket>(ioc));
+                auto& ws = *plain.back();
+                ws.next_layer().connect(ep);
+                exchange(ws);
+            }
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+    char c;
+    while (::read(fd, &c, 1) > 0) {
+    }
+}
+
+// Returns the heap bytes per idle connection
+double run_pass(bool use_ssl, bool hibernate, std::size_t connections)
+{
+    ssl::context ctx(ssl::context::tlsv12);
+    load_server_certificate(ctx);
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    int fds[2];
+    if (::pipe(fds) != 0)
+        return 0;
+    auto const pid = ::fork();
+    if (pid == 0) {
+        ::close(fds[1]);
+        run_client(acceptor.local_endpoint(), use_ssl, connections, fds[0]);
+        ::_exit(0);
+    }
+    ::close(fds[0]);
+
+    auto const baseline = heap_bytes();
+    double result = 0;
+    std::vector<std::shared_ptr<websocket_stream_base>> streams;
+    std::size_t idle = 0;
+    net::steady_timer timer(ioc);
+
+    // Measure once the last session has been idle long enough to hibernate
+    auto const on_idle = [&] {
+        if (++idle < connections)
+            return;
+        timer.expires_after(std::chrono::milliseconds(500));
+        timer.async_wait([&](beast::error_code) {
+            std::size_t asleep = 0;
+            for (auto const& ws : streams)
+                asleep += ws->hibernating() ? 1 : 0;
+            if (hibernate && asleep != connections)
+                std::cerr << asleep << " of " << connections
+                          << " streams hibernating\n";
+            result = static_cast<double>(heap_bytes() - baseline) /
+                     static_cast<double>(connections);
+            streams.clear();
+            ::close(fds[1]);
+        });
+    };
+
+    auto const start = [&](std::shared_ptr<websocket_stream_base> ws) {
+        if (hibernate)
+            ws->hibernate_after(std::chrono::milliseconds(100));
+        streams.push_back(ws);
+        std::make_shared<session>(std::move(ws), on_idle)->run();
+    };
+
+    std::size_t accepted = 0;
+    std::function<void()> do_accept = [&] {
+        acceptor.async_accept([&](beast::error_code ec, tcp::socket socket) {
+            if (ec)
+                return fail(ec, "accept");
+            if (use_ssl) {
+                auto ws = std::make_shared<ssl_websocket_stream>(
+                    std::move(socket), ctx);
+                ws->next_layer().async_handshake(
+                    ssl::stream_base::server,
+                    [ws, &start](beast::error_code ec) {
+                        if (ec)
+                            return fail(ec, "handshake");
+                        start(ws);
+                    });
+            } else {
+                start(std::make_shared<plain_websocket_stream>(
+                    std::move(socket)));
+            }
+            if (++accepted < connections)
+                do_accept();
+        });
+    };
+    do_accept();
+    ioc.run();
+
+    int status;
+    ::waitpid(pid, &status, 0);
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 2) {
+        std::cerr << "Usage: bench-hibernation <connections>\n"
+                  << "Example:\n"
+                  << "    bench-hibernation 1000\n";
+        return EXIT_FAILURE;
+    }
+    auto const connections = static_cast<std::size_t>(std::atol(argv[1]));
+
+    for (bool use_ssl : {false, true}) {
+        auto const awake = run_pass(use_ssl, false, connections);
+        auto const asleep = run_pass(use_ssl, true, connections);
+        std::cout << (use_ssl ? "ssl" : "plain") << ", " << connections
+                  << " idle connections, heap bytes per connection:\n"
+                  << "  awake:       " << awake << "\n"
+                  << "  hibernating: " << asleep << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: generators of mask keys, and small client-role writes
+//
+// The first part draws keys from Beast's ChaCha20 generator, as its
+// secure PRNG does, from the buffered generator which replaces it, and
+// from the fast PCG generator, and reports keys per second and how many
+// of the keys drawn were distinct.
+//
+// The second part writes `count` messages of the given size with the
+// type-erased async_write of a client-role stream, once with the secure
+// PRNG and once with the fast one, to a synchronous server on its own
+// thread which reads and counts them. Frames per second are reported.
+// Build with WEBSOCKET_STREAM_BEAST_PRNG defined to measure Beast's
+// generator in the second part.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/core/detail/chacha.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace mask_prng = websocket::mask_prng;
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// The secure generator of Beast's prng.ipp
+std::uint32_t beast_generate()
+{
+    thread_local beast::detail::chacha<20> gen{
+        websocket::detail::prng_seed(), mask_prng::make_nonce()};
+    return gen();
+}
+
+// Draws keys through a generator pointer, as the stream does
+void run_generator(char const* name, websocket::detail::generator g,
+                   std::size_t count)
+{
+    std::uint32_t volatile sink = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i)
+        sink = sink ^ g();
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::unordered_set<std::uint32_t> keys;
+    for (std::size_t i = 0; i < 65536; ++i)
+        keys.insert(g());
+    std::cout << name << count / elapsed.count() / 1e6 << " M keys/s, "
+              << keys.size() << " distinct of 65536\n";
+}
+
+//------------------------------------------------------------------------------
+
+// Writes the payload `count` times, then closes
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    std::string const& payload_;
+    std::size_t count_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws,
+            std::string const& payload, std::size_t count)
+        : ws_(std::move(ws)), payload_(payload), count_(count)
+    {
+    }
+
+    void run() { do_write(); }
+
+  private:
+    void do_write()
+    {
+        if (count_-- == 0)
+            return ws_->async_close(
+                websocket::close_code::normal,
+                beast::bind_front_handler(&session::on_close,
+                                          shared_from_this()));
+        ws_->async_write(net::buffer(payload_),
+                         beast::bind_front_handler(&session::on_write,
+                                                   shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        do_write();
+    }
+
+    void on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+    }
+};
+
+// Reads messages until the client closes, and counts them
+void run_server(tcp::acceptor& acceptor, std::size_t& received)
+{
+    try {
+        websocket::stream<tcp::socket> ws(acceptor.accept());
+        ws.accept();
+        beast::flat_buffer buffer;
+        for (;;) {
+            beast::error_code ec;
+            ws.read(buffer, ec);
+            if (ec == websocket::error::closed)
+                break;
+            if (ec)
+                return fail(ec, "server");
+            ++received;
+            buffer.clear();
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "server");
+    }
+}
+
+// Runs one pass and prints its rate
+void run_pass(char const* name, std::string const& payload,
+              std::size_t count, bool secure)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    std::size_t received = 0;
+    std::thread server(run_server, std::ref(acceptor), std::ref(received));
+
+    auto ws = std::make_shared<plain_websocket_stream>(ioc);
+    beast::get_lowest_layer(ws->ws()).connect(acceptor.local_endpoint());
+    ws->secure_prng(secure);
+    ws->handshake("localhost", "/");
+
+    auto const start = std::chrono::steady_clock::now();
+    std::make_shared<session>(ws, payload, count)->run();
+    ioc.run();
+    server.join();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (received != count)
+        std::cerr << name << "received " << received << " of " << count
+                  << " messages\n";
+    std::cout << name << count / elapsed.count() << " frames/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-mask-prng <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-mask-prng 1000000 16\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+
+    std::size_t const keys = 100000000;
+    run_generator("beast chacha20:    ", &beast_generate, keys);
+    run_generator("buffered chacha20: ", &mask_prng::secure_generate, keys);
+    run_generator("pcg:               ", &mask_prng::fast_generate, keys);
+
+    std::string const payload(size, 'x');
+    std::cout << "\n"
+              << count << " client frames of " << size << " bytes"
+#if WEBSOCKET_STREAM_REPLACES_PRNG
+              << ":\n";
+#else
+              << ", Beast's generators:\n";
+#endif
+    run_pass("  secure: ", payload, count, true);
+    run_pass("  fast:   ", payload, count, false);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: allocator calls per message, flat_buffer vs pooled_buffer
+//
+// Global operator new is replaced to count calls made on the calling
+// thread. A synchronous client on its own thread sends messages of three
+// sizes in turn and waits for each echo. The server session reads every
+// message into a new buffer, as the coro example does, and echoes it. In
+// the first pass the buffer is a beast::flat_buffer, which grows a fresh
+// heap block for each message; in the others it is a pooled_buffer,
+// through the type-erased and the template read. The allocations made
+// per message after a warm-up are reported for each pass.
+//
+//------------------------------------------------------------------------------
+
+#include "pooled_buffer.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+thread_local std::size_t allocations = 0;
+
+}    // namespace
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Echoes messages, each read into a new buffer, and counts allocations
+template <class Stream, class Buffer>
+class echo_session
+    : public std::enable_shared_from_this<echo_session<Stream, Buffer>>
+{
+    std::shared_ptr<Stream> ws_;
+    Buffer buffer_;
+    std::size_t warmup_;
+    std::size_t measured_;
+    std::size_t cycles_ = 0;
+    std::size_t start_ = 0;
+    std::size_t& result_;
+
+  public:
+    echo_session(std::shared_ptr<Stream> ws, std::size_t warmup,
+                 std::size_t measured, std::size_t& result)
+        : ws_(std::move(ws))
+        , warmup_(warmup)
+        , measured_(measured)
+        , result_(result)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&echo_session::on_accept,
+                                                    this->shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        // A new buffer for every message
+        buffer_ = Buffer();
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&echo_session::on_read,
+                                                  this->shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+
+        ws_->text(ws_->got_text());
+        ws_->async_write(buffer_.data(),
+                         beast::bind_front_handler(&echo_session::on_write,
+                                                   this->shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+
+        ++cycles_;
+        if (cycles_ == warmup_)
+            start_ = allocations;
+        else if (cycles_ == warmup_ + measured_)
+            result_ = allocations - start_;
+        do_read();
+    }
+};
+
+// Sends `count` messages of three sizes in turn, waiting for each echo
+void run_client(tcp::endpoint ep, std::size_t size, std::size_t count)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.next_layer().set_option(tcp::no_delay(true));
+        ws.handshake("localhost", "/");
+
+        std::string const payload(4 * size, 'x');
+        std::size_t const sizes[] = {size / 4 + 1, size, 4 * size};
+        beast::flat_buffer buffer;
+        for (std::size_t i = 0; i < count; ++i) {
+            ws.write(net::buffer(payload.data(), sizes[i % 3]));
+            ws.read(buffer);
+            buffer.consume(buffer.size());
+        }
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one echo pass and returns the allocations made by the measured cycles
+template <class Stream, class Buffer>
+std::size_t run_pass(std::size_t size, std::size_t warmup,
+                     std::size_t measured)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(), size,
+                       warmup + measured);
+
+    // Large messages go out as several frames; do not wait for acks
+    auto socket = acceptor.accept();
+    socket.set_option(tcp::no_delay(true));
+
+    std::size_t result = static_cast<std::size_t>(-1);
+    std::make_shared<echo_session<Stream, Buffer>>(
+        std::make_shared<plain_websocket_stream>(std::move(socket)), warmup,
+        measured, result)
+        ->run();
+    ioc.run();
+    client.join();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-pooled-buffer <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-pooled-buffer 10000 4096\n";
+        return EXIT_FAILURE;
+    }
+    auto const measured = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+    std::size_t const warmup = 16;
+
+    auto const flat =
+        run_pass<websocket_stream_base, beast::flat_buffer>(size, warmup,
+                                                            measured);
+    auto const erased =
+        run_pass<websocket_stream_base, pooled_buffer>(size, warmup, measured);
+    auto const wrapper =
+        run_pass<plain_websocket_stream, pooled_buffer>(size, warmup,
+                                                        measured);
+
+    auto const per_message = [measured](std::size_t n) {
+        return static_cast<double>(n) / static_cast<double>(measured);
+    };
+    std::cout << "allocations per message after " << warmup
+              << " warm-up messages:\n"
+              << "flat_buffer:                   " << per_message(flat)
+              << "\n"
+              << "pooled_buffer, type-erased:    " << per_message(erased)
+              << "\n"
+              << "pooled_buffer, template:       " << per_message(wrapper)
+              << "\n"
+              << "pool: " << buffer_pool::local().allocations()
+              << " blocks from the heap, " << buffer_pool::local().reuses()
+              << " reused\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: one completion per message vs one per batch of messages
+//
+// A synchronous client on its own thread sends small messages, encoded
+// beforehand, as fast as it can, then closes, so they arrive pipelined.
+// The server session runs on a strand and checksums every message. In
+// the first pass it takes them one at a time with async_receive; in the
+// second it takes every message already at hand with async_read_many.
+// Both receive into a receive_ring and release the views after each
+// completion. Messages per second, completions and the average batch
+// size are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "receive_ring.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// What the application does with a message
+std::size_t checksum(std::size_t sum, receive_ring::message const& m)
+{
+    for (std::size_t i = 0; i < m.size(); i += 64)
+        sum = sum * 31 + static_cast<unsigned char>(m.data()[i]);
+    return sum + m.size() + m.text();
+}
+
+struct result
+{
+    std::size_t messages = 0;
+    std::size_t completions = 0;
+    std::size_t sum = 0;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point stop;
+};
+
+// Receives the messages one completion at a time, or in batches
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    receive_ring ring_;
+    std::vector<receive_ring::message> batch_;
+    result& result_;
+    bool many_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws, std::size_t capacity,
+            bool many, result& r)
+        : ws_(std::move(ws)), ring_(capacity), result_(r), many_(many)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        result_.start = std::chrono::steady_clock::now();
+        do_read();
+    }
+
+    void do_read()
+    {
+        if (many_)
+            return ws_->async_read_many(
+                ring_, batch_,
+                beast::bind_front_handler(&session::on_read_many,
+                                          shared_from_this()));
+        ws_->async_receive(ring_,
+                           beast::bind_front_handler(&session::on_receive,
+                                                     shared_from_this()));
+    }
+
+    bool on_error(beast::error_code ec)
+    {
+        if (!ec)
+            return false;
+        result_.stop = std::chrono::steady_clock::now();
+        if (ec != websocket::error::closed)
+            fail(ec, "read");
+        return true;
+    }
+
+    void on_receive(beast::error_code ec, receive_ring::message message)
+    {
+        if (on_error(ec))
+            return;
+        ++result_.completions;
+        ++result_.messages;
+        result_.sum = checksum(result_.sum, message);
+        ring_.release(message);
+        do_read();
+    }
+
+    void on_read_many(beast::error_code ec, std::size_t count)
+    {
+        if (on_error(ec))
+            return;
+        ++result_.completions;
+        result_.messages += count;
+        for (auto const& message : batch_) {
+            result_.sum = checksum(result_.sum, message);
+            ring_.release(message);
+        }
+        batch_.clear();
+        do_read();
+    }
+};
+
+// Appends a client frame holding `payload`. The key is zero, which
+// leaves the payload as it is, so the frames can be encoded up front.
+void append_frame(std::string& out, std::string const& payload, bool text)
+{
+    out += static_cast<char>(text ? 0x81 : 0x82);
+    if (payload.size() < 126) {
+        out += static_cast<char>(0x80 | payload.size());
+    } else {
+        out += static_cast<char>(0x80 | 126);
+        out += static_cast<char>(payload.size() >> 8);
+        out += static_cast<char>(payload.size() & 0xff);
+    }
+    out.append(4, '\0');
+    out += payload;
+}
+
+// Sends `count` messages of `size` bytes, then closes. The frames are
+// encoded beforehand and written 64 KiB at a time, so that the client
+// outpaces the server.
+void run_client(tcp::endpoint ep, std::size_t size, std::size_t count)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        std::string payload(size, 'x');
+        std::string frames;
+        for (std::size_t i = 0; i < count; ++i) {
+            payload[0] = static_cast<char>('a' + i % 26);
+            append_frame(frames, payload, i % 3 == 0);
+        }
+        for (std::size_t i = 0; i < frames.size(); i += 65536)
+            net::write(ws.next_layer(),
+                       net::buffer(frames.data() + i,
+                                   (std::min)(frames.size() - i,
+                                              std::size_t(65536))));
+        ws.close(websocket::close_code::normal);
+
+        // Wait for the close frame of the server
+        beast::flat_buffer buffer;
+        beast::error_code ec;
+        while (!ec)
+            ws.read(buffer, ec);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and returns its result
+result run_pass(std::size_t size, std::size_t count, bool many)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(), size, count);
+
+    // A batch of held messages, as many as 64 KiB read ahead can hold,
+    // and the one being received
+    std::size_t const capacity = 4 * 65536 + 1024 * (size + 64);
+
+    result r;
+    auto ws = std::make_shared<plain_websocket_stream>(
+        net::make_strand(ioc.get_executor()));
+    acceptor.accept(beast::get_lowest_layer(ws->ws()).socket());
+    std::make_shared<session>(ws, capacity, many, r)->run();
+    ioc.run();
+    client.join();
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-read-many <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-read-many 1000000 32\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+
+    auto const single = run_pass(size, count, false);
+    auto const many = run_pass(size, count, true);
+    if (single.sum != many.sum || single.messages != many.messages)
+        std::cerr << "checksums differ\n";
+
+    auto const report = [](char const* name, result const& r) {
+        std::chrono::duration<double> const elapsed = r.stop - r.start;
+        std::cout << name
+                  << static_cast<double>(r.messages) / elapsed.count()
+                  << " msg/s, " << r.completions << " completions, "
+                  << static_cast<double>(r.messages) /
+                         static_cast<double>(r.completions)
+                  << " messages each\n";
+    };
+    std::cout << count << " messages of " << size << " bytes:\n";
+    report("  async_receive:   ", single);
+    report("  async_read_many: ", many);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: fixed 1536 byte first read vs the adaptive read size policy
+//
+// A synchronous client on its own thread sends three phases of messages
+// on one connection: small messages, then a burst of bulk messages, then
+// small messages again. The server session reads each message into a new
+// flat_buffer whose allocator counts its calls. In the first pass it reads
+// through websocket::stream's own async_read, whose first read of a
+// message prepares a fixed 1536 bytes; in the second through
+// websocket_stream::async_read, sized by the stream's read_size_policy.
+// For each phase the transport reads and the buffer allocations per
+// message, the buffer bytes allocated per payload byte, and the policy's
+// hint at the end of the phase are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+namespace {
+
+std::size_t buffer_allocations = 0;
+
+}    // namespace
+
+// The allocator of the read buffer, which counts its calls
+template <class T>
+struct counting_allocator
+{
+    using value_type = T;
+
+    counting_allocator() = default;
+
+    template <class U>
+    counting_allocator(counting_allocator<U> const&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        ++buffer_allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    bool operator==(counting_allocator<U> const&) const noexcept
+    {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(counting_allocator<U> const&) const noexcept
+    {
+        return false;
+    }
+};
+
+using counted_buffer = beast::basic_flat_buffer<counting_allocator<char>>;
+
+struct phase
+{
+    char const* name;
+    std::size_t count;
+    std::size_t size;
+};
+
+struct phase_stats
+{
+    std::size_t messages = 0;
+    std::size_t reads = 0;
+    std::size_t allocations = 0;
+    std::size_t allocated = 0;
+    std::size_t bytes = 0;
+    std::size_t hint = 0;
+};
+
+// Reads every message into a new buffer and records how it was read
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<plain_websocket_stream> ws_;
+    counted_buffer buffer_;
+    std::vector<phase> const& phases_;
+    std::vector<phase_stats>& stats_;
+    bool adaptive_;
+    std::size_t phase_ = 0;
+    std::size_t operations_ = 0;
+    std::size_t allocations_ = 0;
+
+  public:
+    session(std::shared_ptr<plain_websocket_stream> ws,
+            std::vector<phase> const& phases,
+            std::vector<phase_stats>& stats, bool adaptive)
+        : ws_(std::move(ws))
+        , phases_(phases)
+        , stats_(stats)
+        , adaptive_(adaptive)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(
+            beast::bind_front_handler(&session::on_accept, shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        buffer_ = counted_buffer();
+        operations_ = ws_->coalescing_layer().operation_count();
+        allocations_ = buffer_allocations;
+        auto h = beast::bind_front_handler(&session::on_read,
+                                           shared_from_this());
+        if (adaptive_)
+            ws_->async_read(buffer_, std::move(h));
+        else
+            ws_->ws().async_read(buffer_, std::move(h));
+    }
+
+    void on_read(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+
+        auto& s = stats_[phase_];
+        s.reads += ws_->coalescing_layer().operation_count() - operations_;
+        s.allocations += buffer_allocations - allocations_;
+        s.allocated += buffer_.capacity();
+        s.bytes += bytes_transferred;
+        s.hint = ws_->read_size_hint();
+        if (++s.messages == phases_[phase_].count)
+            ++phase_;
+        do_read();
+    }
+};
+
+// Sends the phases of messages as single frames, then closes
+void run_client(tcp::endpoint ep, std::vector<phase> const& phases)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.next_layer().set_option(tcp::no_delay(true));
+        ws.handshake("localhost", "/");
+        ws.auto_fragment(false);
+        ws.binary(true);
+
+        for (auto const& p : phases) {
+            std::string const payload(p.size, 'x');
+            for (std::size_t i = 0; i < p.count; ++i)
+                ws.write(net::buffer(payload));
+        }
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and returns the statistics of each phase
+std::vector<phase_stats> run_pass(std::vector<phase> const& phases,
+                                  bool adaptive)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(),
+                       std::cref(phases));
+
+    std::vector<phase_stats> stats(phases.size());
+    std::make_shared<session>(
+        std::make_shared<plain_websocket_stream>(acceptor.accept()), phases,
+        stats, adaptive)
+        ->run();
+    ioc.run();
+    client.join();
+    return stats;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 4) {
+        std::cerr << "Usage: bench-read-sizing <messages> <small size> "
+                     "<bulk size>\n"
+                  << "Example:\n"
+                  << "    bench-read-sizing 2000 64 262144\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const small = static_cast<std::size_t>(std::atol(argv[2]));
+    auto const bulk = static_cast<std::size_t>(std::atol(argv[3]));
+
+    std::vector<phase> const phases = {
+        {"small", count, small},
+        {"bulk", count / 10 + 1, bulk},
+        {"small again", count, small},
+    };
+
+    auto const fixed = run_pass(phases, false);
+    auto const adaptive = run_pass(phases, true);
+
+    auto const report = [&phases](char const* name,
+                                  std::vector<phase_stats> const& stats,
+                                  bool hint) {
+        std::cout << name << "\n";
+        for (std::size_t i = 0; i < phases.size(); ++i) {
+            auto const& s = stats[i];
+            auto const n = static_cast<double>(s.messages ? s.messages : 1);
+            std::cout << "  " << std::left << std::setw(12) << phases[i].name
+                      << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(6)
+                      << static_cast<double>(s.reads) / n
+                      << " reads/msg " << std::setw(6)
+                      << static_cast<double>(s.allocations) / n
+                      << " allocs/msg " << std::setw(8)
+                      << static_cast<double>(s.allocated) /
+                             static_cast<double>(s.bytes ? s.bytes : 1)
+                      << " bytes/byte";
+            if (hint)
+                std::cout << ", hint " << s.hint;
+            std::cout << "\n";
+        }
+    };
+    report("fixed 1536 byte first read:", fixed, false);
+    report("read_size_policy:", adaptive, true);
+
+    return EXIT_SUCCESS;
+}
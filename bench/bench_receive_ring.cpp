@@ -0,0 +1,246 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: ingest throughput, copied messages vs views into a receive ring
+//
+// A synchronous client on its own thread sends messages of one size as
+// fast as it can, then closes. The server session consumes every message
+// the way an ingest path does. In the first pass it reads each message
+// into a flat_buffer and copies it into a std::string handed to the
+// application, as the coro example used to. In the second it receives
+// into a receive_ring and hands the application a view; the views are
+// held in batches of eight and released newest first, so the ring wraps
+// and reuses space out of order. Both passes checksum the payload they
+// were handed, and messages per second and MB/s are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "receive_ring.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// What the application does with a message
+std::size_t checksum(std::size_t sum, char const* data, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; i += 64)
+        sum = sum * 31 + static_cast<unsigned char>(data[i]);
+    return sum + size;
+}
+
+struct result
+{
+    std::size_t messages = 0;
+    std::size_t sum = 0;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point stop;
+};
+
+// Reads into a flat_buffer and copies each message out
+class copy_session : public std::enable_shared_from_this<copy_session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+    result& result_;
+
+  public:
+    copy_session(std::shared_ptr<websocket_stream_base> ws, result& r)
+        : ws_(std::move(ws)), result_(r)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&copy_session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        result_.start = std::chrono::steady_clock::now();
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&copy_session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        if (ec) {
+            result_.stop = std::chrono::steady_clock::now();
+            if (ec != websocket::error::closed)
+                fail(ec, "read");
+            return;
+        }
+        std::string const message = beast::buffers_to_string(buffer_.data());
+        buffer_.consume(buffer_.size());
+        result_.sum = checksum(result_.sum, message.data(), message.size());
+        ++result_.messages;
+        do_read();
+    }
+};
+
+// Receives views into a ring, releasing them in batches
+class ring_session : public std::enable_shared_from_this<ring_session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    receive_ring ring_;
+    std::vector<receive_ring::message> held_;
+    result& result_;
+
+  public:
+    ring_session(std::shared_ptr<websocket_stream_base> ws,
+                 std::size_t capacity, result& r)
+        : ws_(std::move(ws)), ring_(capacity), result_(r)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&ring_session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        result_.start = std::chrono::steady_clock::now();
+        do_receive();
+    }
+
+    void do_receive()
+    {
+        ws_->async_receive(ring_,
+                           beast::bind_front_handler(&ring_session::on_receive,
+                                                     shared_from_this()));
+    }
+
+    void on_receive(beast::error_code ec, receive_ring::message message)
+    {
+        if (ec) {
+            result_.stop = std::chrono::steady_clock::now();
+            if (ec != websocket::error::closed)
+                fail(ec, "receive");
+            return;
+        }
+        result_.sum = checksum(result_.sum, message.data(), message.size());
+        ++result_.messages;
+        held_.push_back(message);
+        if (held_.size() == 8) {
+            while (!held_.empty()) {
+                ring_.release(held_.back());
+                held_.pop_back();
+            }
+        }
+        do_receive();
+    }
+};
+
+// Sends `count` messages of `size` bytes, then closes
+void run_client(tcp::endpoint ep, std::size_t size, std::size_t count)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.next_layer().set_option(tcp::no_delay(true));
+        ws.handshake("localhost", "/");
+        ws.binary(true);
+
+        std::string payload(size, 'x');
+        for (std::size_t i = 0; i < count; ++i) {
+            payload[0] = static_cast<char>('a' + i % 26);
+            ws.write(net::buffer(payload));
+        }
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and returns its result
+template <class Session, class... Args>
+result run_pass(std::size_t size, std::size_t count, Args... args)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(), size, count);
+
+    result r;
+    std::make_shared<Session>(
+        std::make_shared<plain_websocket_stream>(acceptor.accept()), args...,
+        r)
+        ->run();
+    ioc.run();
+    client.join();
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-receive-ring <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-receive-ring 200000 4096\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+
+    // Room for a batch of held messages and the one being received
+    std::size_t const capacity = 16 * (size + 64);
+
+    auto const copied = run_pass<copy_session>(size, count);
+    auto const viewed = run_pass<ring_session>(size, count, capacity);
+    if (copied.sum != viewed.sum || copied.messages != viewed.messages)
+        std::cerr << "checksums differ\n";
+
+    auto const report = [size](char const* name, result const& r) {
+        std::chrono::duration<double> const elapsed = r.stop - r.start;
+        auto const rate = static_cast<double>(r.messages) / elapsed.count();
+        std::cout << name << rate << " msg/s, "
+                  << rate * static_cast<double>(size) / 1e6 << " MB/s\n";
+    };
+    std::cout << count << " messages of " << size << " bytes:\n";
+    report("  flat_buffer, copied: ", copied);
+    report("  receive_ring, views: ", viewed);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: queued async_send with write coalescing vs one write at a time
+//
+// A server session sends bursts of small messages to a synchronous client
+// running on its own thread. In the sequential pass each message is written
+// with async_write once the previous one completes. In the queued pass a
+// whole burst is handed to async_send at once, and the coalescing layer
+// folds the messages queued behind a write in flight into one transport
+// write. The number of writes made to the transport per message is
+// reported for both passes, for a plain and for an SSL stream.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+#include "example/common/server_certificate.hpp"
+
+#include <algorithm>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl;          // from <boost/asio/ssl.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+struct result
+{
+    double rate = 0;
+    double writes_per_message = 0;
+};
+
+// Sends `count` messages in bursts of `burst`
+template <class Stream>
+class sender : public std::enable_shared_from_this<sender<Stream>>
+{
+    std::shared_ptr<Stream> ws_;
+    beast::flat_buffer buffer_;
+    std::string payload_;
+    std::size_t remaining_;
+    std::size_t burst_;
+    std::size_t in_flight_ = 0;
+    bool queued_;
+
+  public:
+    sender(std::shared_ptr<Stream> ws, std::size_t size, std::size_t count,
+           std::size_t burst, bool queued)
+        : ws_(std::move(ws))
+        , payload_(size, 'x')
+        , remaining_(count)
+        , burst_(burst)
+        , queued_(queued)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&sender::on_accept,
+                                                    this->shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        ws_->binary(true);
+        send_burst();
+    }
+
+    void send_burst()
+    {
+        // Wait for the client to close
+        if (remaining_ == 0)
+            return ws_->async_read(
+                buffer_, [self = this->shared_from_this()](
+                             beast::error_code ec, std::size_t) {
+                    if (ec != websocket::error::closed)
+                        fail(ec, "read");
+                });
+        in_flight_ = std::min(burst_, remaining_);
+        remaining_ -= in_flight_;
+        if (!queued_)
+            return write_one();
+        for (std::size_t i = 0; i < in_flight_; ++i)
+            ws_->async_send(payload_,
+                            beast::bind_front_handler(&sender::on_sent,
+                                                      this->shared_from_this()));
+    }
+
+    void write_one()
+    {
+        ws_->async_write(net::buffer(payload_),
+                         beast::bind_front_handler(&sender::on_written,
+                                                   this->shared_from_this()));
+    }
+
+    void on_written(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        if (--in_flight_ > 0)
+            return write_one();
+        send_burst();
+    }
+
+    void on_sent(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "send");
+        if (--in_flight_ == 0)
+            send_burst();
+    }
+};
+
+// Reads `count` messages, then closes
+template <class Stream>
+void run_client(Stream& ws, std::size_t count)
+{
+    try {
+        ws.handshake("localhost", "/");
+        beast::flat_buffer buffer;
+        for (std::size_t i = 0; i < count; ++i) {
+            ws.read(buffer);
+            buffer.consume(buffer.size());
+        }
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and reports the rate and the transport writes per message
+result run_pass(bool use_ssl, bool queued, std::size_t size,
+                std::size_t count, std::size_t burst)
+{
+    net::io_context ioc(1);
+    ssl::context ctx{ssl::context::tlsv12};
+    load_server_certificate(ctx);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    auto const ep = acceptor.local_endpoint();
+
+    std::thread client([use_ssl, ep, count] {
+        net::io_context ioc;
+        if (use_ssl) {
+            ssl::context ctx{ssl::context::tlsv12_client};
+            ctx.set_verify_mode(ssl::verify_none);
+            websocket::stream<beast::ssl_stream<tcp::socket>> ws(ioc, ctx);
+            beast::get_lowest_layer(ws).connect(ep);
+            ws.next_layer().handshake(ssl::stream_base::client);
+            run_client(ws, count);
+        } else {
+            websocket::stream<tcp::socket> ws(ioc);
+            ws.next_layer().connect(ep);
+            run_client(ws, count);
+        }
+    });
+
+    auto socket = acceptor.accept();
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t writes = 0;
+    if (use_ssl) {
+        beast::ssl_stream<beast::tcp_stream> stream(std::move(socket), ctx);
+        stream.handshake(ssl::stream_base::server);
+        auto ws = std::make_shared<ssl_websocket_stream>(std::move(stream));
+        std::make_shared<sender<ssl_websocket_stream>>(ws, size, count, burst,
+                                                       queued)
+            ->run();
+        ioc.run();
+        writes = ws->coalescing_layer().write_count();
+    } else {
+        auto ws = std::make_shared<plain_websocket_stream>(std::move(socket));
+        std::make_shared<sender<plain_websocket_stream>>(ws, size, count,
+                                                         burst, queued)
+            ->run();
+        ioc.run();
+        writes = ws->coalescing_layer().write_count();
+    }
+    client.join();
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    result r;
+    r.rate = static_cast<double>(count) / elapsed.count();
+    r.writes_per_message =
+        static_cast<double>(writes) / static_cast<double>(count);
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 4) {
+        std::cerr << "Usage: bench-send-coalescing <messages> <size> <burst>\n"
+                  << "Example:\n"
+                  << "    bench-send-coalescing 100000 32 16\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+    auto const burst = static_cast<std::size_t>(std::atol(argv[3]));
+
+    for (bool use_ssl : {false, true}) {
+        auto const sequential = run_pass(use_ssl, false, size, count, burst);
+        auto const queued = run_pass(use_ssl, true, size, count, burst);
+        std::cout << (use_ssl ? "ssl" : "plain") << ":\n"
+                  << "  async_write: " << sequential.rate << " msg/s, "
+                  << sequential.writes_per_message
+                  << " transport writes/msg\n"
+                  << "  async_send:  " << queued.rate << " msg/s, "
+                  << queued.writes_per_message << " transport writes/msg\n";
+    }
+
+    return EXIT_SUCCESS;
+}
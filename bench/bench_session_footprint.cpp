@@ -0,0 +1,432 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: memory per session, by component and connection state
+//
+// A server opens a configurable number of loopback connections from a
+// client running in a child process, so that only the server's memory is
+// measured. Each session holds its stream and a flat_buffer, as in the
+// flex example. The heap in use, from mallinfo2, and the resident set
+// size are recorded per connection in three states:
+//
+//      idle        accepted, the stream constructed, nothing started
+//      handshake   TLS and WebSocket handshakes done, a read pending
+//      message     one message received and echoed, a read pending
+//
+// This is done for a plain and an SSL stream, each with and without
+// permessage-deflate. The heap per connection is then split into:
+//
+//      session     the application session object, measured around its
+//                  construction
+//      websocket   the plain stream and its TCP socket when idle
+//      tls         the SSL stream less the plain stream
+//      buffers     the plain stream less the plain stream when idle
+//      deflate     the plain stream with permessage-deflate less the
+//                  plain stream
+//
+// More connections than ports in the ephemeral range are spread over
+// several loopback addresses. Each connection takes a descriptor in each
+// process; the soft limit is raised to the hard limit, which may need
+// raising with `ulimit -n` for 100k connections.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+#include "example/common/server_certificate.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl;          // from <boost/asio/ssl.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the bytes of heap in use by the process
+std::size_t heap_bytes()
+{
+    auto const mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+// Returns the resident set size of the process
+std::size_t resident_bytes()
+{
+    long pages = 0;
+    long resident = 0;
+    if (auto f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return static_cast<std::size_t>(resident) *
+           static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+std::size_t const message_size = 256;
+
+// Connections per loopback address, within the ephemeral port range
+std::size_t const per_address = 20000;
+
+enum state
+{
+    idle,
+    handshake,
+    message,
+    state_count
+};
+
+char const* const state_names[] = {"idle", "handshake", "message"};
+
+// The memory per connection in each state
+struct footprint
+{
+    double heap[state_count] = {};
+    double resident[state_count] = {};
+    double session = 0;
+};
+
+// Tracks the progress of all sessions of a pass
+struct progress
+{
+    std::size_t connections;
+    std::size_t handshakes = 0;
+    std::size_t echoes = 0;
+    std::function<void(state)> on_state;
+
+    void on_handshake()
+    {
+        if (++handshakes == connections)
+            on_state(handshake);
+    }
+
+    void on_echo()
+    {
+        if (++echoes == connections)
+            on_state(message);
+    }
+};
+
+// Completes the handshakes, then echoes messages
+template <class Stream>
+class session : public std::enable_shared_from_this<session<Stream>>
+{
+    std::shared_ptr<Stream> ws_;
+    beast::flat_buffer buffer_;
+    progress& progress_;
+
+  public:
+    session(std::shared_ptr<Stream> ws, progress& p)
+        : ws_(std::move(ws)), progress_(p)
+    {
+    }
+
+    void run()
+    {
+        if constexpr (std::is_same<Stream, ssl_websocket_stream>::value)
+            ws_->next_layer().async_handshake(
+                ssl::stream_base::server,
+                beast::bind_front_handler(&session::on_handshake,
+                                          this->shared_from_this()));
+        else
+            on_handshake({});
+    }
+
+  private:
+    void on_handshake(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "handshake");
+        ws_->async_accept(beast::bind_front_handler(
+            &session::on_accept, this->shared_from_this()));
+    }
+
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+        progress_.on_handshake();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  this->shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The client goes away once the last state has been measured
+        if (ec)
+            return;
+        ws_->text(ws_->got_text());
+        ws_->async_write(buffer_.data(),
+                         beast::bind_front_handler(&session::on_write,
+                                                   this->shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        buffer_.consume(buffer_.size());
+        do_read();
+        progress_.on_echo();
+    }
+};
+
+// Runs in the child process: opens the connections, then completes the
+// handshakes and exchanges a message on each when the parent says so
+template <class Stream>
+void run_client(std::vector<tcp::endpoint> const& endpoints, bool deflate,
+                std::size_t connections, int fd)
+{
+    bool constexpr use_ssl = std::is_same<
+        Stream, websocket::stream<ssl::stream<tcp::socket>>>::value;
+    auto const wait = [fd] {
+        char c;
+        return ::read(fd, &c, 1) == 1;
+    };
+
+    net::io_context ioc;
+    ssl::context ctx(ssl::context::tlsv12_client);
+    ctx.set_verify_mode(ssl::verify_none);
+    std::vector<std::unique_ptr<Stream>> streams;
+    try {
+        for (std::size_t i = 0; i < connections; ++i) {
+            if constexpr (use_ssl)
+                streams.emplace_back(new Stream(ioc, ctx));
+            else
+                streams.emplace_back(new Stream(ioc));
+            beast::get_lowest_layer(*streams.back())
+                .connect(endpoints[i / per_address]);
+        }
+        if (!wait())
+            return;
+
+        for (auto& ws : streams) {
+            if constexpr (use_ssl)
+                ws->next_layer().handshake(ssl::stream_base::client);
+            websocket::permessage_deflate pmd;
+            pmd.client_enable = deflate;
+            ws->set_option(pmd);
+            ws->handshake("localhost", "/");
+        }
+        if (!wait())
+            return;
+
+        std::string const payload(message_size, 'x');
+        beast::flat_buffer buffer;
+        for (auto& ws : streams) {
+            ws->write(net::buffer(payload));
+            ws->read(buffer);
+            buffer.consume(buffer.size());
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+    wait();
+}
+
+// Returns the memory per connection of one stream type
+template <class Stream>
+footprint run_pass(bool deflate, std::size_t connections)
+{
+    bool constexpr use_ssl =
+        std::is_same<Stream, ssl_websocket_stream>::value;
+    using client_stream = typename std::conditional<
+        use_ssl, websocket::stream<ssl::stream<tcp::socket>>,
+        websocket::stream<tcp::socket>>::type;
+
+    ssl::context ctx(ssl::context::tlsv12);
+    load_server_certificate(ctx);
+    net::io_context ioc(1);
+
+    std::vector<std::unique_ptr<tcp::acceptor>> acceptors;
+    std::vector<tcp::endpoint> endpoints;
+    for (std::size_t i = 0; i * per_address < connections; ++i) {
+        auto const address = net::ip::make_address_v4(
+            net::ip::address_v4::loopback().to_uint() +
+            static_cast<unsigned int>(i));
+        acceptors.emplace_back(new tcp::acceptor(ioc, {address, 0}));
+        endpoints.push_back(acceptors.back()->local_endpoint());
+    }
+
+    int fds[2];
+    if (::pipe(fds) != 0)
+        return {};
+    auto const pid = ::fork();
+    if (pid == 0) {
+        ::close(fds[1]);
+        run_client<client_stream>(endpoints, deflate, connections, fds[0]);
+        ::_exit(0);
+    }
+    ::close(fds[0]);
+
+    // Return the pages freed by earlier passes, so that every pass
+    // starts its resident set from the same point
+    ::malloc_trim(0);
+    auto const heap_baseline = heap_bytes();
+    auto const resident_baseline = resident_bytes();
+    footprint result;
+    std::size_t session_bytes = 0;
+    std::vector<std::shared_ptr<session<Stream>>> sessions;
+
+    progress p;
+    p.connections = connections;
+    p.on_state = [&](state s) {
+        auto const n = static_cast<double>(connections);
+        result.heap[s] =
+            static_cast<double>(heap_bytes() - heap_baseline) / n;
+        result.resident[s] =
+            static_cast<double>(resident_bytes() - resident_baseline) / n;
+        if (s == idle) {
+            result.session = static_cast<double>(session_bytes) / n;
+            for (auto const& session : sessions)
+                session->run();
+        } else if (s == message) {
+            sessions.clear();
+            ::close(fds[1]);
+            return;
+        }
+        auto const c = 'x';
+        if (::write(fds[1], &c, 1) != 1)
+            fail({}, "pipe");
+    };
+
+    std::size_t accepted = 0;
+    std::function<void(tcp::acceptor&)> do_accept = [&](tcp::acceptor& a) {
+        a.async_accept([&](beast::error_code ec, tcp::socket socket) {
+            if (ec == net::error::operation_aborted)
+                return;
+            if (ec)
+                return fail(ec, "accept");
+            std::shared_ptr<Stream> ws;
+            if constexpr (use_ssl)
+                ws = std::make_shared<Stream>(std::move(socket), ctx);
+            else
+                ws = std::make_shared<Stream>(std::move(socket));
+            websocket::permessage_deflate pmd;
+            pmd.server_enable = deflate;
+            ws->set_option(pmd);
+
+            auto const before = heap_bytes();
+            sessions.push_back(
+                std::make_shared<session<Stream>>(std::move(ws), p));
+            session_bytes += heap_bytes() - before;
+
+            if (++accepted < connections)
+                return do_accept(a);
+            acceptors.clear();
+            p.on_state(idle);
+        });
+    };
+    for (auto& a : acceptors)
+        do_accept(*a);
+    ioc.run();
+
+    int status;
+    ::waitpid(pid, &status, 0);
+    return result;
+}
+
+// Raise the descriptor limit as far as allowed
+void raise_descriptor_limit(std::size_t connections)
+{
+    rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) != 0)
+        return;
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < connections + 64)
+        std::cerr << "warning: the descriptor limit is " << rl.rlim_cur
+                  << ", raise it with ulimit -n\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 2) {
+        std::cerr << "Usage: bench-session-footprint <connections>\n"
+                  << "Example:\n"
+                  << "    bench-session-footprint 100000\n";
+        return EXIT_FAILURE;
+    }
+    auto const connections = static_cast<std::size_t>(std::atol(argv[1]));
+    raise_descriptor_limit(connections);
+
+    auto const plain = run_pass<plain_websocket_stream>(false, connections);
+    auto const plain_deflate =
+        run_pass<plain_websocket_stream>(true, connections);
+    auto const secure = run_pass<ssl_websocket_stream>(false, connections);
+    auto const secure_deflate =
+        run_pass<ssl_websocket_stream>(true, connections);
+
+    std::cout << std::fixed << std::setprecision(0) << connections
+              << " connections, bytes per connection\n\n"
+              << "measured       state        heap       rss\n";
+    auto const measured = [](char const* name, footprint const& f) {
+        for (int s = 0; s < state_count; ++s)
+            std::cout << std::left << std::setw(15) << name << std::setw(10)
+                      << state_names[s] << std::right << std::setw(8)
+                      << f.heap[s] << std::setw(10) << f.resident[s] << "\n";
+    };
+    measured("plain", plain);
+    measured("plain+deflate", plain_deflate);
+    measured("ssl", secure);
+    measured("ssl+deflate", secure_deflate);
+
+    std::cout << "\nheap by component\n"
+              << "state        session websocket       tls   buffers   deflate"
+                 "     total\n";
+    for (int s = 0; s < state_count; ++s) {
+        double const parts[] = {
+            plain.session,
+            plain.heap[idle] - plain.session,
+            secure.heap[s] - plain.heap[s],
+            plain.heap[s] - plain.heap[idle],
+            plain_deflate.heap[s] - plain.heap[s],
+        };
+        double total = 0;
+        std::cout << std::left << std::setw(10) << state_names[s]
+                  << std::right;
+        for (auto const part : parts) {
+            total += part;
+            std::cout << std::setw(10) << part;
+        }
+        std::cout << std::setw(10) << total << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,343 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: io_context per core vs one io_context shared by all threads
+//
+// An echo server is run with 1..N threads in two ways. In the shared pass
+// one io_context is run by every thread, one acceptor hands out sockets,
+// and each session runs on a strand, as the flex example does. In the
+// sharded pass a sharded_server runs one io_context per thread, each
+// pinned to a core and listening on the same port with SO_REUSEPORT, and
+// sessions run on their shard without a strand. The third pass repeats
+// the sharded one with sessions from a session_slab per shard, each
+// holding its stream by value and bound into its handlers with a
+// session_ptr instead of a shared_ptr.
+//
+// Clients running as many threads as the server keep one 64 byte message
+// in flight on each connection for a fixed time. The number of echoes
+// per second is reported for both passes at every thread count.
+//
+//------------------------------------------------------------------------------
+
+#include "session_slab.hpp"
+#include "sharded_server.hpp"
+#include "websocket_stream.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Echoes every message back until the client goes away
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+
+  public:
+    explicit session(std::shared_ptr<websocket_stream_base> ws)
+        : ws_(std::move(ws))
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(
+            beast::bind_front_handler(&session::on_accept, shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The client drops the connections when the time is up
+        if (ec)
+            return;
+        ws_->text(ws_->got_text());
+        ws_->async_write(buffer_.data(),
+                         beast::bind_front_handler(&session::on_write,
+                                                   shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return;
+        buffer_.consume(buffer_.size());
+        do_read();
+    }
+};
+
+void start_session(tcp::socket socket)
+{
+    std::make_shared<session>(
+        std::make_shared<plain_websocket_stream>(std::move(socket)))
+        ->run();
+}
+
+// The same session, stored in a slab and owned through session_ptr
+class slab_echo_session : public slab_session<slab_echo_session>
+{
+    plain_websocket_stream ws_;
+    beast::flat_buffer buffer_;
+
+  public:
+    explicit slab_echo_session(tcp::socket socket) : ws_(std::move(socket)) {}
+
+    void run()
+    {
+        ws_.async_accept(
+            beast::bind_front_handler(&slab_echo_session::on_accept, self()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_.async_read(buffer_,
+                       beast::bind_front_handler(&slab_echo_session::on_read,
+                                                 self()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        // The client drops the connections when the time is up
+        if (ec)
+            return;
+        ws_.text(ws_.got_text());
+        ws_.async_write(buffer_.data(),
+                        beast::bind_front_handler(&slab_echo_session::on_write,
+                                                  self()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return;
+        buffer_.consume(buffer_.size());
+        do_read();
+    }
+};
+
+// One client thread: keeps a message in flight on each of its connections
+class client
+{
+    net::io_context ioc_{1};
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> streams_;
+    std::vector<beast::flat_buffer> buffers_;
+    std::string const payload_ = std::string(64, 'x');
+    std::size_t echoes_ = 0;
+    bool done_ = false;
+
+    void do_write(std::size_t i)
+    {
+        streams_[i]->async_write(
+            net::buffer(payload_),
+            [this, i](beast::error_code ec, std::size_t) {
+                if (ec)
+                    return;
+                streams_[i]->async_read(
+                    buffers_[i], [this, i](beast::error_code ec, std::size_t) {
+                        if (ec)
+                            return;
+                        buffers_[i].consume(buffers_[i].size());
+                        if (done_)
+                            return;
+                        ++echoes_;
+                        do_write(i);
+                    });
+            });
+    }
+
+  public:
+    client(tcp::endpoint ep, std::size_t connections) : buffers_(connections)
+    {
+        for (std::size_t i = 0; i < connections; ++i) {
+            streams_.emplace_back(new websocket::stream<tcp::socket>(ioc_));
+            streams_.back()->next_layer().connect(ep);
+            streams_.back()->handshake("localhost", "/");
+        }
+    }
+
+    // Returns the number of echoes completed in `duration`
+    std::size_t run(std::chrono::duration<double> duration)
+    {
+        net::steady_timer timer(ioc_,
+                                std::chrono::duration_cast<
+                                    net::steady_timer::duration>(duration));
+        timer.async_wait([this](beast::error_code) {
+            done_ = true;
+            for (auto& ws : streams_)
+                ws->next_layer().close();
+        });
+        for (std::size_t i = 0; i < streams_.size(); ++i)
+            do_write(i);
+        ioc_.run();
+        return echoes_;
+    }
+};
+
+// Connects the clients, then returns the echoes per second
+double run_clients(tcp::endpoint ep, std::size_t threads,
+                   std::size_t connections, double seconds)
+{
+    std::vector<std::unique_ptr<client>> clients;
+    for (std::size_t i = 0; i < threads; ++i)
+        clients.emplace_back(new client(
+            ep, connections / threads + (i < connections % threads ? 1 : 0)));
+
+    std::atomic<std::size_t> echoes{0};
+    std::vector<std::thread> v;
+    for (auto& c : clients)
+        v.emplace_back([&echoes, &c, seconds] {
+            echoes += c->run(std::chrono::duration<double>(seconds));
+        });
+    for (auto& t : v)
+        t.join();
+    return static_cast<double>(echoes) / seconds;
+}
+
+// One io_context run by every thread, a strand per session
+double run_shared(std::size_t threads, std::size_t connections,
+                  double seconds)
+{
+    net::io_context ioc{static_cast<int>(threads)};
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    std::function<void()> do_accept = [&] {
+        acceptor.async_accept(
+            net::make_strand(ioc),
+            [&](beast::error_code ec, tcp::socket socket) {
+                if (ec == net::error::operation_aborted)
+                    return;
+                if (ec)
+                    fail(ec, "accept");
+                else
+                    start_session(std::move(socket));
+                do_accept();
+            });
+    };
+    do_accept();
+
+    auto work = net::make_work_guard(ioc);
+    std::vector<std::thread> v;
+    for (std::size_t i = 0; i < threads; ++i)
+        v.emplace_back([&ioc] { ioc.run(); });
+
+    auto const rate = run_clients(acceptor.local_endpoint(), threads,
+                                  connections, seconds);
+    ioc.stop();
+    for (auto& t : v)
+        t.join();
+    return rate;
+}
+
+// One io_context per thread, an SO_REUSEPORT acceptor per shard
+double run_sharded(std::size_t threads, std::size_t connections,
+                   double seconds, bool slab, bool& reuses_port)
+{
+    // The slabs outlive the shards, whose handlers hold their sessions
+    std::vector<session_slab<slab_echo_session>> slabs(threads);
+    sharded_server server(
+        threads, [&slabs, slab](tcp::socket socket, std::size_t shard) {
+            if (slab)
+                slabs[shard].create(std::move(socket))->run();
+            else
+                start_session(std::move(socket));
+        });
+    beast::error_code ec;
+    server.listen({net::ip::make_address("127.0.0.1"), 0}, ec);
+    if (ec) {
+        fail(ec, "listen");
+        return 0;
+    }
+    reuses_port = server.reuses_port();
+    server.start();
+
+    auto const rate = run_clients(server.local_endpoint(), threads,
+                                  connections, seconds);
+    server.stop();
+    server.join();
+    return rate;
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 4) {
+        std::cerr << "Usage: bench-sharded-scaling <threads> <connections> "
+                     "<seconds>\n"
+                  << "Example:\n"
+                  << "    bench-sharded-scaling 8 256 5\n";
+        return EXIT_FAILURE;
+    }
+    auto const max_threads =
+        std::max<std::size_t>(1, static_cast<std::size_t>(std::atol(argv[1])));
+    auto const connections =
+        std::max<std::size_t>(1, static_cast<std::size_t>(std::atol(argv[2])));
+    auto const seconds = std::atof(argv[3]);
+
+    std::cout << sharded_server::hardware_shards() << " cores, "
+              << connections << " connections\n";
+    for (std::size_t threads = 1; threads <= max_threads; ++threads) {
+        bool reuses_port = false;
+        auto const shared = run_shared(threads, connections, seconds);
+        auto const sharded =
+            run_sharded(threads, connections, seconds, false, reuses_port);
+        auto const slab =
+            run_sharded(threads, connections, seconds, true, reuses_port);
+        std::cout << threads << " threads:\n"
+                  << "  shared io_context: " << shared << " msg/s\n"
+                  << "  io_context per core: " << sharded << " msg/s"
+                  << (reuses_port ? "" : " (single acceptor)") << "\n"
+                  << "  per core, slab sessions: " << slab << " msg/s\n";
+    }
+
+    return EXIT_SUCCESS;
+}
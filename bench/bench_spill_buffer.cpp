@@ -0,0 +1,222 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: resident memory while receiving large messages,
+// flat_buffer vs spill_buffer
+//
+// Each pass runs in a child process. A synchronous client on its own
+// thread sends large messages as frames of 1 MiB, taken from one 1 MiB
+// payload, so the client holds little memory of its own. The server
+// session reads each message through the type-erased async_read, in the
+// first pass into a flat_buffer and in the second into a spill_buffer
+// with a 1 MiB threshold, then checksums every page of it and clears the
+// buffer. When each message completes, before the checksum, the anonymous
+// and file-backed resident memory of the process is sampled from
+// /proc/self/status; the largest samples are reported, with the peak
+// resident set of the child, which includes the pages of the view the
+// checksum touches.
+//
+// The spill file is created in $TMPDIR, or /tmp. On tmpfs its pages are
+// shared memory rather than page cache, and stay resident until freed.
+//
+//------------------------------------------------------------------------------
+
+#include "spill_buffer.hpp"
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+std::size_t const frame_size = 1024 * 1024;
+
+// Returns a field of /proc/self/status, in bytes
+std::size_t status_bytes(char const* field)
+{
+    std::size_t kb = 0;
+    if (auto f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        auto const len = std::strlen(field);
+        while (std::fgets(line, sizeof(line), f)) {
+            if (std::strncmp(line, field, len) == 0 && line[len] == ':') {
+                kb = static_cast<std::size_t>(
+                    std::strtoul(line + len + 1, nullptr, 10));
+                break;
+            }
+        }
+        std::fclose(f);
+    }
+    return kb * 1024;
+}
+
+struct result
+{
+    std::size_t sum = 0;
+    std::size_t anonymous = 0;
+    std::size_t file = 0;
+};
+
+// Reads every message into a Buffer, checksums and clears it
+template <class Buffer>
+class session : public std::enable_shared_from_this<session<Buffer>>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    Buffer buffer_;
+    result& result_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws, Buffer buffer,
+            result& r)
+        : ws_(std::move(ws)), buffer_(std::move(buffer)), result_(r)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    this->shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  this->shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+
+        result_.anonymous =
+            (std::max)(result_.anonymous, status_bytes("RssAnon"));
+        result_.file = (std::max)(result_.file, status_bytes("RssFile") +
+                                                    status_bytes("RssShmem"));
+        auto const data = buffer_.data();
+        auto const p = static_cast<unsigned char const*>(data.data());
+        for (std::size_t i = 0; i < data.size(); i += 4096)
+            result_.sum = result_.sum * 31 + p[i];
+        buffer_.clear();
+        do_read();
+    }
+};
+
+// Sends `count` messages of `frames` frames, then closes
+void run_client(tcp::endpoint ep, std::size_t frames, std::size_t count)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+        ws.auto_fragment(false);
+        ws.binary(true);
+
+        std::string const payload(frame_size, 'x');
+        for (std::size_t i = 0; i < count; ++i)
+            for (std::size_t j = 0; j < frames; ++j)
+                ws.write_some(j + 1 == frames, net::buffer(payload));
+        ws.close(websocket::close_code::normal);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass in this process and prints its samples
+template <class Buffer>
+void run_pass(char const* name, Buffer buffer, std::size_t frames,
+              std::size_t count)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    std::thread client(run_client, acceptor.local_endpoint(), frames, count);
+
+    result r;
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+    ws->read_message_max(frames * frame_size);
+    std::make_shared<session<Buffer>>(std::move(ws), std::move(buffer), r)
+        ->run();
+    ioc.run();
+    client.join();
+
+    std::cout << name << "received: anonymous "
+              << r.anonymous / (1024 * 1024) << " MiB, file-backed "
+              << r.file / (1024 * 1024) << " MiB; ";
+    std::cout.flush();
+}
+
+// Runs a pass in a child process and prints its peak resident set
+template <class Buffer>
+void run_child(char const* name, Buffer buffer, std::size_t frames,
+               std::size_t count)
+{
+    std::cout.flush();
+    auto const pid = ::fork();
+    if (pid == 0) {
+        run_pass(name, std::move(buffer), frames, count);
+        std::_Exit(EXIT_SUCCESS);
+    }
+    int status = 0;
+    struct rusage usage = {};
+    ::wait4(pid, &status, 0, &usage);
+    std::cout << "peak resident " << usage.ru_maxrss / 1024 << " MiB\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-spill-buffer <messages> <size in MiB>\n"
+                  << "Example:\n"
+                  << "    bench-spill-buffer 4 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const frames = static_cast<std::size_t>(std::atol(argv[2]));
+
+    std::cout << count << " messages of " << frames << " MiB:\n";
+    run_child("  flat_buffer:  ", beast::flat_buffer(), frames, count);
+    run_child("  spill_buffer: ", spill_buffer(frame_size), frames, count);
+
+    return EXIT_SUCCESS;
+}
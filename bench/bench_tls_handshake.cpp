@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: shared TLS context vs a context per connection
+//
+// A client thread makes connections one after the other and completes a
+// full TLS handshake on each. In the first pass the server builds an
+// ssl::context and loads the certificate, key and DH parameters for
+// every connection, as the coro example used to. In the second pass
+// every connection uses the context of an ssl_context_provider. The
+// third pass repeats the second while another thread reloads the
+// certificates continuously. Handshakes per second are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "ssl_context_provider.hpp"
+#include "example/common/server_certificate.hpp"
+
+#include <atomic>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace beast = boost::beast;      // from <boost/beast.hpp>
+namespace net = boost::asio;         // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl;    // from <boost/asio/ssl.hpp>
+using tcp = boost::asio::ip::tcp;    // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+enum class mode
+{
+    per_connection,
+    shared,
+    reloading
+};
+
+// Completes `count` client handshakes against `ep`
+void run_client(tcp::endpoint ep, std::size_t count)
+{
+    net::io_context ioc;
+    ssl::context ctx(ssl::context::tlsv12_client);
+    ctx.set_verify_mode(ssl::verify_none);
+    for (std::size_t i = 0; i < count; ++i) {
+        beast::ssl_stream<tcp::socket> stream(ioc, ctx);
+        stream.next_layer().connect(ep);
+        beast::error_code ec;
+        stream.handshake(ssl::stream_base::client, ec);
+        if (ec)
+            return fail(ec, "client handshake");
+    }
+}
+
+// Returns the handshakes completed per second
+double run_pass(mode m, std::size_t count, std::size_t& reloads)
+{
+    net::io_context ioc;
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    ssl_context_provider tls(ssl::context::tlsv12, load_server_certificate);
+
+    std::atomic<bool> done{false};
+    std::thread reloader;
+    if (m == mode::reloading)
+        reloader = std::thread([&tls, &done] {
+            while (!done)
+                tls.reload();
+        });
+
+    std::thread client([ep = acceptor.local_endpoint(), count] {
+        run_client(ep, count);
+    });
+
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        auto socket = acceptor.accept();
+        std::shared_ptr<ssl::context> ctx;
+        if (m == mode::per_connection) {
+            ctx = std::make_shared<ssl::context>(ssl::context::tlsv12);
+            load_server_certificate(*ctx);
+        } else {
+            ctx = tls.get();
+        }
+        beast::ssl_stream<tcp::socket> stream(std::move(socket), *ctx);
+        beast::error_code ec;
+        stream.handshake(ssl::stream_base::server, ec);
+        if (ec) {
+            fail(ec, "server handshake");
+            break;
+        }
+    }
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    done = true;
+    client.join();
+    if (reloader.joinable())
+        reloader.join();
+    reloads = tls.generation();
+    return static_cast<double>(count) / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 2) {
+        std::cerr << "Usage: bench-tls-handshake <handshakes>\n"
+                  << "Example:\n"
+                  << "    bench-tls-handshake 2000\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+
+    std::size_t reloads = 0;
+    auto const per_connection = run_pass(mode::per_connection, count, reloads);
+    auto const shared = run_pass(mode::shared, count, reloads);
+    auto const reloading = run_pass(mode::reloading, count, reloads);
+    std::cout << count << " handshakes:\n"
+              << "  context per connection: " << per_connection << " /s\n"
+              << "  shared context:         " << shared << " /s\n"
+              << "  shared, reloading:      " << reloading << " /s, "
+              << reloads << " reloads\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: type-erased virtual async operations vs the static-cast path
+//
+// A loopback echo server is driven by a single client. The server session
+// either dispatches every accept, read and write through the virtual,
+// type-erased members of websocket_stream_base, or checks use_ssl() and
+// calls the static helpers with a downcast stream, which instantiates the
+// composed operations for every handler type on both stream types.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Echoes back all received WebSocket messages
+class echo_session : public std::enable_shared_from_this<echo_session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+    bool erased_;
+
+  public:
+    echo_session(std::shared_ptr<websocket_stream_base> ws, bool erased)
+        : ws_(std::move(ws)), erased_(erased)
+    {
+    }
+
+    void run()
+    {
+        auto handler = beast::bind_front_handler(&echo_session::on_accept,
+                                                 shared_from_this());
+        if (erased_)
+            ws_->async_accept(std::move(handler));
+        else if (ws_->use_ssl())
+            websocket_stream_base::async_accept(
+                static_cast<ssl_websocket_stream&>(*ws_), std::move(handler));
+        else
+            websocket_stream_base::async_accept(
+                static_cast<plain_websocket_stream&>(*ws_),
+                std::move(handler));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read()
+    {
+        auto handler = beast::bind_front_handler(&echo_session::on_read,
+                                                 shared_from_this());
+        if (erased_)
+            ws_->async_read(buffer_, std::move(handler));
+        else if (ws_->use_ssl())
+            websocket_stream_base::async_read(
+                static_cast<ssl_websocket_stream&>(*ws_), buffer_,
+                std::move(handler));
+        else
+            websocket_stream_base::async_read(
+                static_cast<plain_websocket_stream&>(*ws_), buffer_,
+                std::move(handler));
+    }
+
+    void on_read(beast::error_code ec, std::size_t)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+
+        ws_->text(ws_->got_text());
+        auto handler = beast::bind_front_handler(&echo_session::on_write,
+                                                 shared_from_this());
+        if (erased_)
+            ws_->async_write(buffer_.data(), std::move(handler));
+        else if (ws_->use_ssl())
+            websocket_stream_base::async_write(
+                static_cast<ssl_websocket_stream&>(*ws_), buffer_.data(),
+                std::move(handler));
+        else
+            websocket_stream_base::async_write(
+                static_cast<plain_websocket_stream&>(*ws_), buffer_.data(),
+                std::move(handler));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        buffer_.consume(buffer_.size());
+        do_read();
+    }
+};
+
+// Sends `count` messages, waits for each echo, then closes
+class echo_client
+{
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    std::string payload_;
+    std::size_t remaining_;
+    std::chrono::steady_clock::time_point done_;
+
+  public:
+    echo_client(net::io_context& ioc, std::size_t size, std::size_t count)
+        : ws_(ioc), payload_(size, 'x'), remaining_(count)
+    {
+    }
+
+    websocket::stream<beast::tcp_stream>& ws() { return ws_; }
+
+    std::chrono::steady_clock::time_point done() const { return done_; }
+
+    void run()
+    {
+        ws_.async_write(net::buffer(payload_),
+                        [this](beast::error_code ec, std::size_t) {
+                            if (ec)
+                                return fail(ec, "client write");
+                            ws_.async_read(buffer_, [this](beast::error_code ec,
+                                                           std::size_t) {
+                                on_echo(ec);
+                            });
+                        });
+    }
+
+  private:
+    void on_echo(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "client read");
+        buffer_.consume(buffer_.size());
+        if (--remaining_ > 0)
+            return run();
+
+        done_ = std::chrono::steady_clock::now();
+        ws_.async_close(websocket::close_code::normal,
+                        [](beast::error_code ec) {
+                            if (ec)
+                                fail(ec, "client close");
+                        });
+    }
+};
+
+// Runs one echo pass and returns the number of round trips per second
+double run_pass(bool erased, std::size_t size, std::size_t count)
+{
+    net::io_context ioc(1);
+
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+    acceptor.async_accept([&](beast::error_code ec, tcp::socket socket) {
+        if (ec)
+            return fail(ec, "accept");
+        std::make_shared<echo_session>(
+            std::make_shared<plain_websocket_stream>(std::move(socket)),
+            erased)
+            ->run();
+    });
+
+    echo_client client(ioc, size, count);
+    beast::get_lowest_layer(client.ws()).connect(acceptor.local_endpoint());
+
+    bool open = false;
+    client.ws().async_handshake("localhost", "/",
+                                [&open](beast::error_code ec) {
+                                    if (ec)
+                                        return fail(ec, "handshake");
+                                    open = true;
+                                });
+    while (!open && ioc.run_one() > 0)
+        ;
+    if (!open)
+        return 0;
+
+    auto const start = std::chrono::steady_clock::now();
+    client.run();
+    ioc.run();
+    std::chrono::duration<double> const elapsed = client.done() - start;
+    return static_cast<double>(count) / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-type-erased-async <messages> <size>\n"
+                  << "Example:\n"
+                  << "    bench-type-erased-async 100000 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2]));
+
+    // Warm up the loopback path before measuring
+    run_pass(false, size, count / 10 + 1);
+
+    auto const cast_rate = run_pass(false, size, count);
+    auto const erased_rate = run_pass(true, size, count);
+
+    std::cout << "static-cast path: " << cast_rate << " round trips/s\n"
+              << "type-erased path: " << erased_rate << " round trips/s\n"
+              << "ratio:            " << erased_rate / cast_rate << "\n";
+
+    return EXIT_SUCCESS;
+}
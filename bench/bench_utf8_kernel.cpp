@@ -0,0 +1,280 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: UTF-8 validation kernels, and text vs binary messages
+//
+// The first part validates 1 MiB of ASCII, of mixed-script text (Latin,
+// Cyrillic, CJK and emoji) and of the same text with one invalid byte
+// near the end, with each kernel the CPU supports and with the stream's
+// utf8_checker fed 4 KiB at a time as frames arrive. The results of
+// every kernel are checked to agree, and the throughput of each is
+// reported in GB/s.
+//
+// The second part sends `count` messages of the given size from a
+// synchronous client on its own thread to a server session, which reads
+// them with the type-erased async_read, first as binary messages and
+// then as text messages of the same mixed-script payload. The wall time
+// and CPU time of each pass are reported; with the vectorized checker a
+// text message costs about as much per byte as a binary one.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+namespace utf8_kernel = websocket::utf8_kernel;
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the CPU time used by the process, in seconds
+double cpu_seconds()
+{
+    struct rusage usage = {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Returns `size` bytes of well-formed text mixing 1 to 4 byte code points
+std::string mixed_text(std::size_t size)
+{
+    char const* const words[] = {"websocket ", "\xd0\xbf\xd1\x80\xd0\xb8 ",
+                                 "\xe6\x96\x87\xe5\xad\x97 ",
+                                 "\xf0\x9f\x98\x80 ", "{\"id\": 42} "};
+    std::string s;
+    for (std::size_t i = 0; s.size() < size; ++i)
+        s += words[(i * 7 + i / 3) % 5];
+    // Cut at a code point boundary and pad with ASCII
+    s.resize(size);
+    auto n = size;
+    while (n > 0 && (static_cast<unsigned char>(s[n - 1]) & 0xc0) == 0x80)
+        --n;
+    if (n > 0 && static_cast<unsigned char>(s[n - 1]) >= 0xc0)
+        --n;
+    std::fill(s.begin() + static_cast<std::ptrdiff_t>(n), s.end(), ' ');
+    return s;
+}
+
+// Returns the throughput of validating `n` bytes repeatedly, in GB/s
+template <class Validate>
+double measure(Validate&& validate, unsigned char const* p, std::size_t n)
+{
+    std::size_t const total = std::size_t(1) << 31;
+    auto const rounds = (std::max)(total / n, std::size_t(16));
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t valid = 0;
+    for (std::size_t i = 0; i < rounds; ++i)
+        valid += validate(p, n);
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (valid != 0 && valid != rounds)
+        std::cerr << "inconsistent result\n";
+    return static_cast<double>(n * rounds) / elapsed.count() / 1e9;
+}
+
+// Validates as the stream does, one frame at a time
+bool validate_frames(unsigned char const* p, std::size_t n)
+{
+    websocket::detail::utf8_checker checker;
+    for (std::size_t i = 0; i < n; i += 4096)
+        if (!checker.write(p + i, (std::min)(n - i, std::size_t(4096))))
+            return false;
+    return checker.finish();
+}
+
+bool run_kernels()
+{
+    std::size_t const size = 1024 * 1024;
+    auto const text = mixed_text(size);
+    auto invalid = text;
+    invalid[size - 100] = '\xff';
+    struct input
+    {
+        char const* name;
+        std::string data;
+    };
+    input const inputs[] = {{"ascii", std::string(size, 'a')},
+                            {"mixed", text},
+                            {"invalid", invalid}};
+
+    std::cout << std::setw(10) << "input" << std::setw(10) << "scalar";
+    if (utf8_kernel::supported(utf8_kernel::isa::avx2))
+        std::cout << std::setw(10) << "avx2";
+    std::cout << std::setw(10) << "frames"
+              << "   GB/s, frames: utf8_checker as used by the stream\n";
+
+    bool ok = true;
+    for (auto const& in : inputs) {
+        auto const p = reinterpret_cast<unsigned char const*>(in.data.data());
+        auto const expected = utf8_kernel::validate_scalar(p, size);
+        std::cout << std::setw(10) << in.name << std::fixed
+                  << std::setprecision(2) << std::setw(10)
+                  << measure(&utf8_kernel::validate_scalar, p, size);
+        if (utf8_kernel::supported(utf8_kernel::isa::avx2)) {
+            auto const f = utf8_kernel::get(utf8_kernel::isa::avx2);
+            ok &= f(p, size) == expected;
+            std::cout << std::setw(10) << measure(f, p, size);
+        }
+        ok &= validate_frames(p, size) == expected;
+        std::cout << std::setw(10) << measure(&validate_frames, p, size)
+                  << "\n";
+    }
+    if (!ok)
+        std::cerr << "kernels disagree\n";
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+
+// Reads messages until the client closes, checking their size
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    beast::flat_buffer buffer_;
+    std::size_t size_;
+    std::size_t count_ = 0;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws, std::size_t size)
+        : ws_(std::move(ws)), size_(size)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    shared_from_this()));
+    }
+
+    std::size_t count() const { return count_; }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        ws_->read_message_max(size_ + 1);
+        do_read();
+    }
+
+    void do_read()
+    {
+        ws_->async_read(buffer_,
+                        beast::bind_front_handler(&session::on_read,
+                                                  shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        if (ec == websocket::error::closed)
+            return;
+        if (ec)
+            return fail(ec, "read");
+        if (bytes_transferred != size_)
+            std::cerr << "read: bad message\n";
+        ++count_;
+        buffer_.clear();
+        do_read();
+    }
+};
+
+// Writes the payload `count` times, then closes
+void run_client(tcp::endpoint ep, std::string const& payload,
+                std::size_t count, bool text)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+        ws.text(text);
+        for (std::size_t i = 0; i < count; ++i)
+            ws.write(net::buffer(payload));
+        ws.close(websocket::close_code::normal);
+
+        // Wait for the close frame of the server
+        beast::flat_buffer buffer;
+        beast::error_code ec;
+        while (!ec)
+            ws.read(buffer, ec);
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and prints its times
+void run_pass(char const* name, std::string const& payload,
+              std::size_t count, bool text)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    auto const cpu = cpu_seconds();
+    auto const start = std::chrono::steady_clock::now();
+    std::thread client(run_client, acceptor.local_endpoint(),
+                       std::cref(payload), count, text);
+
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+    auto s = std::make_shared<session>(ws, payload.size());
+    s->run();
+    ioc.run();
+    client.join();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (s->count() != count)
+        std::cerr << name << "received " << s->count() << " of " << count
+                  << " messages\n";
+    std::cout << name << elapsed.count() << " s, "
+              << payload.size() * count / elapsed.count() / (1024 * 1024)
+              << " MiB/s, cpu " << cpu_seconds() - cpu << " s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-utf8-kernel <messages> <size in KiB>\n"
+                  << "Example:\n"
+                  << "    bench-utf8-kernel 1000 1024\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[2])) * 1024;
+
+    if (!run_kernels())
+        return EXIT_FAILURE;
+
+    auto const payload = mixed_text(size);
+    std::cout << "\n" << count << " messages of " << size / 1024 << " KiB:\n";
+    run_pass("  binary: ", payload, count, false);
+    run_pass("  text:   ", payload, count, true);
+
+    return EXIT_SUCCESS;
+}
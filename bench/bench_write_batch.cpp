@@ -0,0 +1,212 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: writing small messages one at a time vs in batches
+//
+// The server session writes `batches` batches of `batch` messages of the
+// given size, every other one text, to a synchronous client on its own
+// thread, which reads each message and checks its size, opcode and
+// first byte. The first pass writes each message with the type-erased
+// async_write, waiting for one before starting the next, the second
+// writes each batch with async_write_batch. The messages per second, the
+// CPU time of the process and the number of writes to the transport of
+// each pass are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the CPU time used by the process, in seconds
+double cpu_seconds()
+{
+    struct rusage usage = {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Writes the messages `batches` times, then closes
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    std::vector<websocket::batch_message> const& messages_;
+    std::size_t batches_;
+    bool batched_;
+    std::size_t next_ = 0;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws,
+            std::vector<websocket::batch_message> const& messages,
+            std::size_t batches, bool batched)
+        : ws_(std::move(ws))
+        , messages_(messages)
+        , batches_(batches)
+        , batched_(batched)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        do_write();
+    }
+
+    void do_write()
+    {
+        if (next_ == 0 && batches_-- == 0)
+            return ws_->async_close(
+                websocket::close_code::normal,
+                beast::bind_front_handler(&session::on_close,
+                                          shared_from_this()));
+        if (batched_)
+            return ws_->async_write_batch(
+                beast::span<websocket::batch_message const>(messages_),
+                beast::bind_front_handler(&session::on_write,
+                                          shared_from_this()));
+        auto const& m = messages_[next_];
+        next_ = (next_ + 1) % messages_.size();
+        ws_->binary(m.binary);
+        ws_->async_write(m.payload,
+                         beast::bind_front_handler(&session::on_write,
+                                                   shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        do_write();
+    }
+
+    void on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+    }
+};
+
+// Reads messages until the server closes, checking each of them
+void run_client(tcp::endpoint ep, std::size_t batch, std::size_t size)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        beast::flat_buffer buffer;
+        for (std::size_t i = 0;; i = (i + 1) % batch) {
+            beast::error_code ec;
+            ws.read(buffer, ec);
+            if (ec == websocket::error::closed)
+                break;
+            if (ec)
+                return fail(ec, "client");
+            auto const data = buffer.data();
+            if (data.size() != size || ws.got_binary() != (i % 2 == 1) ||
+                (size > 0 && *static_cast<char const*>(data.data()) !=
+                                 static_cast<char>('a' + i % 26)))
+                std::cerr << "client: bad message\n";
+            buffer.clear();
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and prints its rates
+void run_pass(char const* name,
+              std::vector<websocket::batch_message> const& messages,
+              std::size_t size, std::size_t batches, bool batched)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    auto const cpu = cpu_seconds();
+    auto const start = std::chrono::steady_clock::now();
+    std::thread client(run_client, acceptor.local_endpoint(),
+                       messages.size(), size);
+
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+    auto const& layer = ws->coalescing_layer();
+    std::make_shared<session>(ws, messages, batches, batched)->run();
+    ioc.run();
+    client.join();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << name << messages.size() * batches / elapsed.count()
+              << " msg/s, cpu " << cpu_seconds() - cpu << " s, "
+              << layer.write_count() << " writes\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 4) {
+        std::cerr << "Usage: bench-write-batch <batches> <messages per batch> "
+                     "<size>\n"
+                  << "Example:\n"
+                  << "    bench-write-batch 10000 32 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const batches = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const batch = static_cast<std::size_t>(std::atol(argv[2]));
+    auto const size = static_cast<std::size_t>(std::atol(argv[3]));
+    if (batch == 0) {
+        std::cerr << "A batch holds at least one message\n";
+        return EXIT_FAILURE;
+    }
+
+    // Every other message is binary, and each starts with its own letter
+    std::vector<std::string> payloads;
+    std::vector<websocket::batch_message> messages;
+    for (std::size_t i = 0; i < batch; ++i)
+        payloads.emplace_back(size, static_cast<char>('a' + i % 26));
+    for (std::size_t i = 0; i < batch; ++i)
+        messages.push_back({net::buffer(payloads[i]), i % 2 == 1});
+
+    std::cout << batches << " batches of " << batch << " messages of " << size
+              << " bytes:\n";
+    run_pass("  async_write:       ", messages, size, batches, false);
+    run_pass("  async_write_batch: ", messages, size, batches, true);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+//------------------------------------------------------------------------------
+//
+// Benchmark: sending a file as messages, read into memory and written
+// with async_write vs async_write_file
+//
+// A file of the given size is created in $TMPDIR, or /tmp, and read once
+// so that it is in the page cache. The server session sends it `count`
+// times to a synchronous client on its own thread, which reads each
+// message and checks its size and checksum. The first pass reads the
+// file into a string and writes it with async_write, the second writes it
+// with async_write_file, which on a plain server stream without
+// permessage-deflate sends the payload with sendfile. The third pass
+// negotiates permessage-deflate, so async_write_file falls back to
+// reading the file in blocks. The CPU time of the process and the wall
+// time of each pass are reported.
+//
+//------------------------------------------------------------------------------
+
+#include "websocket_stream.hpp"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+namespace beast = boost::beast;            // from <boost/beast.hpp>
+namespace http = beast::http;              // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket;    // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;               // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
+
+//------------------------------------------------------------------------------
+
+// Report a failure
+void fail(beast::error_code ec, char const* what)
+{
+    std::cerr << what << ": " << ec.message() << "\n";
+}
+
+// Returns the checksum of a payload
+std::size_t checksum(unsigned char const* p, std::size_t n)
+{
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < n; i += 4096)
+        sum = sum * 31 + p[i];
+    return sum;
+}
+
+// Returns the CPU time used by the process, in seconds
+double cpu_seconds()
+{
+    struct rusage usage = {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+enum class mode { buffered, write_file };
+
+// Sends the file `count` times, then closes
+class session : public std::enable_shared_from_this<session>
+{
+    std::shared_ptr<websocket_stream_base> ws_;
+    std::string path_;
+    std::size_t size_;
+    std::size_t count_;
+    mode mode_;
+    std::string message_;
+
+  public:
+    session(std::shared_ptr<websocket_stream_base> ws, std::string path,
+            std::size_t size, std::size_t count, mode m)
+        : ws_(std::move(ws))
+        , path_(std::move(path))
+        , size_(size)
+        , count_(count)
+        , mode_(m)
+    {
+    }
+
+    void run()
+    {
+        ws_->async_accept(beast::bind_front_handler(&session::on_accept,
+                                                    shared_from_this()));
+    }
+
+  private:
+    void on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+        ws_->binary(true);
+        do_write();
+    }
+
+    void do_write()
+    {
+        if (count_-- == 0)
+            return ws_->async_close(
+                websocket::close_code::normal,
+                beast::bind_front_handler(&session::on_close,
+                                          shared_from_this()));
+
+        if (mode_ == mode::write_file)
+            return ws_->async_write_file(
+                path_, 0, websocket_stream_base::rest_of_file,
+                beast::bind_front_handler(&session::on_write,
+                                          shared_from_this()));
+
+        // What the server did before async_write_file
+        message_.resize(size_);
+        auto const fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        for (std::size_t got = 0; fd >= 0 && got < size_;) {
+            auto const n = ::read(fd, &message_[got], size_ - got);
+            if (n <= 0)
+                break;
+            got += static_cast<std::size_t>(n);
+        }
+        if (fd >= 0)
+            ::close(fd);
+        ws_->async_write(net::buffer(message_),
+                         beast::bind_front_handler(&session::on_write,
+                                                   shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+        do_write();
+    }
+
+    void on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+    }
+};
+
+// Reads messages until the server closes, checking each of them
+void run_client(tcp::endpoint ep, bool deflate, std::size_t size,
+                std::size_t sum)
+{
+    try {
+        net::io_context ioc;
+        websocket::stream<tcp::socket> ws(ioc);
+        if (deflate) {
+            websocket::permessage_deflate pmd;
+            pmd.client_enable = true;
+            ws.set_option(pmd);
+        }
+        ws.read_message_max(size + 1);
+        ws.next_layer().connect(ep);
+        ws.handshake("localhost", "/");
+
+        beast::flat_buffer buffer;
+        for (;;) {
+            beast::error_code ec;
+            ws.read(buffer, ec);
+            if (ec == websocket::error::closed)
+                break;
+            if (ec)
+                return fail(ec, "client");
+            auto const data = buffer.data();
+            if (data.size() != size ||
+                checksum(static_cast<unsigned char const*>(data.data()),
+                         data.size()) != sum)
+                std::cerr << "client: bad message\n";
+            buffer.clear();
+        }
+    } catch (beast::system_error const& se) {
+        fail(se.code(), "client");
+    }
+}
+
+// Runs one pass and prints its times
+void run_pass(char const* name, std::string const& path, std::size_t size,
+              std::size_t sum, std::size_t count, mode m, bool deflate)
+{
+    net::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, {net::ip::make_address("127.0.0.1"), 0});
+
+    auto const cpu = cpu_seconds();
+    auto const start = std::chrono::steady_clock::now();
+    std::thread client(run_client, acceptor.local_endpoint(), deflate, size,
+                       sum);
+
+    auto ws = std::make_shared<plain_websocket_stream>(acceptor.accept());
+    if (deflate) {
+        websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        ws->set_option(pmd);
+    }
+    std::make_shared<session>(std::move(ws), path, size, count, m)->run();
+    ioc.run();
+    client.join();
+
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << name << elapsed.count() << " s, "
+              << size * count / elapsed.count() / (1024 * 1024)
+              << " MiB/s, cpu " << cpu_seconds() - cpu << " s\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Check command line arguments.
+    if (argc != 3) {
+        std::cerr << "Usage: bench-write-file <messages> <size in MiB>\n"
+                  << "Example:\n"
+                  << "    bench-write-file 16 64\n";
+        return EXIT_FAILURE;
+    }
+    auto const count = static_cast<std::size_t>(std::atol(argv[1]));
+    auto const size =
+        static_cast<std::size_t>(std::atol(argv[2])) * 1024 * 1024;
+
+    char const* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/bench-XXXXXX";
+    auto const fd = ::mkstemp(&path[0]);
+    if (fd < 0) {
+        std::cerr << "mkstemp failed\n";
+        return EXIT_FAILURE;
+    }
+    std::string payload(size, '\0');
+    for (std::size_t i = 0; i < size; ++i)
+        payload[i] = static_cast<char>(i * 7 + i / 4096);
+    for (std::size_t put = 0; put < size;) {
+        auto const n = ::write(fd, &payload[put], size - put);
+        if (n <= 0) {
+            std::cerr << "write failed\n";
+            return EXIT_FAILURE;
+        }
+        put += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+    auto const sum = checksum(
+        reinterpret_cast<unsigned char const*>(payload.data()), size);
+    payload = std::string();
+
+    std::cout << count << " messages of " << size / (1024 * 1024)
+              << " MiB:\n";
+    run_pass("  async_write:               ", path, size, sum, count,
+             mode::buffered, false);
+    run_pass("  async_write_file:          ", path, size, sum, count,
+             mode::write_file, false);
+    run_pass("  async_write_file, deflate: ", path, size, sum, count,
+             mode::write_file, true);
+
+    ::unlink(path.c_str());
+    return EXIT_SUCCESS;
+}
@@ -4,15 +4,21 @@
 
 //------------------------------------------------------------------------------
 //
-// Example: WebSocket server, coroutine (plain + SSL)
+// Example: WebSocket server, stackless coroutine (plain + SSL)
 //
 //------------------------------------------------------------------------------
 
+#include "receive_ring.hpp"
+#include "ssl_context_provider.hpp"
 #include "websocket_stream.hpp"
 #include "example/common/server_certificate.hpp"
 
 #include <algorithm>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/websocket.hpp>
@@ -32,6 +38,8 @@ using tcp = boost::asio::ip::tcp;          // from <boost/asio/ip/tcp.hpp>
 
 //------------------------------------------------------------------------------
 
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
 // Report a failure
 void fail(beast::error_code ec, char const* what)
 {
@@ -39,16 +47,18 @@ void fail(beast::error_code ec, char const* what)
 }
 
 // Echoes back all received WebSocket messages
-void do_session(beast::tcp_stream& stream, net::yield_context yield)
+net::awaitable<void> do_session(beast::tcp_stream stream,
+                                ssl_context_provider const& tls)
 {
     beast::error_code ec;
+    auto token = net::redirect_error(net::use_awaitable, ec);
 
     stream.expires_after(std::chrono::seconds(30));
     beast::flat_buffer buffer;
     bool result = true;
-    result = beast::async_detect_ssl(stream, buffer, yield[ec]);
+    result = co_await beast::async_detect_ssl(stream, buffer, token);
     if (ec)
-        return fail(ec, "detect_ssl");
+        co_return fail(ec, "detect_ssl");
     std::cout << "detect_ssl: " << result << std::endl;
 
     std::unique_ptr<websocket_stream_base> ws_ptr;
@@ -57,34 +67,34 @@ void do_session(beast::tcp_stream& stream, net::yield_context yield)
     parser->body_limit(10000);
     result = true;
     if (result) {
-        boost::asio::ssl::context ctx(boost::asio::ssl::context_base::tlsv12);
-        load_server_certificate(ctx);
-        beast::ssl_stream<beast::tcp_stream> sstream(std::move(stream), ctx);
+        // The certificate is loaded once and shared by all sessions
+        beast::ssl_stream<beast::tcp_stream> sstream(std::move(stream),
+                                                     *tls.get());
         beast::get_lowest_layer(sstream).expires_after(
             std::chrono::seconds(30));
 
         std::size_t bytes_used;
-        bytes_used = sstream.async_handshake(
-            boost::asio::ssl::stream_base::server, buffer.data(), yield[ec]);
+        bytes_used = co_await sstream.async_handshake(
+            boost::asio::ssl::stream_base::server, buffer.data(), token);
         if (ec)
-            return fail(ec, "handshake");
+            co_return fail(ec, "handshake");
         buffer.consume(bytes_used);
 
         beast::get_lowest_layer(sstream).expires_after(
             std::chrono::seconds(30));
-        http::async_read(sstream, buffer, *parser, yield[ec]);
+        co_await http::async_read(sstream, buffer, *parser, token);
         if (ec == http::error::end_of_stream) {
             beast::get_lowest_layer(sstream).expires_after(
                 std::chrono::seconds(30));
 
-            sstream.async_shutdown(yield[ec]);
+            co_await sstream.async_shutdown(token);
             if (ec)
-                return fail(ec, "shutdown");
-            return;
+                co_return fail(ec, "shutdown");
+            co_return;
         }
 
         if (ec)
-            return fail(ec, "read");
+            co_return fail(ec, "read");
 
         if (websocket::is_upgrade(parser->get())) {
             beast::get_lowest_layer(sstream).expires_never();
@@ -93,14 +103,14 @@ void do_session(beast::tcp_stream& stream, net::yield_context yield)
         }
     } else {
         beast::get_lowest_layer(stream).expires_after(std::chrono::seconds(30));
-        http::async_read(stream, buffer, *parser, yield[ec]);
+        co_await http::async_read(stream, buffer, *parser, token);
         if (ec == http::error::end_of_stream) {
             stream.socket().shutdown(tcp::socket::shutdown_send, ec);
-            return;
+            co_return;
         }
 
         if (ec)
-            return fail(ec, "read");
+            co_return fail(ec, "read");
 
         if (websocket::is_upgrade(parser->get())) {
             beast::get_lowest_layer(stream).expires_never();
@@ -123,44 +133,26 @@ void do_session(beast::tcp_stream& stream, net::yield_context yield)
         }));
 
     // Accept the websocket handshake
-    // ws.async_accept(yield[ec]);
-    if (ws.use_ssl()) {
-        websocket_stream_base::async_accept(
-            static_cast<ssl_websocket_stream&>(ws), parser->release(),
-            yield[ec]);
-    } else {
-        websocket_stream_base::async_accept(
-            static_cast<plain_websocket_stream&>(ws), parser->release(),
-            yield[ec]);
-    }
+    co_await ws.co_accept(parser->release(), ec);
     if (ec)
-        return fail(ec, "accept");
+        co_return fail(ec, "accept");
+
+    // Messages are received in place into this ring. A larger message
+    // fails the read with buffer_overflow.
+    receive_ring ring(64 * 1024);
 
     for (;;) {
-        // This buffer will hold the incoming message
-        beast::flat_buffer buffer;
-
-        // Read a message
-        // ws.async_read(buffer, yield[ec]);
-        if (ws.use_ssl()) {
-            websocket_stream_base::async_read(
-                static_cast<ssl_websocket_stream&>(ws), buffer, yield[ec]);
-        } else {
-            websocket_stream_base::async_read(
-                static_cast<plain_websocket_stream&>(ws), buffer, yield[ec]);
-        }
+        // Receive a message, as a view into the ring
+        auto message = co_await ws.co_receive(ring, ec);
 
         // This indicates that the session was closed
         if (ec == websocket::error::closed)
             break;
 
         if (ec)
-            return fail(ec, "read");
+            co_return fail(ec, "read");
 
-        std::cout << "Receive " << '\"'
-                  << std::string(reinterpret_cast<char*>(buffer.data().data()),
-                                 buffer.size())
-                  << '\"' << " from "
+        std::cout << "Receive " << '\"' << message.str() << '\"' << " from "
                   << ws.lowest_layer()
                          .socket()
                          .remote_endpoint()
@@ -169,62 +161,54 @@ void do_session(beast::tcp_stream& stream, net::yield_context yield)
                   << ":" << ws.lowest_layer().socket().remote_endpoint().port()
                   << std::endl;
 
-        // Echo the message back
-        ws.text(ws.got_text());
-        // ws.async_write(buffer.data(), yield[ec]);
-        if (ws.use_ssl()) {
-            websocket_stream_base::async_write(
-                static_cast<ssl_websocket_stream&>(ws), buffer.data(),
-                yield[ec]);
-        } else {
-            websocket_stream_base::async_write(
-                static_cast<plain_websocket_stream&>(ws), buffer.data(),
-                yield[ec]);
-        }
+        // Echo the message back, then give its space back to the ring
+        ws.text(message.text());
+        co_await ws.co_write(message.buffer(), ec);
+        ring.release(message);
         if (ec)
-            return fail(ec, "write");
+            co_return fail(ec, "write");
     }
 }
 
 //------------------------------------------------------------------------------
 
 // Accepts incoming connections and launches the sessions
-void do_listen(net::io_context& ioc, tcp::endpoint endpoint,
-               net::yield_context yield)
+net::awaitable<void> do_listen(tcp::endpoint endpoint,
+                               ssl_context_provider const& tls)
 {
     beast::error_code ec;
 
     // Open the acceptor
-    tcp::acceptor acceptor(ioc);
+    tcp::acceptor acceptor(co_await net::this_coro::executor);
     acceptor.open(endpoint.protocol(), ec);
     if (ec)
-        return fail(ec, "open");
+        co_return fail(ec, "open");
 
     // Allow address reuse
     acceptor.set_option(net::socket_base::reuse_address(true), ec);
     if (ec)
-        return fail(ec, "set_option");
+        co_return fail(ec, "set_option");
 
     // Bind to the server address
     acceptor.bind(endpoint, ec);
     if (ec)
-        return fail(ec, "bind");
+        co_return fail(ec, "bind");
 
     // Start listening for connections
     acceptor.listen(net::socket_base::max_listen_connections, ec);
     if (ec)
-        return fail(ec, "listen");
+        co_return fail(ec, "listen");
 
     for (;;) {
-        tcp::socket socket(ioc);
-        acceptor.async_accept(socket, yield[ec]);
+        tcp::socket socket(acceptor.get_executor());
+        co_await acceptor.async_accept(
+            socket, net::redirect_error(net::use_awaitable, ec));
         if (ec)
             fail(ec, "accept");
         else
-            boost::asio::spawn(
-                acceptor.get_executor(),
-                std::bind(&do_session, beast::tcp_stream(std::move(socket)),
-                          std::placeholders::_1));
+            net::co_spawn(acceptor.get_executor(),
+                          do_session(beast::tcp_stream(std::move(socket)), tls),
+                          net::detached);
     }
 }
 
@@ -244,10 +228,27 @@ int main(int argc, char* argv[])
     // The io_context is required for all I/O
     net::io_context ioc(threads);
 
+    // The SSL context is required, and holds certificates
+    ssl_context_provider tls(net::ssl::context::tlsv12,
+                             load_server_certificate);
+
+    // Reload the certificates on SIGHUP, without pausing accepts
+    net::signal_set signals(ioc, SIGHUP);
+    std::function<void()> do_reload = [&] {
+        signals.async_wait([&](beast::error_code ec, int) {
+            if (ec)
+                return;
+            tls.reload(ec);
+            if (ec)
+                fail(ec, "reload");
+            do_reload();
+        });
+    };
+    do_reload();
+
     // Spawn a listening port
-    boost::asio::spawn(
-        ioc, std::bind(&do_listen, std::ref(ioc), tcp::endpoint{address, port},
-                       std::placeholders::_1));
+    net::co_spawn(ioc, do_listen(tcp::endpoint{address, port}, tls),
+                  net::detached);
 
     // Run the I/O service on the requested number of threads
     std::vector<std::thread> v;
@@ -258,3 +259,13 @@ int main(int argc, char* argv[])
 
     return EXIT_SUCCESS;
 }
+
+#else
+
+int main(int, char*[])
+{
+    std::cerr << "websocket-server-coro requires C++20 coroutine support\n";
+    return EXIT_FAILURE;
+}
+
+#endif
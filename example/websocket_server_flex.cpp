@@ -369,15 +369,8 @@ void do_accept(std::shared_ptr<websocket_stream_base> stream,
         }));
 
     // Accept the websocket handshake
-    if (stream->use_ssl()) {
-        websocket_stream_base::async_accept(
-            *static_cast<ssl_websocket_stream*>(stream.get()), req,
-            std::bind(on_accept, stream, std::placeholders::_1));
-    } else {
-        websocket_stream_base::async_accept(
-            *static_cast<plain_websocket_stream*>(stream.get()), req,
-            std::bind(on_accept, stream, std::placeholders::_1));
-    }
+    stream->async_accept(req,
+                         std::bind(on_accept, stream, std::placeholders::_1));
 }
 
 void on_accept(std::shared_ptr<websocket_stream_base> stream,
@@ -393,17 +386,8 @@ void on_accept(std::shared_ptr<websocket_stream_base> stream,
 void do_read(std::shared_ptr<websocket_stream_base> stream)
 {
     // Read a message into our buffer
-    if (stream->use_ssl()) {
-        websocket_stream_base::async_read(
-            *static_cast<ssl_websocket_stream*>(stream.get()), buffer_,
-            std::bind(on_read, stream, std::placeholders::_1,
-                      std::placeholders::_2));
-    } else {
-        websocket_stream_base::async_read(
-            *static_cast<plain_websocket_stream*>(stream.get()), buffer_,
-            std::bind(on_read, stream, std::placeholders::_1,
-                      std::placeholders::_2));
-    }
+    stream->async_read(buffer_, std::bind(on_read, stream, std::placeholders::_1,
+                                          std::placeholders::_2));
 }
 
 void on_read(std::shared_ptr<websocket_stream_base> stream,
@@ -420,17 +404,9 @@ void on_read(std::shared_ptr<websocket_stream_base> stream,
 
     // Echo the message
     stream->text(stream->got_text());
-    if (stream->use_ssl()) {
-        websocket_stream_base::async_write(
-            *static_cast<ssl_websocket_stream*>(stream.get()), buffer_.data(),
-            std::bind(on_write, stream, std::placeholders::_1,
-                      std::placeholders::_2));
-    } else {
-        websocket_stream_base::async_write(
-            *static_cast<plain_websocket_stream*>(stream.get()), buffer_.data(),
-            std::bind(on_write, stream, std::placeholders::_1,
-                      std::placeholders::_2));
-    }
+    stream->async_write(buffer_.data(),
+                        std::bind(on_write, stream, std::placeholders::_1,
+                                  std::placeholders::_2));
 }
 
 void on_write(std::shared_ptr<websocket_stream_base> stream,
@@ -513,7 +489,6 @@ void make_websocket_session(
     //    std::move(stream))->run(std::move(req));
     std::shared_ptr<websocket_stream_base> ws =
         std::make_shared<plain_websocket_stream>(std::move(stream));
-    ws->use_ssl(false);
     test::do_accept(ws, std::move(req));
 }
 
@@ -526,7 +501,6 @@ void make_websocket_session(
     //    std::move(stream))->run(std::move(req));
     std::shared_ptr<websocket_stream_base> ws =
         std::make_shared<ssl_websocket_stream>(std::move(stream));
-    ws->use_ssl(true);
     test::do_accept(ws, std::move(req));
 }
 
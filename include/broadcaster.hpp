@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef BROADCASTER_HPP
+#define BROADCASTER_HPP
+
+#include <boost/asio/dispatch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "shared_frame.hpp"
+#include "websocket_stream_base.hpp"
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Sends the same message to a set of streams, encoding it once.
+
+    A message is framed into a @ref shared_frame and the frame is queued
+    on every stream with `async_send`, in order with the stream's own
+    queued messages. Server streams without permessage-deflate write the
+    encoded bytes as they are, so the payload is neither re-framed nor
+    copied per recipient.
+
+    Streams which negotiated permessage-deflate with
+    server_no_context_takeover compress every message from an empty
+    window, so the compressed bytes depend only on the message and the
+    negotiated settings. Such a message is compressed once per distinct
+    set of settings among the recipients, and the compressed frame is
+    shared by every stream with those settings. The share of those
+    recipients served without compressing is reported by
+    @ref deflate_hit_ratio. Streams which keep their compression context
+    still compress the message themselves.
+
+    Streams are held by weak pointer and drop out of the set when they
+    are destroyed. The compression of a stream is read when a message is
+    sent, so streams should join once their handshake is complete. The
+    queueing is dispatched to the executor of each stream, so streams
+    driven by several threads must use a strand as their executor. The
+    set itself may be used from any thread.
+
+    @tparam Executor The executor type of the streams, as for
+    @ref basic_websocket_stream_base.
+*/
+template <class Executor = net::any_io_executor>
+class basic_broadcaster
+{
+  public:
+    using stream_type = basic_websocket_stream_base<Executor>;
+
+  private:
+    mutable std::mutex mutex_;
+    std::vector<std::weak_ptr<stream_type>> streams_;
+    std::atomic<std::size_t> deflations_{0};
+    std::atomic<std::size_t> deflate_hits_{0};
+
+  public:
+    /// Add a stream to the set
+    void join(std::shared_ptr<stream_type> const& stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streams_.push_back(stream);
+    }
+
+    /// Remove a stream from the set
+    void leave(stream_type const& stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streams_.erase(
+            std::remove_if(streams_.begin(), streams_.end(),
+                           [&stream](std::weak_ptr<stream_type> const& p) {
+                               auto const sp = p.lock();
+                               return !sp || sp.get() == &stream;
+                           }),
+            streams_.end());
+    }
+
+    /// Returns the number of streams in the set, including destroyed ones
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return streams_.size();
+    }
+
+    /** Queue a frame on every stream in the set.
+
+        Errors are not reported; a stream which can no longer be written
+        reports the failure to its own reads.
+
+        @return The number of streams the frame was queued on.
+    */
+    std::size_t send(shared_frame const& frame)
+    {
+        std::vector<std::shared_ptr<stream_type>> streams;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            streams.reserve(streams_.size());
+            for (auto const& p : streams_)
+                if (auto sp = p.lock())
+                    streams.push_back(std::move(sp));
+            if (streams.size() < streams_.size())
+                streams_.erase(
+                    std::remove_if(streams_.begin(), streams_.end(),
+                                   [](std::weak_ptr<stream_type> const& p) {
+                                       return p.expired();
+                                   }),
+                    streams_.end());
+        }
+
+        // One compressed frame for each distinct set of settings
+        std::vector<shared_frame> deflated;
+        for (auto& sp : streams) {
+            auto& stream = *sp;
+            auto f = frame;
+            auto const c = stream.compression();
+            if (c.enabled && c.no_context_takeover) {
+                auto const it =
+                    std::find_if(deflated.begin(), deflated.end(),
+                                 [&c](shared_frame const& d) {
+                                     return d.params() == c.params;
+                                 });
+                if (it != deflated.end()) {
+                    f = *it;
+                    ++deflate_hits_;
+                } else {
+                    f = frame.deflate(c.params);
+                    deflated.push_back(f);
+                    ++deflations_;
+                }
+            }
+            net::dispatch(stream.get_executor(),
+                          [sp = std::move(sp), f = std::move(f)] {
+                              sp->async_send(f,
+                                             [](error_code, std::size_t) {});
+                          });
+        }
+        return streams.size();
+    }
+
+    /// Encode a message and queue it on every stream in the set
+    std::size_t send(string_view message, bool binary)
+    {
+        return send(shared_frame(message, binary));
+    }
+
+    /// Returns the number of times a message was compressed
+    std::size_t deflate_count() const noexcept { return deflations_; }
+
+    /// Returns the number of recipients served an already compressed frame
+    std::size_t deflate_hits() const noexcept { return deflate_hits_; }
+
+    /** Returns the share of compressing recipients served without compressing.
+
+        This is `deflate_hits() / (deflate_hits() + deflate_count())`, or
+        zero before any message was compressed.
+    */
+    double deflate_hit_ratio() const noexcept
+    {
+        std::size_t const hits = deflate_hits_;
+        std::size_t const total = hits + deflations_;
+        return total == 0 ? 0.0
+                          : static_cast<double>(hits) /
+                                static_cast<double>(total);
+    }
+};
+
+/// A broadcaster for streams using the default executor
+using broadcaster = basic_broadcaster<>;
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::broadcaster;
+
+#endif    // !BROADCASTER_HPP
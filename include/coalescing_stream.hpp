@@ -0,0 +1,746 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef COALESCING_STREAM_HPP
+#define COALESCING_STREAM_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/handler_continuation_hook.hpp>
+#include <boost/asio/handler_invoke_hook.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/assert.hpp>
+#include <boost/beast/core/async_base.hpp>
+#include <boost/beast/core/buffer_traits.hpp>
+#include <boost/beast/core/buffers_suffix.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/core/span.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include "websocket_stream_handler.hpp"
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A stream layer which coalesces writes made while a write is in flight.
+
+    This layer sits between `websocket::stream` and its transport. When no
+    write is in progress, a write passes straight through. While one is,
+    or while the layer is corked, later writes are copied into a pending
+    buffer and complete at once; when the write in flight finishes, or the
+    layer is uncorked, everything pending goes out in a single write to the
+    next layer. Several small frames thus cost one system call, and one TLS
+    record when the next layer is an SSL stream.
+
+    Each write is accepted whole or not at all, and one which passes
+    through is written in full before the next one starts, so frames are
+    never split by data from another write. Bytes may therefore also be
+    written straight to this layer, alongside the frames of the stream
+    above it. A write which would grow the pending buffer past
+    @ref buffer_limit waits for the flush to finish instead.
+
+    Reads pass straight through, unless the layer is set to
+    @ref read_ahead. Synchronous writes pass straight through too and must
+    not be mixed with asynchronous ones. A write error seen
+    by a flush is reported by every later write.
+
+    The state is shared with the operations in flight, so the layer may
+    be destroyed while a flush is still pending.
+*/
+template <class NextLayer>
+class coalescing_stream
+{
+  public:
+    using next_layer_type = NextLayer;
+
+    using executor_type = typename NextLayer::executor_type;
+
+  private:
+    using waiter_type = any_stream_handler<void(error_code), executor_type>;
+
+    // The unwritten part of a write which passes through
+    using through_type = buffers_suffix<span<net::const_buffer const>>;
+
+    struct impl_type
+    {
+        NextLayer next;
+        flat_buffer pending;
+        flat_buffer flushing;
+        std::size_t limit = 64 * 1024;
+        bool writing = false;
+        int corked = 0;
+        error_code ec;
+        waiter_type waiter;
+        std::vector<net::const_buffer> through_buffers;
+        through_type through;
+        std::size_t writes = 0;
+        std::size_t coalesced = 0;
+        std::size_t operations = 0;
+        std::size_t reads = 0;
+        flat_buffer ahead;
+        std::size_t ahead_size = 0;
+        void (*read_hook)(void*) = nullptr;
+        void* read_hook_context = nullptr;
+
+        template <class... Args>
+        explicit impl_type(Args&&... args) : next(std::forward<Args>(args)...)
+        {
+        }
+    };
+
+    std::shared_ptr<impl_type> impl_;
+
+    // Called when a write to the next layer finishes
+    static void on_write(std::shared_ptr<impl_type> const& impl,
+                         error_code const& ec)
+    {
+        auto& s = *impl;
+        s.writing = false;
+        if (ec && !s.ec)
+            s.ec = ec;
+        if (s.pending.size() > 0 && !s.ec && (s.corked == 0 || s.waiter))
+            return flush(impl);
+        if (s.waiter)
+            std::move(s.waiter)(s.ec);
+    }
+
+    // Write everything pending in one operation
+    static void flush(std::shared_ptr<impl_type> const& impl)
+    {
+        auto& s = *impl;
+        BOOST_ASSERT(!s.writing);
+        s.writing = true;
+        ++s.writes;
+        std::swap(s.pending, s.flushing);
+        net::async_write(s.next, s.flushing.data(), flush_op{impl});
+    }
+
+    struct flush_op
+    {
+        std::shared_ptr<impl_type> impl;
+
+        void operator()(error_code ec, std::size_t)
+        {
+            impl->flushing.clear();
+            on_write(impl, ec);
+        }
+    };
+
+    // True if a write of `n` bytes may go straight to the next layer
+    static bool pass_through(impl_type const& s, std::size_t n) noexcept
+    {
+        return !s.writing && s.pending.size() == 0 &&
+               (s.corked == 0 || n > s.limit);
+    }
+
+    // Writes the whole of a write which passes through, then completes
+    // it. The buffers live in the shared state and this handler holds
+    // little more than the caller's, so the operations of the next layer
+    // stay as small as they would be without this layer.
+    template <class Handler>
+    class write_some_handler
+    {
+        Handler h_;
+        std::shared_ptr<impl_type> impl_;
+        std::size_t bytes_ = 0;
+
+      public:
+        using executor_type = net::associated_executor_t<
+            Handler, typename coalescing_stream::executor_type>;
+
+        using allocator_type = net::associated_allocator_t<Handler>;
+
+        template <class Handler_>
+        write_some_handler(Handler_&& handler, std::shared_ptr<impl_type> impl)
+            : h_(std::forward<Handler_>(handler)), impl_(std::move(impl))
+        {
+        }
+
+        executor_type get_executor() const noexcept
+        {
+            return net::get_associated_executor(h_,
+                                                impl_->next.get_executor());
+        }
+
+        allocator_type get_allocator() const noexcept
+        {
+            return net::get_associated_allocator(h_);
+        }
+
+        void operator()(error_code ec, std::size_t bytes_transferred)
+        {
+            auto& s = *impl_;
+            bytes_ += bytes_transferred;
+            s.through.consume(bytes_transferred);
+            if (!ec && buffer_bytes(s.through) > 0) {
+                auto& next = s.next;
+                return next.async_write_some(s.through, std::move(*this));
+            }
+            on_write(impl_, {});
+            h_(ec, bytes_);
+        }
+
+        template <class Function>
+        friend void asio_handler_invoke(Function&& f, write_some_handler* p)
+        {
+            using net::asio_handler_invoke;
+            asio_handler_invoke(f, std::addressof(p->h_));
+        }
+
+        friend bool asio_handler_is_continuation(write_some_handler* p)
+        {
+            using net::asio_handler_is_continuation;
+            return asio_handler_is_continuation(std::addressof(p->h_));
+        }
+    };
+
+    // Start a write which goes straight to the next layer
+    template <class ConstBufferSequence, class Handler>
+    static void write_through(std::shared_ptr<impl_type> const& impl,
+                              ConstBufferSequence const& buffers,
+                              Handler&& handler)
+    {
+        auto& s = *impl;
+        s.writing = true;
+        ++s.writes;
+        s.through_buffers.assign(net::buffer_sequence_begin(buffers),
+                                 net::buffer_sequence_end(buffers));
+        s.through = through_type(span<net::const_buffer const>(
+            s.through_buffers.data(), s.through_buffers.size()));
+        s.next.async_write_some(
+            s.through, write_some_handler<typename std::decay<Handler>::type>(
+                           std::forward<Handler>(handler), impl));
+    }
+
+    // A write which is coalesced, or waits for room in the pending buffer
+    template <class Handler, class ConstBufferSequence>
+    class write_op : public beast::async_base<Handler, executor_type>
+    {
+        std::shared_ptr<impl_type> impl_;
+        ConstBufferSequence buffers_;
+
+      public:
+        template <class Handler_>
+        write_op(Handler_&& handler, std::shared_ptr<impl_type> impl,
+                 ConstBufferSequence const& buffers)
+            : beast::async_base<Handler, executor_type>(
+                  std::forward<Handler_>(handler), impl->next.get_executor())
+            , impl_(std::move(impl))
+            , buffers_(buffers)
+        {
+            (*this)(error_code{});
+        }
+
+        // Start, or resume after waiting for a flush
+        void operator()(error_code)
+        {
+            auto& s = *impl_;
+            if (s.ec)
+                return this->complete(false, s.ec, 0);
+
+            auto const n = buffer_bytes(buffers_);
+            if (pass_through(s, n)) {
+                auto impl = impl_;
+                auto buffers = buffers_;
+                return write_through(impl, buffers, std::move(*this));
+            }
+
+            if (s.pending.size() + n > s.limit) {
+                // Wait for the pending bytes to be written, then try again
+                BOOST_ASSERT(!s.waiter);
+                auto impl = impl_;
+                auto ex = s.next.get_executor();
+                s.waiter = waiter_type(std::move(*this), ex);
+                if (!s.writing)
+                    flush(impl);
+                return;
+            }
+            ++s.coalesced;
+            s.pending.commit(
+                net::buffer_copy(s.pending.prepare(n), buffers_));
+            this->complete(false, error_code{}, n);
+        }
+
+        // The write went to the next layer after waiting
+        void operator()(error_code ec, std::size_t bytes_transferred)
+        {
+            this->complete_now(ec, bytes_transferred);
+        }
+    };
+
+    // Called as a read goes to the next layer
+    static void on_read(impl_type& s)
+    {
+        ++s.reads;
+        if (s.read_hook)
+            s.read_hook(s.read_hook_context);
+    }
+
+    // A read served from the bytes read ahead, which first reads more
+    // from the next layer when none are left
+    template <class Handler, class MutableBufferSequence>
+    class read_op : public beast::async_base<Handler, executor_type>
+    {
+        std::shared_ptr<impl_type> impl_;
+        MutableBufferSequence buffers_;
+
+      public:
+        template <class Handler_>
+        read_op(Handler_&& handler, std::shared_ptr<impl_type> impl,
+                MutableBufferSequence const& buffers)
+            : beast::async_base<Handler, executor_type>(
+                  std::forward<Handler_>(handler), impl->next.get_executor())
+            , impl_(std::move(impl))
+            , buffers_(buffers)
+        {
+            auto& s = *impl_;
+            if (s.ahead.size() > 0 || buffer_bytes(buffers_) == 0) {
+                (*this)(error_code{}, 0, false);
+                return;
+            }
+            on_read(s);
+            auto& next = s.next;
+            next.async_read_some(s.ahead.prepare(s.ahead_size),
+                                 std::move(*this));
+        }
+
+        void operator()(error_code ec, std::size_t bytes_transferred,
+                        bool cont = true)
+        {
+            auto& s = *impl_;
+            s.ahead.commit(bytes_transferred);
+            auto const n = net::buffer_copy(buffers_, s.ahead.data());
+            s.ahead.consume(n);
+            this->complete(cont, ec, n);
+        }
+    };
+
+#if defined(__linux__)
+    // Writes a header and then a range of a file with sendfile, straight
+    // from the page cache to the socket. Writes made meanwhile are held
+    // in the pending buffer, as behind any write in flight.
+    template <class Handler>
+    class sendfile_op : public beast::async_base<Handler, executor_type>
+    {
+        std::shared_ptr<impl_type> impl_;
+        unsigned char header_[16];
+        std::size_t header_size_;
+        int fd_;
+        off_t offset_;
+        std::size_t remaining_;
+        std::size_t bytes_ = 0;
+        bool started_ = false;
+
+        void finish(error_code ec)
+        {
+            on_write(impl_, ec);
+            this->complete_now(ec, bytes_);
+        }
+
+        // Send until done or the socket buffer is full
+        void send()
+        {
+            auto& socket = beast::get_lowest_layer(impl_->next).socket();
+            error_code ec;
+            if (!socket.native_non_blocking())
+                socket.native_non_blocking(true, ec);
+            if (ec)
+                return finish(ec);
+            while (remaining_ > 0) {
+                auto const n =
+                    ::sendfile(socket.native_handle(), fd_, &offset_,
+                               (std::min)(remaining_, std::size_t(1) << 30));
+                if (n > 0) {
+                    bytes_ += static_cast<std::size_t>(n);
+                    remaining_ -= static_cast<std::size_t>(n);
+                } else if (n == 0) {
+                    // The file is shorter than the frame header says
+                    return finish(net::error::eof);
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return socket.async_wait(net::socket_base::wait_write,
+                                             std::move(*this));
+                } else if (errno != EINTR) {
+                    return finish(error_code(errno, system_category()));
+                }
+            }
+            finish({});
+        }
+
+      public:
+        template <class Handler_>
+        sendfile_op(Handler_&& handler, std::shared_ptr<impl_type> impl,
+                    net::const_buffer header, int fd, std::uint64_t offset,
+                    std::size_t length)
+            : beast::async_base<Handler, executor_type>(
+                  std::forward<Handler_>(handler), impl->next.get_executor())
+            , impl_(std::move(impl))
+            , header_size_((std::min)(header.size(), sizeof(header_)))
+            , fd_(fd)
+            , offset_(static_cast<off_t>(offset))
+            , remaining_(length)
+        {
+            std::memcpy(header_, header.data(), header_size_);
+            (*this)(error_code{});
+        }
+
+        // Start, resume after waiting for a flush, or the socket became
+        // writable
+        void operator()(error_code ec)
+        {
+            auto& s = *impl_;
+            if (started_) {
+                if (ec)
+                    return finish(ec);
+                return send();
+            }
+            if (s.ec)
+                return this->complete(false, s.ec, 0);
+            if (s.writing || s.pending.size() > 0) {
+                // Earlier frames go out first
+                BOOST_ASSERT(!s.waiter);
+                auto impl = impl_;
+                auto ex = s.next.get_executor();
+                s.waiter = waiter_type(std::move(*this), ex);
+                if (!s.writing)
+                    flush(impl);
+                return;
+            }
+            started_ = true;
+            s.writing = true;
+            ++s.writes;
+            s.flushing.commit(
+                net::buffer_copy(s.flushing.prepare(header_size_),
+                                 net::buffer(header_, header_size_)));
+            auto& next = s.next;
+            auto const header = s.flushing.data();
+            net::async_write(next, header, std::move(*this));
+        }
+
+        // The header was written
+        void operator()(error_code ec, std::size_t)
+        {
+            impl_->flushing.clear();
+            if (ec)
+                return finish(ec);
+            send();
+        }
+    };
+#endif
+
+    template <class Handler>
+    class teardown_op : public beast::async_base<Handler, executor_type>
+    {
+        std::shared_ptr<impl_type> impl_;
+        role_type role_;
+        bool started_ = false;
+
+      public:
+        template <class Handler_>
+        teardown_op(Handler_&& handler, std::shared_ptr<impl_type> impl,
+                    role_type role)
+            : beast::async_base<Handler, executor_type>(
+                  std::forward<Handler_>(handler), impl->next.get_executor())
+            , impl_(std::move(impl))
+            , role_(role)
+        {
+            (*this)(error_code{});
+        }
+
+        void operator()(error_code ec)
+        {
+            if (started_)
+                return this->complete_now(ec);
+
+            // Pending frames, such as a close frame, go out first
+            auto& s = *impl_;
+            if (s.writing || (s.pending.size() > 0 && !s.ec)) {
+                BOOST_ASSERT(!s.waiter);
+                auto impl = impl_;
+                auto ex = s.next.get_executor();
+                s.waiter = waiter_type(std::move(*this), ex);
+                if (!s.writing)
+                    flush(impl);
+                return;
+            }
+            started_ = true;
+            using beast::websocket::async_teardown;
+            auto& next = s.next;
+            async_teardown(role_, next, std::move(*this));
+        }
+    };
+
+  public:
+    /// Constructor. Arguments are forwarded to the next layer.
+    template <class... Args>
+    explicit coalescing_stream(Args&&... args)
+        : impl_(std::make_shared<impl_type>(std::forward<Args>(args)...))
+    {
+    }
+
+    coalescing_stream(coalescing_stream&&) = default;
+    coalescing_stream& operator=(coalescing_stream&&) = default;
+
+    executor_type get_executor() noexcept { return impl_->next.get_executor(); }
+
+    next_layer_type& next_layer() noexcept { return impl_->next; }
+
+    next_layer_type const& next_layer() const noexcept { return impl_->next; }
+
+    //--------------------------------------------------------------------------
+
+    /** Set the largest number of bytes held while a write is in flight.
+
+        The default is 64 kilobytes.
+    */
+    void buffer_limit(std::size_t bytes) noexcept { impl_->limit = bytes; }
+
+    /// Returns the largest number of bytes held while a write is in flight
+    std::size_t buffer_limit() const noexcept { return impl_->limit; }
+
+    /** Hold back writes until a matching call to @ref uncork.
+
+        Use this when several frames are about to be written back to
+        back, so they are sent together. Calls may be nested.
+    */
+    void cork() noexcept { ++impl_->corked; }
+
+    /// Undo one call to @ref cork, writing what is pending on the last one
+    void uncork()
+    {
+        auto& s = *impl_;
+        BOOST_ASSERT(s.corked > 0);
+        if (--s.corked == 0 && !s.writing && s.pending.size() > 0 && !s.ec)
+            flush(impl_);
+    }
+
+    /// Returns the number of bytes waiting to be written
+    std::size_t pending_bytes() const noexcept
+    {
+        return impl_->pending.size();
+    }
+
+    /// Returns the number of asynchronous writes made to the next layer
+    std::size_t write_count() const noexcept { return impl_->writes; }
+
+    /// Returns the number of writes folded into a later write
+    std::size_t coalesced_count() const noexcept { return impl_->coalesced; }
+
+    /// Returns the number of asynchronous reads made from the next layer
+    std::size_t read_count() const noexcept { return impl_->reads; }
+
+    /** Returns the number of asynchronous reads and writes started.
+
+        A count which has not moved over a period means no traffic passed
+        through the stream during it.
+    */
+    std::size_t operation_count() const noexcept { return impl_->operations; }
+
+    /** Free the pending buffers, if nothing is pending.
+
+        The buffers grow again on the next write which is coalesced.
+    */
+    void shrink_to_fit() noexcept
+    {
+        auto& s = *impl_;
+        if (s.writing || s.pending.size() > 0)
+            return;
+        s.pending.shrink_to_fit();
+        s.flushing.shrink_to_fit();
+        if (s.ahead.size() == 0)
+            s.ahead.shrink_to_fit();
+        std::vector<net::const_buffer>().swap(s.through_buffers);
+    }
+
+    /** Read ahead up to a number of bytes at a time.
+
+        Asynchronous reads are then served from a buffer of up to `bytes`,
+        which is filled by one read from the next layer whenever it runs
+        out, instead of each being passed to the next layer. A stream
+        above which reads little at a time, as `websocket::stream` does,
+        then makes far fewer reads of the transport when data arrives
+        faster than it is consumed. Zero, the default, turns this off once
+        the bytes already read ahead are used.
+    */
+    void read_ahead(std::size_t bytes) noexcept { impl_->ahead_size = bytes; }
+
+    /// Returns the number of bytes read ahead at a time, see @ref read_ahead
+    std::size_t read_ahead() const noexcept { return impl_->ahead_size; }
+
+    /** Set a function called as each asynchronous read starts.
+
+        The function is called with `context` before a read is passed to
+        the next layer; with @ref read_ahead, only when the bytes read
+        ahead are used up. The stream above uses this to learn that the
+        bytes at hand are used up. Pass a null function to remove it.
+    */
+    void read_hook(void (*hook)(void*), void* context) noexcept
+    {
+        impl_->read_hook = hook;
+        impl_->read_hook_context = context;
+    }
+
+    //--------------------------------------------------------------------------
+
+    template <class MutableBufferSequence>
+    std::size_t read_some(MutableBufferSequence const& buffers)
+    {
+        error_code ec;
+        auto const n = read_some(buffers, ec);
+        if (ec)
+            BOOST_THROW_EXCEPTION(system_error{ec});
+        return n;
+    }
+
+    template <class MutableBufferSequence>
+    std::size_t read_some(MutableBufferSequence const& buffers, error_code& ec)
+    {
+        auto& s = *impl_;
+        if (s.ahead.size() == 0)
+            return s.next.read_some(buffers, ec);
+        // Bytes read ahead come first
+        ec = {};
+        auto const n = net::buffer_copy(buffers, s.ahead.data());
+        s.ahead.consume(n);
+        return n;
+    }
+
+    template <class MutableBufferSequence, class ReadHandler>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_some(MutableBufferSequence const& buffers, ReadHandler&& handler)
+    {
+        auto& s = *impl_;
+        ++s.operations;
+        if (s.ahead_size == 0 && s.ahead.size() == 0) {
+            on_read(s);
+            return s.next.async_read_some(buffers,
+                                          std::forward<ReadHandler>(handler));
+        }
+        return net::async_initiate<ReadHandler, void(error_code, std::size_t)>(
+            [](auto h, std::shared_ptr<impl_type> impl,
+               MutableBufferSequence const& buffers) {
+                read_op<decltype(h), MutableBufferSequence>(
+                    std::move(h), std::move(impl), buffers);
+            },
+            handler, impl_, buffers);
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t write_some(ConstBufferSequence const& buffers)
+    {
+        return impl_->next.write_some(buffers);
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t write_some(ConstBufferSequence const& buffers, error_code& ec)
+    {
+        return impl_->next.write_some(buffers, ec);
+    }
+
+    template <class ConstBufferSequence, class WriteHandler>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_some(ConstBufferSequence const& buffers, WriteHandler&& handler)
+    {
+        ++impl_->operations;
+        return net::async_initiate<WriteHandler, void(error_code, std::size_t)>(
+            [](auto h, std::shared_ptr<impl_type> impl,
+               ConstBufferSequence const& buffers) {
+                if (!impl->ec &&
+                    pass_through(*impl, buffer_bytes(buffers)))
+                    return write_through(impl, buffers, std::move(h));
+                write_op<decltype(h), ConstBufferSequence>(
+                    std::move(h), std::move(impl), buffers);
+            },
+            handler, impl_, buffers);
+    }
+
+#if defined(__linux__) || BOOST_BEAST_DOXYGEN
+    /** Write a header and then a range of a file, without copying it.
+
+        The header is written to the next layer, then the file bytes are
+        sent with `sendfile` from the page cache to the socket at the
+        lowest layer, which must therefore be the transport itself, not a
+        TLS stream. Like a write which passes through, the operation
+        holds back later writes until it is done, so they cannot split
+        the bytes it sends.
+
+        @param header At most 16 bytes written before the file, copied.
+
+        @param fd The file, open for reading; it is not closed.
+
+        @param offset The position of the first byte in the file.
+
+        @param length The number of bytes to send. If the file ends first
+        the operation fails with `net::error::eof`.
+
+        @param handler The completion handler, called with the error and
+        the number of file bytes sent.
+    */
+    template <class WriteHandler>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_sendfile(net::const_buffer header, int fd, std::uint64_t offset,
+                   std::size_t length, WriteHandler&& handler)
+    {
+        ++impl_->operations;
+        return net::async_initiate<WriteHandler, void(error_code, std::size_t)>(
+            [](auto h, std::shared_ptr<impl_type> impl,
+               net::const_buffer header, int fd, std::uint64_t offset,
+               std::size_t length) {
+                sendfile_op<decltype(h)>(std::move(h), std::move(impl),
+                                         header, fd, offset, length);
+            },
+            handler, impl_, header, fd, offset, length);
+    }
+#endif
+
+#if !BOOST_BEAST_DOXYGEN
+    template <class Stream>
+    friend void teardown(role_type role, coalescing_stream<Stream>& stream,
+                         error_code& ec);
+
+    template <class Stream, class TeardownHandler>
+    friend void async_teardown(role_type role,
+                               coalescing_stream<Stream>& stream,
+                               TeardownHandler&& handler);
+#endif
+};
+
+#if !BOOST_BEAST_DOXYGEN
+template <class Stream>
+void teardown(role_type role, coalescing_stream<Stream>& stream,
+              error_code& ec)
+{
+    using beast::websocket::teardown;
+    teardown(role, stream.next_layer(), ec);
+}
+
+template <class Stream, class TeardownHandler>
+void async_teardown(role_type role, coalescing_stream<Stream>& stream,
+                    TeardownHandler&& handler)
+{
+    using op_type = typename coalescing_stream<
+        Stream>::template teardown_op<typename std::decay<TeardownHandler>::type>;
+    op_type(std::forward<TeardownHandler>(handler), stream.impl_, role);
+}
+#endif
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !COALESCING_STREAM_HPP
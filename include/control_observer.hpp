@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef CONTROL_OBSERVER_HPP
+#define CONTROL_OBSERVER_HPP
+
+#include <boost/assert.hpp>
+#include <boost/beast/core/string.hpp>
+#include <boost/beast/websocket/stream_base.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A move-only function called on each incoming control frame.
+
+    The callable is stored inside this object, never on the heap, so
+    setting an observer and calling it do not allocate. Callables larger
+    than @ref capacity, or which may throw when moved, are rejected at
+    compile time; wrap such a callable with `std::ref` instead. A
+    `std::function` always fits, and is moved in as it is.
+*/
+class control_observer
+{
+  public:
+    /// The signature of the observer
+    using signature = void(frame_type, string_view);
+
+    /// The largest callable stored, the size of a `std::function`
+    static std::size_t constexpr capacity =
+        sizeof(std::function<signature>);
+
+  private:
+    struct ops_type
+    {
+        void (*invoke)(void*, frame_type, string_view);
+        void (*move)(void*, void*) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <class Function>
+    struct ops_for
+    {
+        static void invoke(void* p, frame_type kind, string_view payload)
+        {
+            (*static_cast<Function*>(p))(kind, payload);
+        }
+
+        static void move(void* from, void* to) noexcept
+        {
+            ::new (to) Function(std::move(*static_cast<Function*>(from)));
+            static_cast<Function*>(from)->~Function();
+        }
+
+        static void destroy(void* p) noexcept
+        {
+            static_cast<Function*>(p)->~Function();
+        }
+
+        static constexpr ops_type table{&invoke, &move, &destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[capacity];
+    ops_type const* ops_ = nullptr;
+
+    void reset() noexcept
+    {
+        if (ops_)
+            ops_->destroy(storage_);
+        ops_ = nullptr;
+    }
+
+  public:
+    control_observer() = default;
+
+    /// Store a callable invocable as `void(frame_type, string_view)`
+    template <class Function
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = typename std::enable_if<!std::is_same<
+                  typename std::decay<Function>::type,
+                  control_observer>::value>::type
+#endif
+              >
+    control_observer(Function&& f)
+    {
+        using function_type = typename std::decay<Function>::type;
+        static_assert(sizeof(function_type) <= capacity,
+                      "callable too large, wrap it with std::ref");
+        static_assert(alignof(function_type) <= alignof(std::max_align_t),
+                      "over-aligned callables are not supported");
+        static_assert(
+            std::is_nothrow_move_constructible<function_type>::value,
+            "the callable must be nothrow move constructible");
+        ::new (static_cast<void*>(storage_))
+            function_type(std::forward<Function>(f));
+        ops_ = &ops_for<function_type>::table;
+    }
+
+    control_observer(control_observer&& other) noexcept : ops_(other.ops_)
+    {
+        if (ops_)
+            ops_->move(other.storage_, storage_);
+        other.ops_ = nullptr;
+    }
+
+    control_observer& operator=(control_observer&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            if (other.ops_)
+                other.ops_->move(other.storage_, storage_);
+            ops_ = std::exchange(other.ops_, nullptr);
+        }
+        return *this;
+    }
+
+    ~control_observer() { reset(); }
+
+    /// Returns `true` if a callable is held
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    /// Call the stored callable
+    void operator()(frame_type kind, string_view payload)
+    {
+        BOOST_ASSERT(ops_);
+        ops_->invoke(storage_, kind, payload);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** Measures the round-trip time of pings sent on one connection.
+
+    The stream records each ping it sends, and each pong it receives.
+    A pong carrying the payload of the last ping completes a sample: its
+    round-trip time is the time since the ping was sent. Pongs which do
+    not match, such as unsolicited ones or those answering an earlier
+    ping, are not counted. Only a hash of the payload is kept.
+
+    The smoothed time is a moving average which moves an eighth of the
+    way to each new sample, as TCP smooths its round-trip estimate.
+*/
+class ping_tracker
+{
+  public:
+    using clock_type = std::chrono::steady_clock;
+
+    using duration = clock_type::duration;
+
+  private:
+    clock_type::time_point sent_;
+    std::uint64_t hash_ = 0;
+    bool pending_ = false;
+    duration last_{};
+    duration smoothed_{};
+    duration min_{};
+    std::size_t samples_ = 0;
+
+    static std::uint64_t hash(string_view payload) noexcept
+    {
+        // FNV-1a
+        std::uint64_t h = 14695981039346656037ULL;
+        for (auto c : payload)
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        return h;
+    }
+
+  public:
+    /// Record a ping sent now
+    void on_ping(string_view payload) noexcept
+    {
+        hash_ = hash(payload);
+        sent_ = clock_type::now();
+        pending_ = true;
+    }
+
+    /// Record a pong received now
+    void on_pong(string_view payload) noexcept
+    {
+        if (!pending_ || hash(payload) != hash_)
+            return;
+        pending_ = false;
+        last_ = clock_type::now() - sent_;
+        if (samples_++ == 0) {
+            smoothed_ = last_;
+            min_ = last_;
+            return;
+        }
+        smoothed_ += (last_ - smoothed_) / 8;
+        if (last_ < min_)
+            min_ = last_;
+    }
+
+    /// Returns `true` if the last ping sent has not been answered
+    bool pending() const noexcept { return pending_; }
+
+    /// Returns the round-trip time of the last answered ping
+    duration last() const noexcept { return last_; }
+
+    /// Returns the smoothed round-trip time
+    duration smoothed() const noexcept { return smoothed_; }
+
+    /// Returns the shortest round-trip time seen
+    duration shortest() const noexcept { return min_; }
+
+    /// Returns the number of answered pings
+    std::size_t samples() const noexcept { return samples_; }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::control_observer;
+using boost::beast::websocket::ping_tracker;
+
+#endif    // !CONTROL_OBSERVER_HPP
@@ -0,0 +1,209 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef FILE_MESSAGE_HPP
+#define FILE_MESSAGE_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/error.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "pooled_buffer.hpp"
+#include "shared_frame.hpp"
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+namespace detail {
+
+// Opens a file for async_write_file
+inline int open_file(char const* path, error_code& ec)
+{
+    auto const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        ec.assign(errno, system::system_category());
+    return fd;
+}
+
+// Returns the number of bytes of the file from `offset` to its end
+inline std::size_t file_rest(int fd, std::uint64_t offset, error_code& ec)
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ec.assign(errno, system::system_category());
+        return 0;
+    }
+    auto const size = static_cast<std::uint64_t>(st.st_size);
+    return size > offset ? static_cast<std::size_t>(size - offset) : 0;
+}
+
+// The file of an async_write_file, closed with the operation when the
+// operation opened it, and the block a buffered write reads it into
+class file_source
+{
+    int fd_;
+    bool owned_;
+    char* block_ = nullptr;
+    std::size_t capacity_ = 0;
+
+  public:
+    file_source(int fd, bool owned) noexcept : fd_(fd), owned_(owned) {}
+
+    file_source(file_source&& other) noexcept
+        : fd_(std::exchange(other.fd_, -1))
+        , owned_(other.owned_)
+        , block_(std::exchange(other.block_, nullptr))
+        , capacity_(other.capacity_)
+    {
+    }
+
+    file_source& operator=(file_source&&) = delete;
+
+    ~file_source() { release(); }
+
+    int fd() const noexcept { return fd_; }
+
+    // Returns the block, taken from the thread's pool on first use
+    net::mutable_buffer block()
+    {
+        if (!block_)
+            block_ = buffer_pool::local().allocate(64 * 1024, capacity_);
+        return {block_, capacity_};
+    }
+
+    void release() noexcept
+    {
+        if (block_)
+            buffer_pool::local().deallocate(block_, capacity_);
+        block_ = nullptr;
+        if (owned_ && fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+};
+
+// Writes a range of a file as one message. When the stream may write
+// unmasked, uncompressed frames to a socket, the frame header goes out
+// followed by the file through sendfile. Otherwise the file is read in
+// blocks, each written as a frame of the message with async_write_some.
+template <class Stream, class Handler>
+class write_file_op
+{
+    Handler h_;
+    Stream* ws_;
+    file_source file_;
+    std::uint64_t offset_;
+    std::size_t remaining_;
+    std::size_t bytes_ = 0;
+    bool sendfile_;
+
+    // Complete with an error found outside of a stream operation
+    void fail(error_code ec)
+    {
+        file_.release();
+        net::post(ws_->get_executor(),
+                  beast::bind_front_handler(std::move(h_), ec, bytes_));
+    }
+
+    // Read the next block of the file and write it as a frame
+    void write_some()
+    {
+        auto const block = file_.block();
+        auto const p = static_cast<char*>(block.data());
+        auto const n = (std::min)(remaining_, block.size());
+        for (std::size_t got = 0; got < n;) {
+            auto const result =
+                ::pread(file_.fd(), p + got, n - got,
+                        static_cast<off_t>(offset_ + got));
+            if (result > 0)
+                got += static_cast<std::size_t>(result);
+            else if (result == 0)
+                return fail(net::error::eof);
+            else if (errno != EINTR)
+                return fail(error_code(errno, system::system_category()));
+        }
+        offset_ += n;
+        remaining_ -= n;
+        ws_->async_write_some(remaining_ == 0, net::buffer(p, n),
+                              std::move(*this));
+    }
+
+  public:
+    using executor_type = net::associated_executor_t<
+        Handler, typename Stream::executor_type>;
+
+    using allocator_type = net::associated_allocator_t<Handler>;
+
+    template <class DeducedHandler>
+    write_file_op(DeducedHandler&& h, Stream& ws, file_source file,
+                  std::uint64_t offset, std::size_t length, bool sendfile)
+        : h_(std::forward<DeducedHandler>(h))
+        , ws_(&ws)
+        , file_(std::move(file))
+        , offset_(offset)
+        , remaining_(length)
+        , sendfile_(sendfile)
+    {
+    }
+
+    executor_type get_executor() const noexcept
+    {
+        return net::get_associated_executor(h_, ws_->get_executor());
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return net::get_associated_allocator(h_);
+    }
+
+    // Called by the initiating function
+    void start(error_code ec)
+    {
+        if (ec)
+            return fail(ec);
+#if defined(__linux__)
+        if (sendfile_) {
+            unsigned char header[shared_frame::max_header_size];
+            auto const n = encode_frame_header(header, ws_->binary(), false,
+                                               remaining_);
+            auto const fd = file_.fd();
+            auto const offset = offset_;
+            auto const length = remaining_;
+            return ws_->next_layer().async_sendfile(
+                net::buffer(header, n), fd, offset, length, std::move(*this));
+        }
+#endif
+        write_some();
+    }
+
+    void operator()(error_code ec, std::size_t bytes_transferred)
+    {
+        bytes_ += bytes_transferred;
+        if (!ec && !sendfile_ && remaining_ > 0)
+            return write_some();
+        file_.release();
+        h_(ec, bytes_);
+    }
+};
+
+}    // namespace detail
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !FILE_MESSAGE_HPP
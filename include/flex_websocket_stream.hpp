@@ -0,0 +1,674 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef FLEX_WEBSOCKET_STREAM_HPP
+#define FLEX_WEBSOCKET_STREAM_HPP
+
+#include "websocket_stream_base.hpp"
+
+#include <variant>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A WebSocket stream which is either plain or SSL, chosen at runtime.
+
+    Unlike @ref websocket_stream_base, which reaches the concrete stream
+    through virtual calls, this class holds one of the two stream types
+    in a closed set and dispatches with a single branch on the active
+    alternative. Every member is a small inline function, so per-message
+    observers such as @ref got_text or @ref is_message_done compile down
+    to a predictable branch and a field load. The asynchronous operations
+    take any completion token and are instantiated for both alternatives.
+
+    The interface mirrors @ref websocket_stream. There is no base class
+    and no downcasting; code which must handle both stream types holds
+    this class by value.
+
+    @tparam Executor The executor type, as for
+    @ref basic_websocket_stream_base.
+*/
+template <class Executor = net::any_io_executor>
+class basic_flex_websocket_stream
+{
+  public:
+    using lowest_layer_type = beast::basic_stream<net::ip::tcp, Executor>;
+    using executor_type = Executor;
+
+    using plain_stream_type = websocket::stream<lowest_layer_type>;
+    using ssl_stream_type =
+        websocket::stream<beast::ssl_stream<lowest_layer_type>>;
+
+  private:
+    std::variant<plain_stream_type, ssl_stream_type> ws_;
+
+    // Sizes the first read of each message from the recent messages
+    read_size_policy read_size_;
+
+    // Calls `f` with the active stream. Both branches are visible to
+    // the optimizer, unlike the jump table of std::visit.
+    template <class Function>
+    decltype(auto) visit(Function&& f)
+    {
+        if (ws_.index() == 0)
+            return f(*std::get_if<0>(&ws_));
+        return f(*std::get_if<1>(&ws_));
+    }
+
+  public:
+    // Create a plain flex_websocket_stream
+    explicit basic_flex_websocket_stream(lowest_layer_type&& stream)
+        : ws_(std::in_place_index<0>, std::move(stream))
+    {
+    }
+
+    // Create an SSL flex_websocket_stream
+    explicit basic_flex_websocket_stream(
+        beast::ssl_stream<lowest_layer_type>&& stream)
+        : ws_(std::in_place_index<1>, std::move(stream))
+    {
+    }
+
+    bool use_ssl() const noexcept { return ws_.index() == 1; }
+
+    // Returns the plain stream, or nullptr if the stream uses SSL
+    plain_stream_type* plain_ws() noexcept { return std::get_if<0>(&ws_); }
+
+    // Returns the SSL stream, or nullptr if the stream is plain
+    ssl_stream_type* ssl_ws() noexcept { return std::get_if<1>(&ws_); }
+
+    //--------------------------------------------------------------------------
+
+    executor_type get_executor() noexcept
+    {
+        return visit([](auto& ws) { return executor_type(ws.get_executor()); });
+    }
+
+    lowest_layer_type& lowest_layer() noexcept
+    {
+        return visit([](auto& ws) -> lowest_layer_type& {
+            return beast::get_lowest_layer(ws);
+        });
+    }
+
+    bool is_open() noexcept
+    {
+        return visit([](auto& ws) { return ws.is_open(); });
+    }
+
+    bool got_binary() noexcept
+    {
+        return visit([](auto& ws) { return ws.got_binary(); });
+    }
+
+    bool got_text() noexcept
+    {
+        return visit([](auto& ws) { return ws.got_text(); });
+    }
+
+    bool is_message_done() noexcept
+    {
+        return visit([](auto& ws) { return ws.is_message_done(); });
+    }
+
+    close_reason& reason() noexcept
+    {
+        return visit([](auto& ws) -> close_reason& {
+            return const_cast<close_reason&>(ws.reason());
+        });
+    }
+
+    std::size_t read_size_hint(std::size_t initial_size)
+    {
+        return visit(
+            [=](auto& ws) { return ws.read_size_hint(initial_size); });
+    }
+
+    std::size_t read_size_hint() { return read_size_hint(read_size_.hint()); }
+
+    template <class DynamicBuffer
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = typename std::enable_if<
+                  !std::is_integral<DynamicBuffer>::value>::type
+#endif
+              >
+    std::size_t read_size_hint(DynamicBuffer& buffer)
+    {
+        return visit([&](auto& ws) { return ws.read_size_hint(buffer); });
+    }
+
+    template <class Option>
+    void get_option(Option& opt)
+    {
+        return visit([&](auto& ws) { return ws.get_option(opt); });
+    }
+
+    template <class Option>
+    void set_option(Option opt)
+    {
+        return visit([&](auto& ws) { return ws.set_option(std::move(opt)); });
+    }
+
+    void auto_fragment(bool value)
+    {
+        return visit([=](auto& ws) { return ws.auto_fragment(value); });
+    }
+
+    bool auto_fragment()
+    {
+        return visit([](auto& ws) { return ws.auto_fragment(); });
+    }
+
+    void binary(bool value)
+    {
+        return visit([=](auto& ws) { return ws.binary(value); });
+    }
+
+    bool binary()
+    {
+        return visit([](auto& ws) { return ws.binary(); });
+    }
+
+    void control_callback(std::function<void(frame_type, string_view)> cb)
+    {
+        return visit(
+            [&](auto& ws) { return ws.control_callback(std::move(cb)); });
+    }
+
+    void control_callback()
+    {
+        return visit([](auto& ws) { return ws.control_callback(); });
+    }
+
+    void read_message_max(std::size_t amount)
+    {
+        return visit([=](auto& ws) { return ws.read_message_max(amount); });
+    }
+
+    std::size_t read_message_max()
+    {
+        return visit([](auto& ws) { return ws.read_message_max(); });
+    }
+
+    read_size_policy& read_sizing() noexcept { return read_size_; }
+
+    void secure_prng(bool value)
+    {
+        return visit([=](auto& ws) { return ws.secure_prng(value); });
+    }
+
+    void write_buffer_bytes(std::size_t amount)
+    {
+        return visit([=](auto& ws) { return ws.write_buffer_bytes(amount); });
+    }
+
+    std::size_t write_buffer_bytes()
+    {
+        return visit([](auto& ws) { return ws.write_buffer_bytes(); });
+    }
+
+    void text(bool value)
+    {
+        return visit([=](auto& ws) { return ws.text(value); });
+    }
+
+    bool text()
+    {
+        return visit([](auto& ws) { return ws.text(); });
+    }
+
+    //--------------------------------------------------------------------------
+
+    void handshake(string_view host, string_view target)
+    {
+        return visit([&](auto& ws) { return ws.handshake(host, target); });
+    }
+
+    void handshake(response_type& res, string_view host, string_view target)
+    {
+        return visit(
+            [&](auto& ws) { return ws.handshake(res, host, target); });
+    }
+
+    void handshake(string_view host, string_view target, error_code& ec)
+    {
+        return visit(
+            [&](auto& ws) { return ws.handshake(host, target, ec); });
+    }
+
+    void handshake(response_type& res, string_view host, string_view target,
+                   error_code& ec)
+    {
+        return visit(
+            [&](auto& ws) { return ws.handshake(res, host, target, ec); });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 HandshakeHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(HandshakeHandler)
+    async_handshake(string_view host, string_view target,
+                    HandshakeHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_handshake(
+                host, target, std::forward<HandshakeHandler>(handler));
+        });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 HandshakeHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(HandshakeHandler)
+    async_handshake(response_type& res, string_view host, string_view target,
+                    HandshakeHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_handshake(
+                res, host, target, std::forward<HandshakeHandler>(handler));
+        });
+    }
+
+    void accept()
+    {
+        return visit([](auto& ws) { return ws.accept(); });
+    }
+
+    void accept(error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.accept(ec); });
+    }
+
+    template <class ConstBufferSequence>
+#if BOOST_BEAST_DOXYGEN
+    void
+#else
+    typename std::enable_if<
+        !http::detail::is_header<ConstBufferSequence>::value>::type
+#endif
+    accept(ConstBufferSequence const& buffers)
+    {
+        return visit([&](auto& ws) { return ws.accept(buffers); });
+    }
+
+    template <class ConstBufferSequence>
+#if BOOST_BEAST_DOXYGEN
+    void
+#else
+    typename std::enable_if<
+        !http::detail::is_header<ConstBufferSequence>::value>::type
+#endif
+    accept(ConstBufferSequence const& buffers, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.accept(buffers, ec); });
+    }
+
+    template <class Body, class Allocator>
+    void accept(http::request<Body, http::basic_fields<Allocator>> const& req)
+    {
+        return visit([&](auto& ws) { return ws.accept(req); });
+    }
+
+    template <class Body, class Allocator>
+    void accept(http::request<Body, http::basic_fields<Allocator>> const& req,
+                error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.accept(req, ec); });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
+    async_accept(AcceptHandler&& handler =
+                     net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_accept(std::forward<AcceptHandler>(handler));
+        });
+    }
+
+    template <class ConstBufferSequence,
+              BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
+    async_accept(
+        ConstBufferSequence const& buffers,
+        AcceptHandler&& handler =
+            net::default_completion_token_t<executor_type> {}
+#ifndef BOOST_BEAST_DOXYGEN
+        ,
+        typename std::enable_if<
+            !http::detail::is_header<ConstBufferSequence>::value>::type* = 0
+#endif
+    )
+    {
+        return visit([&](auto& ws) {
+            return ws.async_accept(buffers,
+                                   std::forward<AcceptHandler>(handler));
+        });
+    }
+
+    template <class Body, class Allocator,
+              BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
+    async_accept(http::request<Body, http::basic_fields<Allocator>> const& req,
+                 AcceptHandler&& handler =
+                     net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_accept(req, std::forward<AcceptHandler>(handler));
+        });
+    }
+
+    void close(close_reason const& cr)
+    {
+        return visit([&](auto& ws) { return ws.close(cr); });
+    }
+
+    void close(close_reason const& cr, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.close(cr, ec); });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 CloseHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(CloseHandler)
+    async_close(close_reason const& cr,
+                CloseHandler&& handler =
+                    net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_close(cr, std::forward<CloseHandler>(handler));
+        });
+    }
+
+    void ping(ping_data const& payload)
+    {
+        return visit([&](auto& ws) { return ws.ping(payload); });
+    }
+
+    void ping(ping_data const& payload, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.ping(payload, ec); });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(WriteHandler)
+    async_ping(ping_data const& payload,
+               WriteHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_ping(payload, std::forward<WriteHandler>(handler));
+        });
+    }
+
+    void pong(ping_data const& payload)
+    {
+        return visit([&](auto& ws) { return ws.pong(payload); });
+    }
+
+    void pong(ping_data const& payload, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.pong(payload, ec); });
+    }
+
+    template <BOOST_BEAST_ASYNC_TPARAM1 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(WriteHandler)
+    async_pong(ping_data const& payload,
+               WriteHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_pong(payload, std::forward<WriteHandler>(handler));
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    template <class DynamicBuffer>
+    std::size_t read(DynamicBuffer& buffer)
+    {
+        return visit([&](auto& ws) { return ws.read(buffer); });
+    }
+
+    template <class DynamicBuffer>
+    std::size_t read(DynamicBuffer& buffer, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.read(buffer, ec); });
+    }
+
+    template <class DynamicBuffer,
+              BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read(DynamicBuffer& buffer,
+               ReadHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return net::async_initiate<ReadHandler,
+                                       void(error_code, std::size_t)>(
+                [this, &ws](auto h, DynamicBuffer* buffer) {
+                    detail::adaptive_read_op<
+                        typename std::decay<decltype(ws)>::type, DynamicBuffer,
+                        decltype(h)>(std::move(h), ws, *buffer, read_size_)
+                        .start();
+                },
+                handler, &buffer);
+        });
+    }
+
+    template <class DynamicBuffer>
+    std::size_t read_some(DynamicBuffer& buffer, std::size_t limit)
+    {
+        return visit([&](auto& ws) { return ws.read_some(buffer, limit); });
+    }
+
+    template <class DynamicBuffer>
+    std::size_t read_some(DynamicBuffer& buffer, std::size_t limit,
+                          error_code& ec)
+    {
+        return visit(
+            [&](auto& ws) { return ws.read_some(buffer, limit, ec); });
+    }
+
+    template <class DynamicBuffer,
+              BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_some(DynamicBuffer& buffer, std::size_t limit,
+                    ReadHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_read_some(buffer, limit,
+                                      std::forward<ReadHandler>(handler));
+        });
+    }
+
+    template <class MutableBufferSequence>
+    std::size_t read_some(MutableBufferSequence const& buffers)
+    {
+        return visit([&](auto& ws) { return ws.read_some(buffers); });
+    }
+
+    template <class MutableBufferSequence>
+    std::size_t read_some(MutableBufferSequence const& buffers, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.read_some(buffers, ec); });
+    }
+
+    template <class MutableBufferSequence,
+              BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_some(MutableBufferSequence const& buffers,
+                    ReadHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_read_some(buffers,
+                                      std::forward<ReadHandler>(handler));
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    template <class ConstBufferSequence>
+    std::size_t write(ConstBufferSequence const& buffers)
+    {
+        return visit([&](auto& ws) { return ws.write(buffers); });
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t write(ConstBufferSequence const& buffers, error_code& ec)
+    {
+        return visit([&](auto& ws) { return ws.write(buffers, ec); });
+    }
+
+    template <class ConstBufferSequence,
+              BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write(ConstBufferSequence const& buffers,
+                WriteHandler&& handler =
+                    net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_write(buffers, std::forward<WriteHandler>(handler));
+        });
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t write_some(bool fin, ConstBufferSequence const& buffers)
+    {
+        return visit([&](auto& ws) { return ws.write_some(fin, buffers); });
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t write_some(bool fin, ConstBufferSequence const& buffers,
+                           error_code& ec)
+    {
+        return visit(
+            [&](auto& ws) { return ws.write_some(fin, buffers, ec); });
+    }
+
+    template <class ConstBufferSequence,
+              BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_some(bool fin, ConstBufferSequence const& buffers,
+                     WriteHandler&& handler =
+                         net::default_completion_token_t<executor_type>{})
+    {
+        return visit([&](auto& ws) {
+            return ws.async_write_some(fin, buffers,
+                                       std::forward<WriteHandler>(handler));
+        });
+    }
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) || BOOST_BEAST_DOXYGEN
+    //--------------------------------------------------------------------------
+
+    template <class T>
+    using awaitable = net::awaitable<T, executor_type>;
+
+    awaitable<void> co_accept()
+    {
+        return async_accept(net::use_awaitable_t<executor_type>{});
+    }
+
+    awaitable<void> co_accept(error_code& ec)
+    {
+        return async_accept(
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class Body, class Allocator>
+    awaitable<void> co_accept(
+        http::request<Body, http::basic_fields<Allocator>> const& req)
+    {
+        return async_accept(req, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class Body, class Allocator>
+    awaitable<void> co_accept(
+        http::request<Body, http::basic_fields<Allocator>> const& req,
+        error_code& ec)
+    {
+        return async_accept(
+            req,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    awaitable<void> co_close(close_reason const& cr)
+    {
+        return async_close(cr, net::use_awaitable_t<executor_type>{});
+    }
+
+    awaitable<void> co_close(close_reason const& cr, error_code& ec)
+    {
+        return async_close(
+            cr,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    awaitable<void> co_ping(ping_data const& payload)
+    {
+        return async_ping(payload, net::use_awaitable_t<executor_type>{});
+    }
+
+    awaitable<void> co_ping(ping_data const& payload, error_code& ec)
+    {
+        return async_ping(
+            payload,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class DynamicBuffer>
+    awaitable<std::size_t> co_read(DynamicBuffer& buffer)
+    {
+        return async_read(buffer, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class DynamicBuffer>
+    awaitable<std::size_t> co_read(DynamicBuffer& buffer, error_code& ec)
+    {
+        return async_read(
+            buffer,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class ConstBufferSequence>
+    awaitable<std::size_t> co_write(ConstBufferSequence const& buffers)
+    {
+        return async_write(buffers, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class ConstBufferSequence>
+    awaitable<std::size_t> co_write(ConstBufferSequence const& buffers,
+                                    error_code& ec)
+    {
+        return async_write(
+            buffers,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+#endif
+};
+
+using flex_websocket_stream = basic_flex_websocket_stream<>;
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using flex_websocket_stream = boost::beast::websocket::flex_websocket_stream;
+
+#endif    // !FLEX_WEBSOCKET_STREAM_HPP
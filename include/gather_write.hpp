@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef GATHER_WRITE_HPP
+#define GATHER_WRITE_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/beast/core/error.hpp>
+#include <cstddef>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+namespace detail {
+
+// Completes a gathered write of a frame header followed by the caller's
+// buffers, reporting only the payload bytes, as websocket::stream does.
+template <class Handler, class Executor>
+class gather_write_handler
+{
+    Handler h_;
+    Executor ex_;
+    std::size_t header_size_;
+
+  public:
+    using executor_type = net::associated_executor_t<Handler, Executor>;
+
+    using allocator_type = net::associated_allocator_t<Handler>;
+
+    template <class DeducedHandler>
+    gather_write_handler(DeducedHandler&& h, Executor const& ex,
+                         std::size_t header_size)
+        : h_(std::forward<DeducedHandler>(h))
+        , ex_(ex)
+        , header_size_(header_size)
+    {
+    }
+
+    executor_type get_executor() const noexcept
+    {
+        return net::get_associated_executor(h_, ex_);
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return net::get_associated_allocator(h_);
+    }
+
+    void operator()(error_code ec, std::size_t bytes_transferred)
+    {
+        h_(ec, bytes_transferred > header_size_
+                   ? bytes_transferred - header_size_
+                   : 0);
+    }
+};
+
+}    // namespace detail
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !GATHER_WRITE_HPP
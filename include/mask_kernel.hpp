@@ -0,0 +1,297 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef MASK_KERNEL_HPP
+#define MASK_KERNEL_HPP
+
+// Beast applies the WebSocket mask with a byte loop in
+// <boost/beast/websocket/detail/mask.ipp>, which it includes from
+// mask.hpp when it is header-only. When this header is seen first, that
+// file is kept out and the two functions it defines are defined below
+// in terms of the kernels of this header, so every read of a client
+// frame and every client-role write is masked by the fastest kernel the
+// CPU supports. Define WEBSOCKET_STREAM_SCALAR_MASK to keep Beast's loop.
+//
+// All translation units of a program must agree: include this header,
+// or a header of this library, before any Beast WebSocket header.
+#if !defined(WEBSOCKET_STREAM_SCALAR_MASK) &&                         \
+    !defined(BOOST_BEAST_SEPARATE_COMPILATION) &&                      \
+    !defined(BOOST_BEAST_WEBSOCKET_DETAIL_MASK_IPP)
+#define WEBSOCKET_STREAM_REPLACES_MASK 1
+#define BOOST_BEAST_WEBSOCKET_DETAIL_MASK_IPP
+#else
+#define WEBSOCKET_STREAM_REPLACES_MASK 0
+#endif
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/websocket/detail/mask.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define WEBSOCKET_STREAM_X86_MASK 1
+#include <immintrin.h>
+#else
+#define WEBSOCKET_STREAM_X86_MASK 0
+#endif
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Vectorized kernels which apply a WebSocket mask in place.
+
+    Each kernel XORs `n` bytes at `p` with the four bytes of the key
+    repeated, the first byte of the key applying to `p[0]`. The key is
+    passed as the native word holding those four bytes in memory order.
+    The best kernel for the CPU is chosen at run time, once.
+*/
+namespace mask_kernel {
+
+/// The instruction sets a kernel may use
+enum class isa
+{
+    scalar,
+    sse2,
+    avx2,
+    avx512
+};
+
+/// The type of a kernel
+using function_type = void (*)(unsigned char* p, std::size_t n,
+                               std::uint32_t key);
+
+namespace detail {
+
+// XOR the bytes which remain after the vector loop, starting at an
+// offset which is a multiple of four
+inline void mask_tail(unsigned char* p, std::size_t n,
+                      std::uint32_t key) noexcept
+{
+    std::uint64_t const key64 =
+        (static_cast<std::uint64_t>(key) << 32) | key;
+    for (; n >= 8; p += 8, n -= 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        v ^= key64;
+        std::memcpy(p, &v, 8);
+    }
+    unsigned char k[4];
+    std::memcpy(k, &key, 4);
+    for (std::size_t i = 0; i < n; ++i)
+        p[i] ^= k[i & 3];
+}
+
+// Mask the bytes before the first multiple of `align` when the buffer
+// is long enough for that to pay, so that the vector stores do not
+// split cache lines, and return the key for the byte after them.
+inline std::uint32_t mask_head(unsigned char*& p, std::size_t& n,
+                               std::uint32_t key, std::size_t align) noexcept
+{
+    auto const head =
+        (align - (reinterpret_cast<std::uintptr_t>(p) & (align - 1))) &
+        (align - 1);
+    if (head == 0 || n < 32 * align)
+        return key;
+    mask_tail(p, head, key);
+    p += head;
+    n -= head;
+    // The key bytes are in memory order, so on this little-endian
+    // target the next byte takes the low byte of a right rotation.
+    auto const r = 8 * (head & 3);
+    return r == 0 ? key : (key >> r) | (key << (32 - r));
+}
+
+}    // namespace detail
+
+/// Apply the mask eight bytes at a time, with no vector instructions
+inline void mask_scalar(unsigned char* p, std::size_t n, std::uint32_t key)
+{
+    detail::mask_tail(p, n, key);
+}
+
+#if WEBSOCKET_STREAM_X86_MASK
+/// Apply the mask sixteen bytes at a time
+__attribute__((target("sse2"))) inline void
+mask_sse2(unsigned char* p, std::size_t n, std::uint32_t key)
+{
+    auto const k = _mm_set1_epi32(static_cast<int>(key));
+    for (; n >= 64; p += 64, n -= 64) {
+        auto const q = reinterpret_cast<__m128i*>(p);
+        _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(q), k));
+        _mm_storeu_si128(q + 1, _mm_xor_si128(_mm_loadu_si128(q + 1), k));
+        _mm_storeu_si128(q + 2, _mm_xor_si128(_mm_loadu_si128(q + 2), k));
+        _mm_storeu_si128(q + 3, _mm_xor_si128(_mm_loadu_si128(q + 3), k));
+    }
+    for (; n >= 16; p += 16, n -= 16) {
+        auto const q = reinterpret_cast<__m128i*>(p);
+        _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(q), k));
+    }
+    detail::mask_tail(p, n, key);
+}
+
+/// Apply the mask thirty-two bytes at a time
+__attribute__((target("avx2"))) inline void
+mask_avx2(unsigned char* p, std::size_t n, std::uint32_t key)
+{
+    key = detail::mask_head(p, n, key, 32);
+    auto const k = _mm256_set1_epi32(static_cast<int>(key));
+    for (; n >= 128; p += 128, n -= 128) {
+        auto const q = reinterpret_cast<__m256i*>(p);
+        _mm256_storeu_si256(q, _mm256_xor_si256(_mm256_loadu_si256(q), k));
+        _mm256_storeu_si256(q + 1,
+                            _mm256_xor_si256(_mm256_loadu_si256(q + 1), k));
+        _mm256_storeu_si256(q + 2,
+                            _mm256_xor_si256(_mm256_loadu_si256(q + 2), k));
+        _mm256_storeu_si256(q + 3,
+                            _mm256_xor_si256(_mm256_loadu_si256(q + 3), k));
+    }
+    for (; n >= 32; p += 32, n -= 32) {
+        auto const q = reinterpret_cast<__m256i*>(p);
+        _mm256_storeu_si256(q, _mm256_xor_si256(_mm256_loadu_si256(q), k));
+    }
+    detail::mask_tail(p, n, key);
+}
+
+/// Apply the mask sixty-four bytes at a time
+__attribute__((target("avx512f,avx512bw"))) inline void
+mask_avx512(unsigned char* p, std::size_t n, std::uint32_t key)
+{
+    key = detail::mask_head(p, n, key, 64);
+    auto const k = _mm512_set1_epi32(static_cast<int>(key));
+    for (; n >= 256; p += 256, n -= 256) {
+        for (int i = 0; i < 4; ++i) {
+            auto const q = p + 64 * i;
+            _mm512_storeu_si512(q,
+                                _mm512_xor_si512(_mm512_loadu_si512(q), k));
+        }
+    }
+    for (; n >= 64; p += 64, n -= 64)
+        _mm512_storeu_si512(p, _mm512_xor_si512(_mm512_loadu_si512(p), k));
+    if (n > 0) {
+        // The last bytes in one masked operation
+        auto const m = static_cast<__mmask64>((std::uint64_t(1) << n) - 1);
+        _mm512_mask_storeu_epi8(
+            p, m, _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, p), k));
+    }
+}
+#endif
+
+/// Returns `true` if the CPU can run kernels of the instruction set
+inline bool supported(isa set) noexcept
+{
+    switch (set) {
+    case isa::scalar:
+        return true;
+#if WEBSOCKET_STREAM_X86_MASK
+    case isa::sse2:
+        return __builtin_cpu_supports("sse2");
+    case isa::avx2:
+        return __builtin_cpu_supports("avx2");
+    case isa::avx512:
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+        return false;
+    }
+}
+
+/** Returns the kernel for an instruction set.
+
+    The instruction set must be @ref supported.
+*/
+inline function_type get(isa set) noexcept
+{
+    switch (set) {
+#if WEBSOCKET_STREAM_X86_MASK
+    case isa::sse2:
+        return &mask_sse2;
+    case isa::avx2:
+        return &mask_avx2;
+    case isa::avx512:
+        return &mask_avx512;
+#endif
+    default:
+        return &mask_scalar;
+    }
+}
+
+/** Returns the instruction set of the fastest kernel the CPU supports.
+
+    Masking is bound by memory bandwidth once a payload outgrows the L1
+    cache, where AVX-512 is no faster than AVX2 and may lower the clock
+    of the core. It is therefore only chosen when
+    WEBSOCKET_STREAM_MASK_AVX512 is defined.
+*/
+inline isa best() noexcept
+{
+#if defined(WEBSOCKET_STREAM_MASK_AVX512)
+    if (supported(isa::avx512))
+        return isa::avx512;
+#endif
+    for (auto set : {isa::avx2, isa::sse2})
+        if (supported(set))
+            return set;
+    return isa::scalar;
+}
+
+/// Returns the kernel used to mask frames, chosen on the first call
+inline function_type active() noexcept
+{
+    static function_type const f = get(best());
+    return f;
+}
+
+/** Apply a mask in place, as Beast's `detail::mask_inplace` does.
+
+    The key is rotated by the size of the buffer, so that the next call
+    continues the mask where this one ended.
+*/
+inline void mask_inplace(net::mutable_buffer const& b,
+                         beast::websocket::detail::prepared_key& key)
+{
+    auto const n = b.size();
+    if (n == 0)
+        return;
+    std::uint32_t word;
+    std::memcpy(&word, key.data(), 4);
+    active()(static_cast<unsigned char*>(b.data()), n, word);
+    if (auto const r = n & 3) {
+        auto const k = key;
+        for (std::size_t i = 0; i < 4; ++i)
+            key[i] = k[(i + r) & 3];
+    }
+}
+
+}    // namespace mask_kernel
+
+#if WEBSOCKET_STREAM_REPLACES_MASK && !BOOST_BEAST_DOXYGEN
+namespace detail {
+
+// The definitions Beast's mask.ipp would provide
+
+inline void prepare_key(prepared_key& prepared, std::uint32_t key)
+{
+    prepared[0] = (key >> 0) & 0xff;
+    prepared[1] = (key >> 8) & 0xff;
+    prepared[2] = (key >> 16) & 0xff;
+    prepared[3] = (key >> 24) & 0xff;
+}
+
+inline void mask_inplace(net::mutable_buffer const& b, prepared_key& key)
+{
+    mask_kernel::mask_inplace(b, key);
+}
+
+}    // namespace detail
+#endif
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !MASK_KERNEL_HPP
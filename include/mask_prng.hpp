@@ -0,0 +1,268 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef MASK_PRNG_HPP
+#define MASK_PRNG_HPP
+
+// A client-role stream asks <boost/beast/websocket/detail/prng.ipp> for
+// the key of every frame it sends. Its secure generator computes a
+// ChaCha20 block for every sixteen keys, behind a thread-local lookup
+// on each call, and advances the block counter only every sixteenth
+// block, so that each block of keys is repeated sixteen times. As with
+// mask_kernel.hpp, when this header is seen first that file is kept out
+// and the secure generator is replaced by the buffered one below.
+// Define WEBSOCKET_STREAM_BEAST_PRNG to keep Beast's generators.
+//
+// All translation units of a program must agree: include this header,
+// or a header of this library, before any Beast WebSocket header.
+#if !defined(WEBSOCKET_STREAM_BEAST_PRNG) &&                          \
+    !defined(BOOST_BEAST_SEPARATE_COMPILATION) &&                      \
+    !defined(BOOST_BEAST_WEBSOCKET_DETAIL_PRNG_IPP)
+#define WEBSOCKET_STREAM_REPLACES_PRNG 1
+#define BOOST_BEAST_WEBSOCKET_DETAIL_PRNG_IPP
+#else
+#define WEBSOCKET_STREAM_REPLACES_PRNG 0
+#endif
+
+#include <boost/beast/core/detail/pcg.hpp>
+#include <boost/beast/websocket/detail/prng.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Generators of the keys which mask the frames a client sends.
+
+    The secure generator is ChaCha20 keyed with the seed of
+    `detail::prng_seed`, one stream per thread. Each thread refills a
+    buffer of @ref chacha_buffer::batch blocks at a time, computing word
+    `i` of every block in the lanes of one vector, and hands out one word
+    of it per key. The fast generator is Beast's PCG.
+*/
+namespace mask_prng {
+
+/// A ChaCha20 generator which computes several blocks at a time
+class chacha_buffer
+{
+  public:
+    using result_type = std::uint32_t;
+
+    /// The number of blocks computed by one refill
+    static std::size_t constexpr batch = 4;
+
+    /// The number of words produced by one refill
+    static std::size_t constexpr words = 16 * batch;
+
+  private:
+    std::uint32_t key_[8];
+    std::uint32_t nonce_[2];
+    std::uint64_t counter_ = 0;
+    std::size_t next_ = words;
+    alignas(64) std::uint32_t out_[words];
+
+#if defined(__GNUC__)
+    // Word i of every block
+    using lanes = std::uint32_t
+        __attribute__((vector_size(sizeof(std::uint32_t) * batch)));
+#else
+    struct lanes
+    {
+        std::uint32_t v[batch];
+
+        std::uint32_t& operator[](std::size_t i) noexcept { return v[i]; }
+
+        std::uint32_t operator[](std::size_t i) const noexcept
+        {
+            return v[i];
+        }
+
+#define WEBSOCKET_STREAM_LANES_OP(op)                                    \
+    lanes operator op(lanes const& rhs) const noexcept                  \
+    {                                                                    \
+        lanes r;                                                         \
+        for (std::size_t i = 0; i < batch; ++i)                          \
+            r.v[i] = v[i] op rhs.v[i];                                   \
+        return r;                                                        \
+    }
+        WEBSOCKET_STREAM_LANES_OP(+)
+        WEBSOCKET_STREAM_LANES_OP(^)
+        WEBSOCKET_STREAM_LANES_OP(|)
+#undef WEBSOCKET_STREAM_LANES_OP
+
+        lanes operator<<(int n) const noexcept
+        {
+            lanes r;
+            for (std::size_t i = 0; i < batch; ++i)
+                r.v[i] = v[i] << n;
+            return r;
+        }
+
+        lanes operator>>(int n) const noexcept
+        {
+            lanes r;
+            for (std::size_t i = 0; i < batch; ++i)
+                r.v[i] = v[i] >> n;
+            return r;
+        }
+    };
+#endif
+
+    static lanes rotl(lanes x, int n) noexcept
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    static void quarter(lanes& a, lanes& b, lanes& c, lanes& d) noexcept
+    {
+        a = a + b;
+        d = rotl(d ^ a, 16);
+        c = c + d;
+        b = rotl(b ^ c, 12);
+        a = a + b;
+        d = rotl(d ^ a, 8);
+        c = c + d;
+        b = rotl(b ^ c, 7);
+    }
+
+    void refill() noexcept
+    {
+        std::uint32_t const input[16] = {
+            0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+            key_[0],    key_[1],    key_[2],    key_[3],
+            key_[4],    key_[5],    key_[6],    key_[7],
+            0,          0,          nonce_[0],  nonce_[1]};
+
+        lanes initial[16];
+        for (int i = 0; i < 16; ++i)
+            for (std::size_t j = 0; j < batch; ++j)
+                initial[i][j] = input[i];
+        for (std::size_t j = 0; j < batch; ++j) {
+            auto const counter = counter_ + j;
+            initial[12][j] = static_cast<std::uint32_t>(counter);
+            initial[13][j] = static_cast<std::uint32_t>(counter >> 32);
+        }
+        counter_ += batch;
+
+        lanes x[16];
+        for (int i = 0; i < 16; ++i)
+            x[i] = initial[i];
+        for (int round = 0; round < 20; round += 2) {
+            quarter(x[0], x[4], x[8], x[12]);
+            quarter(x[1], x[5], x[9], x[13]);
+            quarter(x[2], x[6], x[10], x[14]);
+            quarter(x[3], x[7], x[11], x[15]);
+            quarter(x[0], x[5], x[10], x[15]);
+            quarter(x[1], x[6], x[11], x[12]);
+            quarter(x[2], x[7], x[8], x[13]);
+            quarter(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; ++i) {
+            auto const v = x[i] + initial[i];
+            for (std::size_t j = 0; j < batch; ++j)
+                out_[16 * j + i] = v[j];
+        }
+        next_ = 0;
+    }
+
+  public:
+    /** Constructor
+
+        @param key The eight words of the key.
+
+        @param stream Selects one of the streams of output of the key.
+    */
+    chacha_buffer(std::uint32_t const* key, std::uint64_t stream) noexcept
+    {
+        for (int i = 0; i < 8; ++i)
+            key_[i] = key[i];
+        nonce_[0] = static_cast<std::uint32_t>(stream);
+        nonce_[1] = static_cast<std::uint32_t>(stream >> 32);
+    }
+
+    /// Returns the next word of output
+    std::uint32_t operator()() noexcept
+    {
+        if (next_ == words)
+            refill();
+        return out_[next_++];
+    }
+};
+
+/// Returns a number which differs for each generator created
+inline std::uint64_t make_nonce() noexcept
+{
+    static std::atomic<std::uint64_t> nonce{0};
+    return ++nonce;
+}
+
+/// Returns a key from the secure generator of the calling thread
+inline std::uint32_t secure_generate()
+{
+    thread_local chacha_buffer gen{beast::websocket::detail::prng_seed(),
+                                   make_nonce()};
+    return gen();
+}
+
+/// Returns a key from the fast generator of the calling thread
+inline std::uint32_t fast_generate()
+{
+    thread_local beast::detail::pcg gen = [] {
+        auto const pv = beast::websocket::detail::prng_seed();
+        return beast::detail::pcg{
+            ((static_cast<std::uint64_t>(pv[0]) << 32) + pv[1]) ^
+                ((static_cast<std::uint64_t>(pv[2]) << 32) + pv[3]) ^
+                ((static_cast<std::uint64_t>(pv[4]) << 32) + pv[5]) ^
+                ((static_cast<std::uint64_t>(pv[6]) << 32) + pv[7]),
+            make_nonce()};
+    }();
+    return gen();
+}
+
+}    // namespace mask_prng
+
+#if WEBSOCKET_STREAM_REPLACES_PRNG && !BOOST_BEAST_DOXYGEN
+namespace detail {
+
+// The definitions Beast's prng.ipp would provide
+
+inline std::uint32_t const* prng_seed(std::seed_seq* ss)
+{
+    struct data
+    {
+        std::uint32_t v[8];
+
+        explicit data(std::seed_seq* pss)
+        {
+            if (!pss) {
+                std::random_device g;
+                std::seed_seq ss{g(), g(), g(), g(), g(), g(), g(), g()};
+                ss.generate(v, v + 8);
+            } else {
+                pss->generate(v, v + 8);
+            }
+        }
+    };
+    static data const d(ss);
+    return d.v;
+}
+
+inline generator make_prng(bool secure)
+{
+    if (secure)
+        return &mask_prng::secure_generate;
+    return &mask_prng::fast_generate;
+}
+
+}    // namespace detail
+#endif
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !MASK_PRNG_HPP
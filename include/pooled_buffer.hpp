@@ -0,0 +1,332 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef POOLED_BUFFER_HPP
+#define POOLED_BUFFER_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/detail/config.hpp>
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A per-thread cache of buffer blocks in power-of-two size classes.
+
+    Blocks from 512 bytes to 16 MiB are rounded up to a power of two and,
+    when freed, kept on the freelist of their size class for the next
+    request of that class on the same thread. Larger blocks are not
+    cached. A block may be freed on a different thread from the one it
+    was taken on; it then joins the cache of the freeing thread.
+
+    The bytes held by the freelists of one thread are capped by
+    @ref limit. A freed block which would exceed the cap is returned to
+    the heap instead.
+*/
+class buffer_pool
+{
+  public:
+    /// The size of the smallest block
+    static std::size_t constexpr min_block = 512;
+
+    /// The number of size classes, the largest holding 16 MiB blocks
+    static std::size_t constexpr class_count = 16;
+
+    /// The size of the largest block kept in the cache
+    static std::size_t constexpr max_block = min_block << (class_count - 1);
+
+  private:
+    struct node
+    {
+        node* next;
+    };
+
+    node* free_[class_count] = {};
+    std::size_t cached_ = 0;
+    std::size_t limit_ = 4 * 1024 * 1024;
+    std::size_t allocations_ = 0;
+    std::size_t reuses_ = 0;
+
+    // The smallest class holding `n` bytes, or `class_count` if none
+    static std::size_t class_of(std::size_t n) noexcept
+    {
+        std::size_t k = 0;
+        for (std::size_t size = min_block; size < n && k < class_count;
+             size <<= 1)
+            ++k;
+        return k;
+    }
+
+    // Free cached blocks until at most `bytes` remain, largest first
+    void trim(std::size_t bytes) noexcept
+    {
+        for (std::size_t k = class_count; k-- > 0 && cached_ > bytes;) {
+            while (free_[k] && cached_ > bytes) {
+                auto const p = free_[k];
+                free_[k] = p->next;
+                cached_ -= min_block << k;
+                ::operator delete(p);
+            }
+        }
+    }
+
+  public:
+    buffer_pool() = default;
+    buffer_pool(buffer_pool const&) = delete;
+    buffer_pool& operator=(buffer_pool const&) = delete;
+
+    /// Destructor. Returns the cached blocks to the heap.
+    ~buffer_pool() { trim(0); }
+
+    /// Returns the pool of the calling thread
+    static buffer_pool& local()
+    {
+        thread_local buffer_pool pool;
+        return pool;
+    }
+
+    /** Take a block of at least `n` bytes.
+
+        @param capacity Set to the size of the returned block, which
+        must be passed to @ref deallocate.
+    */
+    char* allocate(std::size_t n, std::size_t& capacity)
+    {
+        auto const k = class_of(n);
+        if (k == class_count) {
+            capacity = n;
+            ++allocations_;
+            return static_cast<char*>(::operator new(n));
+        }
+        capacity = min_block << k;
+        if (auto const p = free_[k]) {
+            free_[k] = p->next;
+            cached_ -= capacity;
+            ++reuses_;
+            return reinterpret_cast<char*>(p);
+        }
+        ++allocations_;
+        return static_cast<char*>(::operator new(capacity));
+    }
+
+    /// Return a block taken with @ref allocate
+    void deallocate(char* p, std::size_t capacity) noexcept
+    {
+        if (capacity > max_block || cached_ + capacity > limit_)
+            return ::operator delete(p);
+        auto const k = class_of(capacity);
+        free_[k] = ::new (p) node{free_[k]};
+        cached_ += capacity;
+    }
+
+    /// Returns the most bytes the freelists of this thread may hold
+    std::size_t limit() const noexcept { return limit_; }
+
+    /** Set the most bytes the freelists of this thread may hold.
+
+        Cached blocks beyond the new limit are returned to the heap. A
+        limit of zero disables the cache.
+    */
+    void limit(std::size_t bytes) noexcept
+    {
+        limit_ = bytes;
+        trim(bytes);
+    }
+
+    /// Return every cached block to the heap
+    void release() noexcept { trim(0); }
+
+    /// Returns the bytes held by the freelists
+    std::size_t cached_bytes() const noexcept { return cached_; }
+
+    /// Returns the number of blocks taken from the heap
+    std::size_t allocations() const noexcept { return allocations_; }
+
+    /// Returns the number of blocks served from the freelists
+    std::size_t reuses() const noexcept { return reuses_; }
+};
+
+//------------------------------------------------------------------------------
+
+/** A DynamicBuffer whose storage comes from the thread's @ref buffer_pool.
+
+    The buffer holds one contiguous block, like `flat_buffer`. It grows
+    into the next size class when a `prepare` does not fit, and hands its
+    block back to the pool as soon as all of its readable bytes are
+    consumed. A buffer made for every message, or one kept for the life
+    of a session, therefore reuses the same few blocks once the pool is
+    warm, and reading a message does not call the allocator.
+
+    Objects of this type meet the requirements of DynamicBuffer and may
+    be passed to the read operations of `websocket_stream`.
+*/
+class pooled_buffer
+{
+    char* begin_ = nullptr;
+    char* in_ = nullptr;
+    char* out_ = nullptr;
+    char* last_ = nullptr;
+    char* end_ = nullptr;
+    std::size_t max_;
+
+    void release() noexcept
+    {
+        if (begin_)
+            buffer_pool::local().deallocate(
+                begin_, static_cast<std::size_t>(end_ - begin_));
+        begin_ = in_ = out_ = last_ = end_ = nullptr;
+    }
+
+  public:
+    /// The ConstBufferSequence used to represent the readable bytes
+    using const_buffers_type = net::const_buffer;
+
+    /// The MutableBufferSequence used to represent the writable bytes
+    using mutable_buffers_type = net::mutable_buffer;
+
+    /// Constructor
+    pooled_buffer() noexcept : max_(std::numeric_limits<std::size_t>::max())
+    {
+    }
+
+    /** Constructor.
+
+        @param limit The most bytes the buffer may hold.
+    */
+    explicit pooled_buffer(std::size_t limit) noexcept : max_(limit) {}
+
+    /// Move constructor. The other buffer is left empty.
+    pooled_buffer(pooled_buffer&& other) noexcept
+        : begin_(other.begin_)
+        , in_(other.in_)
+        , out_(other.out_)
+        , last_(other.last_)
+        , end_(other.end_)
+        , max_(other.max_)
+    {
+        other.begin_ = other.in_ = other.out_ = other.last_ = other.end_ =
+            nullptr;
+    }
+
+    /// Move assignment. The other buffer is left empty.
+    pooled_buffer& operator=(pooled_buffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            begin_ = other.begin_;
+            in_ = other.in_;
+            out_ = other.out_;
+            last_ = other.last_;
+            end_ = other.end_;
+            max_ = other.max_;
+            other.begin_ = other.in_ = other.out_ = other.last_ =
+                other.end_ = nullptr;
+        }
+        return *this;
+    }
+
+    pooled_buffer(pooled_buffer const&) = delete;
+    pooled_buffer& operator=(pooled_buffer const&) = delete;
+
+    /// Destructor. The block goes back to the pool of the calling thread.
+    ~pooled_buffer() { release(); }
+
+    /// Returns the number of readable bytes
+    std::size_t size() const noexcept
+    {
+        return static_cast<std::size_t>(out_ - in_);
+    }
+
+    /// Returns the most bytes the buffer may hold
+    std::size_t max_size() const noexcept { return max_; }
+
+    /// Set the most bytes the buffer may hold
+    void max_size(std::size_t n) noexcept { max_ = n; }
+
+    /// Returns the number of bytes the buffer holds without growing
+    std::size_t capacity() const noexcept
+    {
+        return static_cast<std::size_t>(end_ - begin_);
+    }
+
+    /// Returns the readable bytes
+    const_buffers_type data() const noexcept { return {in_, size()}; }
+
+    /// Returns the readable bytes
+    const_buffers_type cdata() const noexcept { return data(); }
+
+    /// Returns the readable bytes
+    mutable_buffers_type data() noexcept { return {in_, size()}; }
+
+    /** Returns `n` writable bytes after the readable bytes.
+
+        @throws std::length_error if the buffer would exceed its limit.
+    */
+    mutable_buffers_type prepare(std::size_t n)
+    {
+        if (n <= static_cast<std::size_t>(end_ - out_)) {
+            last_ = out_ + n;
+            return {out_, n};
+        }
+        auto const len = size();
+        if (n > max_ - len)
+            BOOST_THROW_EXCEPTION(std::length_error{"pooled_buffer overflow"});
+        if (n <= capacity() - len) {
+            // Move the readable bytes to the front
+            if (len > 0)
+                std::memmove(begin_, in_, len);
+            in_ = begin_;
+            out_ = in_ + len;
+            last_ = out_ + n;
+            return {out_, n};
+        }
+
+        std::size_t capacity;
+        auto const p = buffer_pool::local().allocate(len + n, capacity);
+        if (len > 0)
+            std::memcpy(p, in_, len);
+        release();
+        begin_ = in_ = p;
+        out_ = in_ + len;
+        last_ = out_ + n;
+        end_ = begin_ + capacity;
+        return {out_, n};
+    }
+
+    /// Move `n` bytes from the writable to the readable bytes
+    void commit(std::size_t n) noexcept
+    {
+        out_ += (std::min)(n, static_cast<std::size_t>(last_ - out_));
+    }
+
+    /** Remove `n` bytes from the front of the readable bytes.
+
+        Once no readable bytes remain the block goes back to the pool.
+    */
+    void consume(std::size_t n) noexcept
+    {
+        if (n >= size())
+            return release();
+        in_ += n;
+    }
+
+    /// Remove the readable bytes and return the block to the pool
+    void clear() noexcept { release(); }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::buffer_pool;
+using boost::beast::websocket::pooled_buffer;
+
+#endif    // !POOLED_BUFFER_HPP
@@ -0,0 +1,178 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef READ_SIZE_POLICY_HPP
+#define READ_SIZE_POLICY_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/websocket/error.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Chooses how many bytes to prepare for the first read of a message.
+
+    The policy keeps a moving average of the sizes of the messages a
+    stream received. It rises half way to a larger message at once, so a
+    stream of bulk messages reaches its size within a few reads, and
+    decays by a quarter towards each smaller message, so the size shrinks
+    back within a few dozen messages after a burst. The hint is the
+    average with a quarter of headroom, kept between @ref min_size and
+    @ref max_size.
+
+    Later reads of a message are sized by the stream from the frame
+    header, which by then tells how many bytes remain.
+*/
+class read_size_policy
+{
+    std::size_t average_ = initial_size;
+    std::size_t min_ = 256;
+    std::size_t max_ = 256 * 1024;
+
+  public:
+    /// The hint before the first message, as the fixed size used before
+    static std::size_t constexpr initial_size = 1536;
+
+    /// Returns the smallest hint
+    std::size_t min_size() const noexcept { return min_; }
+
+    /// Returns the largest hint
+    std::size_t max_size() const noexcept { return max_; }
+
+    /** Set the range of the hint.
+
+        @param min_size The smallest hint, at least 1.
+
+        @param max_size The largest hint, at least `min_size`.
+    */
+    void limits(std::size_t min_size, std::size_t max_size) noexcept
+    {
+        min_ = (std::max)(min_size, std::size_t(1));
+        max_ = (std::max)(max_size, min_);
+    }
+
+    /// Returns the average message size
+    std::size_t average() const noexcept { return average_; }
+
+    /// Record the size of a received message
+    void on_message(std::size_t size) noexcept
+    {
+        if (size > average_)
+            average_ += (size - average_ + 1) / 2;
+        else
+            average_ -= (average_ - size) / 4;
+    }
+
+    /// Returns the number of bytes to prepare for the next message
+    std::size_t hint() const noexcept
+    {
+        // Room for the frame header, in steps of 256 bytes
+        auto const n =
+            (average_ + average_ / 4 + 14 + 255) & ~std::size_t(255);
+        return (std::min)((std::max)(n, min_), max_);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+namespace detail {
+
+// Reads a complete message into a DynamicBuffer through the stream's
+// read_some on a mutable buffer, preparing the size the stream hints
+// from the policy, and records the size of the message.
+template <class Stream, class DynamicBuffer, class Handler>
+class adaptive_read_op
+{
+    Handler h_;
+    Stream* ws_;
+    DynamicBuffer* buffer_;
+    read_size_policy* policy_;
+    std::size_t bytes_ = 0;
+
+    // Returns the size to prepare, or zero if the buffer is full. The
+    // reads of a message together prepare about the size the policy
+    // expects, so that the buffer grows once.
+    std::size_t read_size() const
+    {
+        auto const expected = policy_->hint();
+        auto const initial =
+            bytes_ < expected ? expected - bytes_ : policy_->min_size();
+        return (std::min)(ws_->read_size_hint(initial),
+                          buffer_->max_size() - buffer_->size());
+    }
+
+  public:
+    using executor_type = net::associated_executor_t<
+        Handler, typename Stream::executor_type>;
+
+    using allocator_type = net::associated_allocator_t<Handler>;
+
+    template <class DeducedHandler>
+    adaptive_read_op(DeducedHandler&& h, Stream& ws, DynamicBuffer& buffer,
+                     read_size_policy& policy)
+        : h_(std::forward<DeducedHandler>(h))
+        , ws_(&ws)
+        , buffer_(&buffer)
+        , policy_(&policy)
+    {
+    }
+
+    executor_type get_executor() const noexcept
+    {
+        return net::get_associated_executor(h_, ws_->get_executor());
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return net::get_associated_allocator(h_);
+    }
+
+    // Called by the initiating function
+    void start()
+    {
+        auto const n = read_size();
+        if (n == 0)
+            return net::post(
+                ws_->get_executor(),
+                beast::bind_front_handler(
+                    std::move(h_), error_code(error::buffer_overflow),
+                    std::size_t(0)));
+        ws_->async_read_some(buffer_->prepare(n), std::move(*this));
+    }
+
+    void operator()(error_code ec, std::size_t bytes_transferred)
+    {
+        buffer_->commit(bytes_transferred);
+        bytes_ += bytes_transferred;
+        if (!ec) {
+            if (ws_->is_message_done()) {
+                policy_->on_message(bytes_);
+                return h_(ec, bytes_);
+            }
+            if (auto const n = read_size())
+                return ws_->async_read_some(buffer_->prepare(n),
+                                            std::move(*this));
+            ec = error::buffer_overflow;
+        }
+        h_(ec, bytes_);
+    }
+};
+
+}    // namespace detail
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::read_size_policy;
+
+#endif    // !READ_SIZE_POLICY_HPP
@@ -0,0 +1,316 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef RECEIVE_RING_HPP
+#define RECEIVE_RING_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/assert.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/string.hpp>
+#include <boost/beast/websocket/error.hpp>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A fixed block of memory which complete messages are received into.
+
+    Each message is stored contiguously, after a small header, in the
+    order it was received. The application is handed a @ref message
+    view of the payload instead of a copy, and the bytes stay where they
+    are until the view is given back with @ref release. Views may be
+    released in any order; the space of the oldest messages is reused as
+    soon as they and every message before them have been released.
+
+    A message which reaches the end of the block while space is free at
+    the front is moved there, which is the only time payload bytes are
+    copied, at most once per pass over the block. A message larger than
+    the free space, or than the block itself, fails with
+    @ref error::buffer_overflow.
+
+    The ring is meant to be owned by one session and used by one receive
+    at a time, see `websocket_stream_base::async_receive`.
+*/
+class receive_ring
+{
+    struct record
+    {
+        std::size_t size;
+        bool text;
+        bool released;
+    };
+
+    static std::size_t constexpr header = sizeof(record);
+
+    static std::size_t round_up(std::size_t n) noexcept
+    {
+        return (n + alignof(record) - 1) & ~(alignof(record) - 1);
+    }
+
+    std::unique_ptr<char[]> data_;
+    std::size_t capacity_;
+
+    // The message being received starts at head_, the oldest held
+    // message at tail_. Once the messages wrap to the front, those at
+    // the back end at wrap_.
+    std::size_t head_ = 0;
+    std::size_t tail_ = 0;
+    std::size_t wrap_;
+    std::size_t received_ = 0;
+    std::size_t held_ = 0;
+    bool wrapped_ = false;
+
+    record& at(std::size_t offset) noexcept
+    {
+        return *reinterpret_cast<record*>(data_.get() + offset);
+    }
+
+    // Move the message being received to the front of the block
+    void wrap(std::size_t used) noexcept
+    {
+        if (used > 0)
+            std::memmove(data_.get(), data_.get() + head_, used);
+        if (held_ == 0) {
+            tail_ = 0;
+        } else {
+            wrap_ = head_;
+            wrapped_ = true;
+        }
+        head_ = 0;
+    }
+
+  public:
+    /// A view of one received message, valid until it is released
+    class message
+    {
+        friend class receive_ring;
+
+        char const* data_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t offset_ = 0;
+        bool text_ = false;
+
+        message(char const* data, std::size_t size, std::size_t offset,
+                bool text) noexcept
+            : data_(data), size_(size), offset_(offset), text_(text)
+        {
+        }
+
+      public:
+        /// Constructor. The message is empty and is not held by a ring.
+        message() = default;
+
+        /// Returns a pointer to the payload
+        char const* data() const noexcept { return data_; }
+
+        /// Returns the size of the payload
+        std::size_t size() const noexcept { return size_; }
+
+        /// Returns `true` if the message was sent as text
+        bool text() const noexcept { return text_; }
+
+        /// Returns `true` if the message was sent as binary
+        bool binary() const noexcept { return !text_; }
+
+        /// Returns the payload as a string
+        string_view str() const noexcept { return {data_, size_}; }
+
+        /// Returns the payload as a buffer
+        net::const_buffer buffer() const noexcept { return {data_, size_}; }
+    };
+
+    /** Constructor.
+
+        @param capacity The size of the block. Messages and their headers
+        must fit in it together until they are released.
+    */
+    explicit receive_ring(std::size_t capacity)
+        : data_(new char[capacity & ~(alignof(record) - 1)])
+        , capacity_(capacity & ~(alignof(record) - 1))
+        , wrap_(capacity_)
+    {
+    }
+
+    receive_ring(receive_ring&&) = default;
+    receive_ring& operator=(receive_ring&&) = default;
+
+    /// Returns the size of the block
+    std::size_t capacity() const noexcept { return capacity_; }
+
+    /// Returns the number of messages not yet released
+    std::size_t held() const noexcept { return held_; }
+
+    /** Returns the free space where the message being received goes on.
+
+        This is used by the receive operation. At the start of a message
+        the larger of the free space at the back and at the front is
+        chosen.
+
+        @param ec Set to @ref error::buffer_overflow if no space is left.
+    */
+    net::mutable_buffer prepare(error_code& ec) noexcept
+    {
+        if (received_ == 0) {
+            if (held_ == 0)
+                head_ = tail_ = 0;
+            else if (!wrapped_ && capacity_ - head_ < tail_)
+                wrap(0);
+        }
+        auto const used = header + received_;
+        auto const limit = wrapped_ ? tail_ : capacity_;
+        if (head_ + used < limit)
+            return {data_.get() + head_ + used, limit - head_ - used};
+        auto const front = held_ == 0 ? capacity_ : tail_;
+        if (!wrapped_ && head_ > 0 && used < front) {
+            wrap(used);
+            return prepare(ec);
+        }
+        ec = error::buffer_overflow;
+        return {};
+    }
+
+    /// Add `n` bytes written to the last prepared space to the message
+    void commit(std::size_t n) noexcept { received_ += n; }
+
+    /** Complete the message being received and hold it.
+
+        @param text `true` if the message was sent as text.
+    */
+    message finish(bool text) noexcept
+    {
+        auto& r = at(head_);
+        r.size = received_;
+        r.text = text;
+        r.released = false;
+        message m(data_.get() + head_ + header, received_, head_, text);
+        head_ = round_up(head_ + header + received_);
+        received_ = 0;
+        ++held_;
+        return m;
+    }
+
+    /// Drop the bytes of the message being received
+    void discard() noexcept { received_ = 0; }
+
+    /** Give back a message.
+
+        The view, and every copy of it, must not be used afterwards.
+    */
+    void release(message const& m) noexcept
+    {
+        BOOST_ASSERT(m.data_ == data_.get() + m.offset_ + header);
+        auto& r = at(m.offset_);
+        BOOST_ASSERT(!r.released);
+        r.released = true;
+        while (held_ > 0 && at(tail_).released) {
+            tail_ = round_up(tail_ + header + at(tail_).size);
+            --held_;
+            if (wrapped_ && tail_ == wrap_) {
+                tail_ = 0;
+                wrap_ = capacity_;
+                wrapped_ = false;
+            }
+        }
+        if (held_ == 0)
+            tail_ = head_;
+    }
+};
+
+//------------------------------------------------------------------------------
+
+namespace detail {
+
+// Receives one message into a receive_ring through the stream's
+// read_some on a mutable buffer, continuing in the ring's free space
+// until the message is done.
+template <class Stream, class Handler>
+class receive_op
+{
+    Handler h_;
+    Stream* stream_;
+    receive_ring* ring_;
+
+  public:
+    using executor_type =
+        net::associated_executor_t<Handler, typename Stream::executor_type>;
+
+    template <class DeducedHandler>
+    receive_op(DeducedHandler&& h, Stream& stream, receive_ring& ring)
+        : h_(std::forward<DeducedHandler>(h)), stream_(&stream), ring_(&ring)
+    {
+    }
+
+    executor_type get_executor() const noexcept
+    {
+        return net::get_associated_executor(h_, stream_->get_executor());
+    }
+
+    Handler const& handler() const noexcept { return h_; }
+
+    // Called by the initiating function
+    void start()
+    {
+        error_code ec;
+        auto const b = ring_->prepare(ec);
+        if (ec)
+            return net::post(stream_->get_executor(),
+                             beast::bind_front_handler(
+                                 std::move(h_), ec, receive_ring::message{}));
+        stream_->async_read_some(b, std::move(*this));
+    }
+
+    void operator()(error_code ec, std::size_t bytes_transferred)
+    {
+        if (!ec) {
+            ring_->commit(bytes_transferred);
+            if (stream_->is_message_done()) {
+                auto const message = ring_->finish(stream_->got_text());
+                stream_->read_sizing().on_message(message.size());
+                return h_(ec, message);
+            }
+            auto const b = ring_->prepare(ec);
+            if (!ec)
+                return stream_->async_read_some(b, std::move(*this));
+        }
+        ring_->discard();
+        h_(ec, receive_ring::message{});
+    }
+};
+
+}    // namespace detail
+
+}    // namespace websocket
+}    // namespace beast
+
+namespace asio {
+
+template <class Stream, class Handler, class Allocator>
+struct associated_allocator<
+    beast::websocket::detail::receive_op<Stream, Handler>, Allocator>
+{
+    using type = typename associated_allocator<Handler, Allocator>::type;
+
+    static type get(
+        beast::websocket::detail::receive_op<Stream, Handler> const& op,
+        Allocator const& a = Allocator()) noexcept
+    {
+        return associated_allocator<Handler, Allocator>::get(op.handler(), a);
+    }
+};
+
+}    // namespace asio
+}    // namespace boost
+
+using boost::beast::websocket::receive_ring;
+
+#endif    // !RECEIVE_RING_HPP
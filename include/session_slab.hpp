@@ -0,0 +1,270 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef SESSION_SLAB_HPP
+#define SESSION_SLAB_HPP
+
+#include <boost/assert.hpp>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+template <class T>
+class session_slab;
+
+template <class T>
+class session_ptr;
+
+/** The base class of a session owned through @ref session_ptr.
+
+    The reference count is a plain integer. Copying or destroying a
+    handle therefore costs no atomic operation, which makes the handle
+    cheap to bind into every completion handler of a read and write loop:
+    @code
+    ws_.async_read(buffer_,
+        beast::bind_front_handler(&session::on_read, self()));
+    @endcode
+    In exchange all handles to a session must be used on one thread, such
+    as the thread of a shard of @ref sharded_server, whose io_context runs
+    every handler of the session.
+
+    @tparam Derived The session class, created with
+    `session_slab<Derived>::create`.
+*/
+template <class Derived>
+class slab_session
+{
+    template <class>
+    friend class session_ptr;
+
+    template <class>
+    friend class session_slab;
+
+    std::size_t refs_ = 0;
+    session_slab<Derived>* slab_ = nullptr;
+
+  protected:
+    slab_session() = default;
+    slab_session(slab_session const&) = delete;
+    slab_session& operator=(slab_session const&) = delete;
+    ~slab_session() = default;
+
+    /** Returns a handle to this session.
+
+        It must not be called from the constructor, as the session is
+        not owned by a handle until the constructor returns.
+    */
+    session_ptr<Derived> self() noexcept
+    {
+        BOOST_ASSERT(refs_ > 0);
+        return session_ptr<Derived>(static_cast<Derived*>(this));
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** An intrusive, single-threaded owning handle to a session.
+
+    The session is destroyed, and its slot returned to the slab it came
+    from, when the last handle goes away.
+*/
+template <class T>
+class session_ptr
+{
+    template <class>
+    friend class session_slab;
+
+    template <class>
+    friend class slab_session;
+
+    T* p_ = nullptr;
+
+    explicit session_ptr(T* p) noexcept : p_(p) { ++base(p_).refs_; }
+
+    static slab_session<T>& base(T* p) noexcept { return *p; }
+
+    void release() noexcept
+    {
+        if (p_ && --base(p_).refs_ == 0) {
+            auto const slab = base(p_).slab_;
+            p_->~T();
+            slab->deallocate(p_);
+        }
+    }
+
+  public:
+    using element_type = T;
+
+    /// Constructor. The handle is empty.
+    session_ptr() = default;
+
+    session_ptr(session_ptr const& other) noexcept : p_(other.p_)
+    {
+        if (p_)
+            ++base(p_).refs_;
+    }
+
+    session_ptr(session_ptr&& other) noexcept : p_(other.p_)
+    {
+        other.p_ = nullptr;
+    }
+
+    session_ptr& operator=(session_ptr other) noexcept
+    {
+        std::swap(p_, other.p_);
+        return *this;
+    }
+
+    ~session_ptr() { release(); }
+
+    /// Release the session, leaving the handle empty
+    void reset() noexcept
+    {
+        release();
+        p_ = nullptr;
+    }
+
+    T* get() const noexcept { return p_; }
+
+    T& operator*() const noexcept { return *p_; }
+
+    T* operator->() const noexcept { return p_; }
+
+    explicit operator bool() const noexcept { return p_ != nullptr; }
+
+    /// Returns the number of handles to the session
+    std::size_t use_count() const noexcept { return p_ ? base(p_).refs_ : 0; }
+};
+
+//------------------------------------------------------------------------------
+
+/** Storage for the sessions of one shard.
+
+    Sessions are constructed in fixed-size slots taken from chunks of
+    contiguous memory, so the sessions of a shard are packed together
+    and creating one after warm-up does not call the allocator. A freed
+    slot is reused by the next session. Chunks are kept until the slab
+    is destroyed.
+
+    A slab is not thread-safe. Create one per shard, on the thread which
+    runs the shard's io_context, and let it outlive that io_context, so
+    that handlers still holding sessions are destroyed first:
+    @code
+    std::vector<session_slab<session>> slabs(threads);
+    sharded_server server(threads,
+        [&slabs](tcp::socket socket, std::size_t shard) {
+            slabs[shard].create(std::move(socket))->run();
+        });
+    @endcode
+
+    @tparam T The session type, derived from `slab_session<T>`.
+*/
+template <class T>
+class session_slab
+{
+    union slot
+    {
+        slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::vector<slot*> chunks_;
+    slot* free_ = nullptr;
+    std::size_t chunk_size_;
+    std::size_t size_ = 0;
+
+    void grow()
+    {
+        auto const chunk = static_cast<slot*>(
+            ::operator new(chunk_size_ * sizeof(slot)));
+        chunks_.push_back(chunk);
+        for (std::size_t i = chunk_size_; i-- > 0;)
+            free_ = ::new (&chunk[i]) slot{free_};
+    }
+
+  public:
+    /** Constructor.
+
+        @param chunk_size The number of sessions in each chunk.
+    */
+    explicit session_slab(std::size_t chunk_size = 64)
+        : chunk_size_(chunk_size > 0 ? chunk_size : 1)
+    {
+    }
+
+    session_slab(session_slab&& other) noexcept
+        : chunks_(std::move(other.chunks_))
+        , free_(std::exchange(other.free_, nullptr))
+        , chunk_size_(other.chunk_size_)
+        , size_(std::exchange(other.size_, 0))
+    {
+        BOOST_ASSERT(size_ == 0);
+    }
+
+    session_slab(session_slab const&) = delete;
+    session_slab& operator=(session_slab const&) = delete;
+
+    /// Destructor. Every session must have been destroyed.
+    ~session_slab()
+    {
+        BOOST_ASSERT(size_ == 0);
+        for (auto const chunk : chunks_)
+            ::operator delete(chunk);
+    }
+
+    /// Construct a session in a free slot and return the first handle
+    template <class... Args>
+    session_ptr<T> create(Args&&... args)
+    {
+        static_assert(std::is_base_of<slab_session<T>, T>::value,
+                      "T must derive from slab_session<T>");
+        if (!free_)
+            grow();
+        auto const s = free_;
+        free_ = s->next;
+        T* p;
+        try {
+            p = ::new (&s->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            free_ = ::new (s) slot{free_};
+            throw;
+        }
+        static_cast<slab_session<T>&>(*p).slab_ = this;
+        ++size_;
+        return session_ptr<T>(p);
+    }
+
+    /// Return the slot of a destroyed session, called by @ref session_ptr
+    void deallocate(T* p) noexcept
+    {
+        BOOST_ASSERT(size_ > 0);
+        free_ = ::new (static_cast<void*>(p)) slot{free_};
+        --size_;
+    }
+
+    /// Returns the number of live sessions
+    std::size_t size() const noexcept { return size_; }
+
+    /// Returns the number of slots, live or free
+    std::size_t capacity() const noexcept
+    {
+        return chunks_.size() * chunk_size_;
+    }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::session_ptr;
+using boost::beast::websocket::session_slab;
+using boost::beast::websocket::slab_session;
+
+#endif    // !SESSION_SLAB_HPP
@@ -0,0 +1,265 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef SHARDED_SERVER_HPP
+#define SHARDED_SERVER_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/beast/core/error.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <sys/socket.h>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A server runtime with one `io_context` per core.
+
+    Running one `io_context` on many threads puts every socket in one
+    epoll set, lets the handlers of a session migrate between threads,
+    and makes each session pay for a strand. This runtime instead owns
+    one single-threaded `io_context` per shard, each run by its own
+    thread pinned to a core. Every shard listens on the same endpoint
+    with its own `SO_REUSEPORT` acceptor, so the kernel spreads incoming
+    connections over the shards.
+
+    An accepted socket belongs to the `io_context` of its shard. A
+    session built from it, such as a `plain_websocket_stream`, runs all
+    of its handlers on that shard's thread for its whole lifetime, so it
+    needs no strand.
+
+    Where `SO_REUSEPORT` is unavailable, the first shard listens alone
+    and hands the accepted sockets to the shards in turn.
+*/
+class sharded_server
+{
+  public:
+    /** Called on the thread of a shard with each socket it accepted.
+
+        The socket uses the `io_context` of the shard whose index is
+        passed as the second argument.
+    */
+    using accept_handler =
+        std::function<void(net::ip::tcp::socket, std::size_t)>;
+
+  private:
+#if defined(SO_REUSEPORT)
+    using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET,
+                                                           SO_REUSEPORT>;
+#endif
+
+    struct shard
+    {
+        net::io_context ioc{1};
+        net::ip::tcp::acceptor acceptor{ioc};
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<shard>> shards_;
+    accept_handler handler_;
+    std::size_t next_ = 0;
+
+    void do_accept(std::size_t index)
+    {
+        auto& s = *shards_[index];
+        if (s.acceptor.is_open())
+            return s.acceptor.async_accept(
+                [this, index](error_code ec, net::ip::tcp::socket socket) {
+                    on_accept(index, ec, std::move(socket));
+                });
+
+        // Only the first shard listens: accept into the next shard
+        auto const target = next_++ % shards_.size();
+        shards_[0]->acceptor.async_accept(
+            shards_[target]->ioc,
+            [this, target](error_code ec, net::ip::tcp::socket socket) {
+                if (ec)
+                    return on_accept(0, ec, std::move(socket));
+                net::post(shards_[target]->ioc,
+                          [this, target, socket = std::move(socket)]() mutable {
+                              handler_(std::move(socket), target);
+                          });
+                do_accept(0);
+            });
+    }
+
+    void on_accept(std::size_t index, error_code ec,
+                   net::ip::tcp::socket socket)
+    {
+        if (ec == net::error::operation_aborted)
+            return;
+        if (!ec)
+            handler_(std::move(socket), index);
+        do_accept(index);
+    }
+
+  public:
+    /** Constructor.
+
+        @param shards The number of shards, normally one per core.
+
+        @param handler Called with each accepted socket.
+    */
+    sharded_server(std::size_t shards, accept_handler handler)
+        : handler_(std::move(handler))
+    {
+        if (shards == 0)
+            shards = 1;
+        shards_.reserve(shards);
+        for (std::size_t i = 0; i < shards; ++i)
+            shards_.emplace_back(new shard);
+    }
+
+    /// Destructor. Stops the shards and waits for their threads.
+    ~sharded_server()
+    {
+        stop();
+        join();
+    }
+
+    sharded_server(sharded_server const&) = delete;
+    sharded_server& operator=(sharded_server const&) = delete;
+
+    /// Returns the number of cores, the default number of shards
+    static std::size_t hardware_shards() noexcept
+    {
+        auto const n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    /// Returns the number of shards
+    std::size_t size() const noexcept { return shards_.size(); }
+
+    /// Returns the `io_context` of a shard
+    net::io_context& context(std::size_t index) noexcept
+    {
+        return shards_[index]->ioc;
+    }
+
+    /// Returns `true` if every shard has its own listening socket
+    bool reuses_port() const noexcept
+    {
+        return shards_.size() == 1 || shards_.back()->acceptor.is_open();
+    }
+
+    /** Open the listening sockets.
+
+        Binding to port zero picks a free port, which every shard then
+        shares. Call this before @ref start.
+
+        @param ec Set to indicate what error occurred, if any.
+    */
+    void listen(net::ip::tcp::endpoint endpoint, error_code& ec)
+    {
+        bool reuse = shards_.size() > 1;
+        for (std::size_t i = 0; i < (reuse ? shards_.size() : 1); ++i) {
+            auto& acceptor = shards_[i]->acceptor;
+            acceptor.open(endpoint.protocol(), ec);
+            if (ec)
+                return;
+            acceptor.set_option(net::socket_base::reuse_address(true), ec);
+            if (ec)
+                return;
+            if (reuse) {
+#if defined(SO_REUSEPORT)
+                acceptor.set_option(reuse_port(true), ec);
+#else
+                ec = net::error::operation_not_supported;
+#endif
+                if (ec) {
+                    // Fall back to the first shard accepting for all
+                    reuse = false;
+                    for (std::size_t j = 1; j <= i; ++j)
+                        shards_[j]->acceptor.close(ec);
+                    ec = {};
+                    if (i > 0)
+                        return;
+                }
+            }
+            acceptor.bind(endpoint, ec);
+            if (ec)
+                return;
+            acceptor.listen(net::socket_base::max_listen_connections, ec);
+            if (ec)
+                return;
+            if (i == 0)
+                endpoint = acceptor.local_endpoint();
+        }
+    }
+
+    /// Returns the endpoint the shards listen on
+    net::ip::tcp::endpoint local_endpoint() const
+    {
+        return shards_[0]->acceptor.local_endpoint();
+    }
+
+    /** Start accepting, with one thread per shard.
+
+        @param pin If `true`, the thread of shard `i` is pinned to core
+        `i` modulo the number of cores, where the platform allows it.
+    */
+    void start(bool pin = true)
+    {
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            auto& s = *shards_[i];
+            s.ioc.restart();
+            net::post(s.ioc, [this, i] {
+                if (i == 0 || reuses_port())
+                    do_accept(i);
+            });
+            s.thread = std::thread([&s] {
+                // Keep running when there is nothing to accept
+                auto work = net::make_work_guard(s.ioc);
+                s.ioc.run();
+            });
+#if defined(__linux__)
+            if (pin) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(static_cast<int>(i % hardware_shards()), &set);
+                pthread_setaffinity_np(s.thread.native_handle(), sizeof(set),
+                                       &set);
+            }
+#else
+            (void)pin;
+#endif
+        }
+    }
+
+    /// Stop every shard. This may be called from any thread.
+    void stop()
+    {
+        for (auto& s : shards_)
+            s->ioc.stop();
+    }
+
+    /// Block until the threads of all shards have exited
+    void join()
+    {
+        for (auto& s : shards_)
+            if (s->thread.joinable())
+                s->thread.join();
+    }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::sharded_server;
+
+#endif    // !SHARDED_SERVER_HPP
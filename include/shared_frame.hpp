@@ -0,0 +1,265 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef SHARED_FRAME_HPP
+#define SHARED_FRAME_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/string.hpp>
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/throw_exception.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** The settings a server compresses its messages with.
+
+    With server_no_context_takeover each message is compressed starting
+    from an empty window, so two streams with equal settings produce the
+    same bytes for the same message.
+*/
+struct deflate_params
+{
+    /// The negotiated server_max_window_bits
+    int window_bits = 15;
+
+    /// The compression level, see `permessage_deflate::compLevel`
+    int level = 8;
+
+    /// The memory level, see `permessage_deflate::memLevel`
+    int mem_level = 4;
+
+    friend bool operator==(deflate_params const& a,
+                           deflate_params const& b) noexcept
+    {
+        return a.window_bits == b.window_bits && a.level == b.level &&
+               a.mem_level == b.mem_level;
+    }
+
+    friend bool operator!=(deflate_params const& a,
+                           deflate_params const& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+/// How a stream compresses the messages it sends
+struct send_compression
+{
+    /// `false` if the outcome of the negotiation is not known
+    bool known = false;
+
+    /// `true` if permessage-deflate was negotiated
+    bool enabled = false;
+
+    /// `true` if server_no_context_takeover was negotiated
+    bool no_context_takeover = false;
+
+    /// The settings used when compression is enabled
+    deflate_params params;
+};
+
+//------------------------------------------------------------------------------
+
+namespace detail {
+
+// Writes the header of a final, unmasked text or binary frame carrying
+// `n` payload bytes, and returns its size, at most 10 bytes.
+inline std::size_t encode_frame_header(unsigned char* header, bool binary,
+                                       bool compressed, std::uint64_t n)
+{
+    header[0] = 0x80 | (compressed ? 0x40 : 0) |    // FIN, RSV1
+                (binary ? 0x2 : 0x1);              // opcode
+    if (n < 126) {
+        header[1] = static_cast<unsigned char>(n);
+        return 2;
+    }
+    if (n <= 0xffff) {
+        header[1] = 126;
+        header[2] = static_cast<unsigned char>(n >> 8);
+        header[3] = static_cast<unsigned char>(n);
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i)
+        header[2 + i] = static_cast<unsigned char>(n >> (56 - 8 * i));
+    return 10;
+}
+
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+
+/** A message encoded once as a WebSocket frame, for sending to many streams.
+
+    Frames sent by a server are not masked, so when permessage-deflate is
+    not in use the bytes of a message are the same for every recipient.
+    This class frames a message once, as a single final text or binary
+    frame, into an immutable buffer held by reference count. Copies are
+    cheap and may be handed to streams running on other threads.
+
+    A frame may also be compressed once with @ref deflate, for the streams
+    which negotiated server_no_context_takeover with the same settings.
+
+    Send a frame with `websocket_stream_base::async_send`. A stream which
+    cannot use the encoded bytes, because it is a client or its
+    compression differs, sends the payload instead.
+*/
+class shared_frame
+{
+    struct impl_type
+    {
+        std::string data;
+        std::size_t header_size = 0;
+        bool binary = false;
+        bool compressed = false;
+        deflate_params params;
+
+        // The uncompressed frame, if this one is compressed
+        std::shared_ptr<impl_type const> message;
+    };
+
+    std::shared_ptr<impl_type const> impl_;
+
+    explicit shared_frame(std::shared_ptr<impl_type const> impl) noexcept
+        : impl_(std::move(impl))
+    {
+    }
+
+    // Build a final frame around `n` payload bytes written by `fill`
+    template <class Fill>
+    static std::shared_ptr<impl_type> encode(bool binary, bool compressed,
+                                             std::size_t n, Fill&& fill)
+    {
+        unsigned char header[max_header_size];
+        auto const header_size =
+            detail::encode_frame_header(header, binary, compressed, n);
+
+        auto impl = std::make_shared<impl_type>();
+        impl->data.resize(header_size + n);
+        std::memcpy(&impl->data[0], header, header_size);
+        if (n > 0)
+            fill(&impl->data[header_size]);
+        impl->header_size = header_size;
+        impl->binary = binary;
+        impl->compressed = compressed;
+        return impl;
+    }
+
+  public:
+    /// The largest frame header, in bytes
+    static std::size_t constexpr max_header_size = 10;
+
+    /// Construct an empty frame
+    shared_frame() = default;
+
+    /** Encode a message.
+
+        @param payload The message payload, which is copied.
+
+        @param binary `true` for a binary message, `false` for text.
+    */
+    shared_frame(net::const_buffer payload, bool binary)
+        : impl_(encode(binary, false, payload.size(), [&](char* out) {
+            std::memcpy(out, payload.data(), payload.size());
+        }))
+    {
+    }
+
+    /// Encode a text or binary message
+    shared_frame(string_view payload, bool binary)
+        : shared_frame(net::buffer(payload.data(), payload.size()), binary)
+    {
+    }
+
+    /** Compress the message for streams with the given settings.
+
+        The message is compressed from an empty window and flushed, as a
+        server with server_no_context_takeover does, and framed with the
+        RSV1 bit set. The returned frame shares the uncompressed message,
+        which remains available from @ref payload.
+
+        @throws system_error if the compressor fails.
+    */
+    shared_frame deflate(deflate_params const& params) const
+    {
+        auto const& m = impl_->message ? *impl_->message : *impl_;
+        auto const in = m.data.size() - m.header_size;
+
+        zlib::deflate_stream zo;
+        zo.reset(params.level, params.window_bits, params.mem_level,
+                 zlib::Strategy::normal);
+        std::string out(zo.upper_bound(in) + 16, '\0');
+        zlib::z_params zs;
+        zs.next_in = m.data.data() + m.header_size;
+        zs.avail_in = in;
+        zs.next_out = &out[0];
+        zs.avail_out = out.size();
+        error_code ec;
+        zo.write(zs, zlib::Flush::sync, ec);
+        if (ec || zs.avail_in != 0 || zs.avail_out == 0)
+            BOOST_THROW_EXCEPTION(system_error{
+                ec ? ec : make_error_code(zlib::error::need_buffers)});
+
+        // Remove the 00 00 ff ff flush marker, RFC 7692 section 7.2.1
+        auto const n = zs.total_out - 4;
+        auto impl = encode(m.binary, true, n, [&](char* p) {
+            std::memcpy(p, out.data(), n);
+        });
+        impl->params = params;
+        impl->message = impl_->message ? impl_->message : impl_;
+        return shared_frame(std::move(impl));
+    }
+
+    /// Returns `true` if the frame holds a message
+    explicit operator bool() const noexcept { return impl_ != nullptr; }
+
+    /// Returns `true` if the message is binary
+    bool binary() const noexcept { return impl_->binary; }
+
+    /// Returns `true` if the frame was made by @ref deflate
+    bool compressed() const noexcept { return impl_->compressed; }
+
+    /// Returns the settings of a compressed frame
+    deflate_params const& params() const noexcept { return impl_->params; }
+
+    /// Returns the encoded frame, header and payload
+    net::const_buffer frame() const noexcept
+    {
+        return net::buffer(impl_->data);
+    }
+
+    /// Returns the uncompressed message payload
+    net::const_buffer payload() const noexcept
+    {
+        auto const& m = impl_->message ? *impl_->message : *impl_;
+        return net::buffer(m.data) + m.header_size;
+    }
+
+    /// Returns the size of the uncompressed message payload
+    std::size_t payload_size() const noexcept
+    {
+        auto const& m = impl_->message ? *impl_->message : *impl_;
+        return m.data.size() - m.header_size;
+    }
+
+    /// Returns the number of copies sharing the encoded bytes
+    long use_count() const noexcept { return impl_.use_count(); }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::deflate_params;
+using boost::beast::websocket::send_compression;
+using boost::beast::websocket::shared_frame;
+
+#endif    // !SHARED_FRAME_HPP
@@ -0,0 +1,433 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef SPILL_BUFFER_HPP
+#define SPILL_BUFFER_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "pooled_buffer.hpp"
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A DynamicBuffer which moves a large message into a temporary file.
+
+    Messages up to @ref threshold bytes are held in one contiguous block
+    from the thread's @ref buffer_pool, as in @ref pooled_buffer. When
+    more bytes arrive than fit under the threshold, the buffer spills:
+    the bytes it holds are written to an unlinked temporary file, which
+    the new bytes were read into, and its block goes back to the pool.
+    From then on every `prepare` maps only the region of the file being
+    read into, and `commit` unmaps it again, so the pages of the message
+    leave the address space of the process as soon as they are received.
+    They are page cache, which the kernel writes back and reclaims under
+    pressure, rather than anonymous memory.
+
+    Once a message is complete, @ref data maps the whole file and
+    returns it as one contiguous buffer, the same as for a message held
+    in memory:
+    @code
+    spill_buffer buffer(1024 * 1024);
+    ws.read(buffer);
+    store(buffer.data().data(), buffer.size());
+    @endcode
+
+    Reading through `websocket_stream` sizes reads from the frame
+    header, so the tail of a message too large for the threshold goes
+    straight to the file. The file space of each read is reserved before
+    it is mapped, so a full disk is reported as an exception rather than
+    a bus error.
+
+    @note The file is created in `$TMPDIR`, or in `/tmp` when that is not
+    set, unless a directory is given.
+*/
+class spill_buffer
+{
+    // The bytes held in memory, before spilling
+    char* begin_ = nullptr;
+    char* in_ = nullptr;
+    char* out_ = nullptr;
+    char* last_ = nullptr;
+    char* end_ = nullptr;
+
+    // The file: the offsets of its readable bytes once spilled, the
+    // mapping of the region last prepared, and that of the whole file
+    int fd_ = -1;
+    bool spilled_ = false;
+    std::size_t file_in_ = 0;
+    std::size_t file_out_ = 0;
+    char* window_ = nullptr;
+    std::size_t window_size_ = 0;
+    char* prepared_data_ = nullptr;
+    std::size_t prepared_ = 0;
+    mutable char* view_ = nullptr;
+    mutable std::size_t view_size_ = 0;
+
+    std::size_t threshold_;
+    std::size_t max_ = (std::numeric_limits<std::size_t>::max)();
+    std::string directory_;
+
+    [[noreturn]] static void fail(char const* what)
+    {
+        BOOST_THROW_EXCEPTION(system::system_error(
+            system::error_code(errno, system::system_category()), what));
+    }
+
+    static std::size_t page_size() noexcept
+    {
+        static auto const size =
+            static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    static void unmap(char*& p, std::size_t& size) noexcept
+    {
+        if (p)
+            ::munmap(p, size);
+        p = nullptr;
+        size = 0;
+    }
+
+    // Map the whole file, if the mapping does not already cover it
+    char* view() const
+    {
+        if (file_out_ == 0)
+            return nullptr;
+        if (view_size_ < file_out_) {
+            unmap(view_, view_size_);
+            auto const v = ::mmap(nullptr, file_out_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, fd_, 0);
+            if (v == MAP_FAILED)
+                fail("spill_buffer: mmap");
+            view_ = static_cast<char*>(v);
+            view_size_ = file_out_;
+        }
+        return view_;
+    }
+
+    // Make room in memory for `n` bytes after the readable bytes
+    void reserve(std::size_t n)
+    {
+        auto const len = static_cast<std::size_t>(out_ - in_);
+        if (n <= static_cast<std::size_t>(end_ - out_))
+            return;
+        if (n <= static_cast<std::size_t>(end_ - begin_) - len) {
+            // Move the readable bytes to the front
+            if (len > 0)
+                std::memmove(begin_, in_, len);
+        } else {
+            std::size_t capacity;
+            auto const p = buffer_pool::local().allocate(
+                (std::min)((std::max)(len + n, 2 * len), threshold_),
+                capacity);
+            if (len > 0)
+                std::memcpy(p, in_, len);
+            release_memory();
+            begin_ = p;
+            end_ = begin_ + capacity;
+        }
+        in_ = begin_;
+        out_ = in_ + len;
+    }
+
+    // Create the unlinked temporary file
+    void create()
+    {
+        std::string path = directory_;
+        if (path.empty()) {
+            auto const tmp = std::getenv("TMPDIR");
+            path = tmp && *tmp ? tmp : "/tmp";
+        }
+        path += "/websocket-spill-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        fd_ = ::mkstemp(name.data());
+        if (fd_ < 0)
+            fail("spill_buffer: mkstemp");
+        ::unlink(name.data());
+    }
+
+    // Write `n` bytes to the file at `offset`
+    void write(std::size_t offset, char const* p, std::size_t n)
+    {
+        while (n > 0) {
+            auto const written =
+                ::pwrite(fd_, p, n, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                fail("spill_buffer: pwrite");
+            }
+            p += written;
+            n -= static_cast<std::size_t>(written);
+            offset += static_cast<std::size_t>(written);
+        }
+    }
+
+    // Reserve and map `n` bytes of the file at `offset`
+    net::mutable_buffer map(std::size_t offset, std::size_t n)
+    {
+        if (n == 0)
+            return {nullptr, 0};
+        auto const e = ::posix_fallocate(fd_, static_cast<off_t>(offset),
+                                         static_cast<off_t>(n));
+        if (e != 0) {
+            errno = e;
+            fail("spill_buffer: posix_fallocate");
+        }
+        auto const page = offset & ~(page_size() - 1);
+        auto const size = offset + n - page;
+        auto const p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd_, static_cast<off_t>(page));
+        if (p == MAP_FAILED)
+            fail("spill_buffer: mmap");
+        window_ = static_cast<char*>(p);
+        window_size_ = size;
+        prepared_data_ = window_ + (offset - page);
+        prepared_ = n;
+        return {prepared_data_, n};
+    }
+
+    void release_memory() noexcept
+    {
+        if (begin_)
+            buffer_pool::local().deallocate(
+                begin_, static_cast<std::size_t>(end_ - begin_));
+        begin_ = in_ = out_ = last_ = end_ = nullptr;
+    }
+
+    void release() noexcept
+    {
+        release_memory();
+        unmap(window_, window_size_);
+        unmap(view_, view_size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+        spilled_ = false;
+        file_in_ = file_out_ = prepared_ = 0;
+        prepared_data_ = nullptr;
+    }
+
+    void steal(spill_buffer& other) noexcept
+    {
+        begin_ = std::exchange(other.begin_, nullptr);
+        in_ = std::exchange(other.in_, nullptr);
+        out_ = std::exchange(other.out_, nullptr);
+        last_ = std::exchange(other.last_, nullptr);
+        end_ = std::exchange(other.end_, nullptr);
+        fd_ = std::exchange(other.fd_, -1);
+        spilled_ = std::exchange(other.spilled_, false);
+        file_in_ = std::exchange(other.file_in_, 0);
+        file_out_ = std::exchange(other.file_out_, 0);
+        window_ = std::exchange(other.window_, nullptr);
+        window_size_ = std::exchange(other.window_size_, 0);
+        prepared_data_ = std::exchange(other.prepared_data_, nullptr);
+        prepared_ = std::exchange(other.prepared_, 0);
+        view_ = std::exchange(other.view_, nullptr);
+        view_size_ = std::exchange(other.view_size_, 0);
+        threshold_ = other.threshold_;
+        max_ = other.max_;
+        directory_ = std::move(other.directory_);
+    }
+
+  public:
+    /// The ConstBufferSequence used to represent the readable bytes
+    using const_buffers_type = net::const_buffer;
+
+    /// The MutableBufferSequence used to represent the writable bytes
+    using mutable_buffers_type = net::mutable_buffer;
+
+    /** Constructor.
+
+        @param threshold The most bytes held in memory. A message which
+        grows larger is moved into a temporary file.
+
+        @param directory The directory of the temporary file.
+    */
+    explicit spill_buffer(std::size_t threshold = 1024 * 1024,
+                          std::string directory = {})
+        : threshold_(threshold), directory_(std::move(directory))
+    {
+    }
+
+    /// Move constructor. The other buffer is left empty.
+    spill_buffer(spill_buffer&& other) noexcept { steal(other); }
+
+    /// Move assignment. The other buffer is left empty.
+    spill_buffer& operator=(spill_buffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            steal(other);
+        }
+        return *this;
+    }
+
+    spill_buffer(spill_buffer const&) = delete;
+    spill_buffer& operator=(spill_buffer const&) = delete;
+
+    /// Destructor. The file, if any, is closed and its space freed.
+    ~spill_buffer() { release(); }
+
+    /// Returns the most bytes held in memory
+    std::size_t threshold() const noexcept { return threshold_; }
+
+    /// Returns `true` if the bytes are held in a temporary file
+    bool spilled() const noexcept { return spilled_; }
+
+    /// Returns the number of readable bytes
+    std::size_t size() const noexcept
+    {
+        if (spilled_)
+            return file_out_ - file_in_;
+        return static_cast<std::size_t>(out_ - in_);
+    }
+
+    /// Returns the most bytes the buffer may hold
+    std::size_t max_size() const noexcept { return max_; }
+
+    /// Set the most bytes the buffer may hold
+    void max_size(std::size_t n) noexcept { max_ = n; }
+
+    /// Returns the number of bytes the buffer holds without growing
+    std::size_t capacity() const noexcept
+    {
+        if (spilled_)
+            return size() + prepared_;
+        return static_cast<std::size_t>(end_ - begin_);
+    }
+
+    /** Returns the readable bytes.
+
+        After spilling, the first call following a `commit` maps the
+        whole file, which invalidates buffers returned before.
+
+        @throws system::system_error if the file cannot be mapped.
+    */
+    const_buffers_type data() const
+    {
+        if (spilled_)
+            return {view() + file_in_, size()};
+        return {in_, size()};
+    }
+
+    /// Returns the readable bytes, see @ref data
+    const_buffers_type cdata() const { return data(); }
+
+    /// Returns the readable bytes, see @ref data
+    mutable_buffers_type data()
+    {
+        if (spilled_)
+            return {view() + file_in_, size()};
+        return {in_, size()};
+    }
+
+    /** Returns `n` writable bytes after the readable bytes.
+
+        While the bytes are in memory, a request which would take the
+        buffer past the threshold is served from the file, with room
+        kept in memory: if fewer bytes arrive than were asked for, as
+        when a read is sized for a larger message than the one received,
+        `commit` copies them back and the buffer does not spill.
+
+        @throws std::length_error if the buffer would exceed its limit.
+
+        @throws system::system_error if the temporary file cannot be
+        created, written, extended or mapped.
+    */
+    mutable_buffers_type prepare(std::size_t n)
+    {
+        auto const len = size();
+        if (n > max_ - len)
+            BOOST_THROW_EXCEPTION(std::length_error{"spill_buffer overflow"});
+
+        unmap(window_, window_size_);
+        prepared_data_ = nullptr;
+        prepared_ = 0;
+        if (spilled_) {
+            unmap(view_, view_size_);
+            return map(file_out_, n);
+        }
+        if (len + n <= threshold_) {
+            reserve(n);
+            last_ = out_ + n;
+            return {out_, n};
+        }
+        reserve(threshold_ - len);
+        if (fd_ < 0)
+            create();
+        write(0, in_, len);
+        return map(len, n);
+    }
+
+    /// Move `n` bytes from the writable to the readable bytes
+    void commit(std::size_t n) noexcept
+    {
+        if (!prepared_data_) {
+            out_ += (std::min)(n, static_cast<std::size_t>(last_ - out_));
+            return;
+        }
+        n = (std::min)(n, prepared_);
+        if (spilled_) {
+            file_out_ += n;
+        } else if (size() + n <= threshold_) {
+            // The room was reserved by prepare
+            std::memcpy(out_, prepared_data_, n);
+            out_ += n;
+        } else {
+            // The bytes in memory were written to the file by prepare
+            file_in_ = 0;
+            file_out_ = size() + n;
+            release_memory();
+            spilled_ = true;
+        }
+        unmap(window_, window_size_);
+        prepared_data_ = nullptr;
+        prepared_ = 0;
+    }
+
+    /** Remove `n` bytes from the front of the readable bytes.
+
+        Once no readable bytes remain, the block goes back to the pool
+        and the file is closed.
+    */
+    void consume(std::size_t n) noexcept
+    {
+        if (n >= size())
+            return release();
+        if (spilled_)
+            file_in_ += n;
+        else
+            in_ += n;
+    }
+
+    /// Remove the readable bytes, releasing the block or file
+    void clear() noexcept { release(); }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::spill_buffer;
+
+#endif    // !SPILL_BUFFER_HPP
@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef SSL_CONTEXT_PROVIDER_HPP
+#define SSL_CONTEXT_PROVIDER_HPP
+
+#include <boost/asio/ssl/context.hpp>
+#include <boost/beast/core/error.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Holds the TLS context shared by the sessions of a server.
+
+    Building an `ssl::context` parses the certificate chain, the private
+    key and the DH parameters, which costs more than many handshakes. A
+    provider builds the context once with a loader function and hands
+    the same context to every @ref ssl_websocket_stream, which also lets
+    the sessions share OpenSSL's session cache.
+
+    The certificates are replaced with @ref reload, which builds a new
+    context with the loader and swaps it in. The new context is built
+    without holding any lock, so accepts carry on with the old one in
+    the meantime. Each stream takes its own reference on the OpenSSL
+    context it was created from, so connections made before a reload
+    keep the certificates they were made with.
+
+    Asio frees the verify and password callbacks of an `ssl::context`
+    when it is destroyed. If the loader installs a verify callback, keep
+    the pointer returned by @ref get for the lifetime of the stream.
+
+    All member functions may be called from any thread.
+*/
+class ssl_context_provider
+{
+  public:
+    /// The function which loads certificates and keys into a new context
+    using loader_type = std::function<void(net::ssl::context&)>;
+
+  private:
+    net::ssl::context::method method_;
+    loader_type loader_;
+    mutable std::mutex mutex_;
+    std::shared_ptr<net::ssl::context> context_;
+    std::size_t generation_ = 0;
+
+    std::shared_ptr<net::ssl::context> load() const
+    {
+        auto ctx = std::make_shared<net::ssl::context>(method_);
+        loader_(*ctx);
+        return ctx;
+    }
+
+  public:
+    /** Constructor.
+
+        The first context is loaded before the constructor returns.
+
+        @param method The TLS method of the contexts.
+
+        @param loader Called with each new context, to load its
+        certificates and keys. It reports failures by throwing, as the
+        member functions of `ssl::context` do.
+
+        @throws system_error if the loader fails.
+    */
+    ssl_context_provider(net::ssl::context::method method, loader_type loader)
+        : method_(method), loader_(std::move(loader)), context_(load())
+    {
+    }
+
+    ssl_context_provider(ssl_context_provider const&) = delete;
+    ssl_context_provider& operator=(ssl_context_provider const&) = delete;
+
+    /** Returns the current context.
+
+        Construct a `beast::ssl_stream` from the returned context for
+        each accepted connection.
+    */
+    std::shared_ptr<net::ssl::context> get() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return context_;
+    }
+
+    /** Load the certificates again and replace the current context.
+
+        If the loader fails, the current context is kept.
+
+        @throws system_error if the loader fails.
+    */
+    void reload()
+    {
+        auto ctx = load();
+        std::lock_guard<std::mutex> lock(mutex_);
+        context_.swap(ctx);
+        ++generation_;
+    }
+
+    /** Load the certificates again and replace the current context.
+
+        If the loader fails, the current context is kept.
+
+        @param ec Set to indicate what error occurred, if any.
+    */
+    void reload(error_code& ec)
+    {
+        try {
+            reload();
+            ec = {};
+        } catch (system_error const& e) {
+            ec = e.code();
+        }
+    }
+
+    /// Returns the number of successful reloads
+    std::size_t generation() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return generation_;
+    }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+using boost::beast::websocket::ssl_context_provider;
+
+#endif    // !SSL_CONTEXT_PROVIDER_HPP
@@ -0,0 +1,459 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef UTF8_KERNEL_HPP
+#define UTF8_KERNEL_HPP
+
+// Beast validates the payload of text messages with the utf8_checker of
+// <boost/beast/websocket/detail/utf8_checker.ipp>, which falls back to
+// checking one code point at a time after the first non-ASCII byte. As
+// with mask_kernel.hpp, when this header is seen first that file is
+// kept out and the members of utf8_checker are defined below in terms
+// of the kernels of this header. Define WEBSOCKET_STREAM_SCALAR_UTF8 to
+// keep Beast's checker.
+//
+// All translation units of a program must agree: include this header,
+// or a header of this library, before any Beast WebSocket header.
+#if !defined(WEBSOCKET_STREAM_SCALAR_UTF8) &&                         \
+    !defined(BOOST_BEAST_SEPARATE_COMPILATION) &&                      \
+    !defined(BOOST_BEAST_WEBSOCKET_DETAIL_UTF8_CHECKER_IPP)
+#define WEBSOCKET_STREAM_REPLACES_UTF8 1
+#define BOOST_BEAST_WEBSOCKET_DETAIL_UTF8_CHECKER_IPP
+#else
+#define WEBSOCKET_STREAM_REPLACES_UTF8 0
+#endif
+
+#include <boost/beast/websocket/detail/utf8_checker.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define WEBSOCKET_STREAM_X86_UTF8 1
+#include <immintrin.h>
+#else
+#define WEBSOCKET_STREAM_X86_UTF8 0
+#endif
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Kernels which validate UTF-8 text.
+
+    Each kernel returns `true` if the `n` bytes at `p` are a sequence of
+    complete, well-formed UTF-8 code points: no overlong forms, no
+    surrogates and nothing above U+10FFFF. The best kernel for the CPU is
+    chosen at run time, once.
+*/
+namespace utf8_kernel {
+
+/// The instruction sets a kernel may use
+enum class isa
+{
+    scalar,
+    avx2
+};
+
+/// The type of a kernel
+using function_type = bool (*)(unsigned char const* p, std::size_t n);
+
+/** Returns the length of the code point starting with a byte.
+
+    Zero is returned for a byte which cannot start a code point: a
+    continuation byte, a lead byte of an overlong two byte form, or one
+    of a code point above U+10FFFF.
+*/
+inline std::size_t sequence_length(unsigned char c) noexcept
+{
+    if (c < 0x80)
+        return 1;
+    if (c < 0xc2)
+        return 0;
+    if (c < 0xe0)
+        return 2;
+    if (c < 0xf0)
+        return 3;
+    if (c < 0xf5)
+        return 4;
+    return 0;
+}
+
+/** Returns `true` if `have` bytes can begin a well-formed code point.
+
+    When `have` is the length of the code point, this checks it whole.
+    The ranges of the second byte are those of table 3-7 of the Unicode
+    standard.
+*/
+inline bool sequence_valid(unsigned char const* p, std::size_t have) noexcept
+{
+    auto const len = sequence_length(p[0]);
+    if (len == 0 || have > len)
+        return false;
+    if (have < 2)
+        return true;
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xbf;
+    switch (p[0]) {
+    case 0xe0:
+        lo = 0xa0;    // overlong
+        break;
+    case 0xed:
+        hi = 0x9f;    // surrogate
+        break;
+    case 0xf0:
+        lo = 0x90;    // overlong
+        break;
+    case 0xf4:
+        hi = 0x8f;    // above U+10FFFF
+        break;
+    }
+    if (p[1] < lo || p[1] > hi)
+        return false;
+    for (std::size_t i = 2; i < have; ++i)
+        if ((p[i] & 0xc0) != 0x80)
+            return false;
+    return true;
+}
+
+/// Validate eight ASCII bytes at a time, and other code points one by one
+inline bool validate_scalar(unsigned char const* p, std::size_t n)
+{
+    while (n > 0) {
+        if (n >= 8) {
+            std::uint64_t v;
+            std::memcpy(&v, p, 8);
+            if ((v & 0x8080808080808080ULL) == 0) {
+                p += 8;
+                n -= 8;
+                continue;
+            }
+        }
+        if (*p < 0x80) {
+            ++p;
+            --n;
+            continue;
+        }
+        auto const len = sequence_length(*p);
+        if (len == 0 || len > n || !sequence_valid(p, len))
+            return false;
+        p += len;
+        n -= len;
+    }
+    return true;
+}
+
+#if WEBSOCKET_STREAM_X86_UTF8
+namespace detail {
+
+// The lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less
+// Than One Instruction Per Byte" (2021). Three 16-entry tables indexed
+// by the high and low nibble of each byte's predecessor and the high
+// nibble of the byte itself classify every pair of adjacent bytes; an
+// error is a class present in all three. The third and fourth bytes of
+// a code point are checked by where the last three lead bytes were.
+
+enum : unsigned char
+{
+    too_short = 1 << 0,         // lead byte not followed by continuation
+    too_long = 1 << 1,          // continuation after ASCII
+    overlong_3 = 1 << 2,        // E0 80..9F
+    too_large = 1 << 3,         // F4 90..BF, F5..FF
+    surrogate = 1 << 4,         // ED A0..BF
+    overlong_2 = 1 << 5,        // C0..C1
+    too_large_1000 = 1 << 6,    // F5..FF 80..8F
+    overlong_4 = 1 << 6,        // F0 80..8F
+    two_conts = 1 << 7,         // continuation after continuation
+    carry = too_short | too_long | two_conts
+};
+
+__attribute__((target("avx2"))) inline __m256i table(
+    unsigned char t0, unsigned char t1, unsigned char t2, unsigned char t3,
+    unsigned char t4, unsigned char t5, unsigned char t6, unsigned char t7,
+    unsigned char t8, unsigned char t9, unsigned char t10, unsigned char t11,
+    unsigned char t12, unsigned char t13, unsigned char t14,
+    unsigned char t15)
+{
+    // Each 128-bit lane looks up its own copy
+    return _mm256_setr_epi8(
+        static_cast<char>(t0), static_cast<char>(t1), static_cast<char>(t2),
+        static_cast<char>(t3), static_cast<char>(t4), static_cast<char>(t5),
+        static_cast<char>(t6), static_cast<char>(t7), static_cast<char>(t8),
+        static_cast<char>(t9), static_cast<char>(t10),
+        static_cast<char>(t11), static_cast<char>(t12),
+        static_cast<char>(t13), static_cast<char>(t14),
+        static_cast<char>(t15), static_cast<char>(t0), static_cast<char>(t1),
+        static_cast<char>(t2), static_cast<char>(t3), static_cast<char>(t4),
+        static_cast<char>(t5), static_cast<char>(t6), static_cast<char>(t7),
+        static_cast<char>(t8), static_cast<char>(t9),
+        static_cast<char>(t10), static_cast<char>(t11),
+        static_cast<char>(t12), static_cast<char>(t13),
+        static_cast<char>(t14), static_cast<char>(t15));
+}
+
+__attribute__((target("avx2"))) inline __m256i high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+// The bytes of `input` shifted in by N from the end of `prev`
+template <int N>
+__attribute__((target("avx2"))) inline __m256i shift_in(__m256i input,
+                                                        __m256i prev)
+{
+    return _mm256_alignr_epi8(
+        input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+class avx2_state
+{
+    // Zeroed without an AVX instruction, in code built for any target
+    __m256i error_{};
+    __m256i prev_{};
+    __m256i prev_incomplete_{};
+
+  public:
+    __attribute__((target("avx2"))) void check(__m256i input)
+    {
+        if (_mm256_movemask_epi8(input) == 0) {
+            // ASCII, only an unfinished code point before it is wrong
+            error_ = _mm256_or_si256(error_, prev_incomplete_);
+            prev_incomplete_ = _mm256_setzero_si256();
+            prev_ = input;
+            return;
+        }
+
+        auto const prev1 = shift_in<1>(input, prev_);
+        auto const byte_1_high = _mm256_shuffle_epi8(
+            table(too_long, too_long, too_long, too_long, too_long, too_long,
+                  too_long, too_long, two_conts, two_conts, two_conts,
+                  two_conts, too_short | overlong_2, too_short,
+                  too_short | overlong_3 | surrogate,
+                  too_short | too_large | too_large_1000 | overlong_4),
+            high_nibbles(prev1));
+        auto const byte_1_low = _mm256_shuffle_epi8(
+            table(carry | overlong_3 | overlong_2 | overlong_4,
+                  carry | overlong_2, carry, carry, carry | too_large,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000 | surrogate,
+                  carry | too_large | too_large_1000,
+                  carry | too_large | too_large_1000),
+            _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)));
+        auto const byte_2_high = _mm256_shuffle_epi8(
+            table(too_short, too_short, too_short, too_short, too_short,
+                  too_short, too_short, too_short,
+                  too_long | overlong_2 | two_conts | overlong_3 |
+                      too_large_1000 | overlong_4,
+                  too_long | overlong_2 | two_conts | overlong_3 | too_large,
+                  too_long | overlong_2 | two_conts | surrogate | too_large,
+                  too_long | overlong_2 | two_conts | surrogate | too_large,
+                  too_short, too_short, too_short, too_short),
+            high_nibbles(input));
+        auto const special = _mm256_and_si256(
+            _mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        // A third or fourth byte must be a continuation
+        auto const prev2 = shift_in<2>(input, prev_);
+        auto const prev3 = shift_in<3>(input, prev_);
+        auto const third = _mm256_subs_epu8(
+            prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+        auto const fourth = _mm256_subs_epu8(
+            prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+        auto const must_be_continuation =
+            _mm256_and_si256(_mm256_or_si256(third, fourth),
+                             _mm256_set1_epi8(static_cast<char>(0x80)));
+        error_ = _mm256_or_si256(
+            error_, _mm256_xor_si256(must_be_continuation, special));
+
+        // Lead bytes among the last three which need more bytes
+        prev_incomplete_ = _mm256_subs_epu8(
+            input,
+            _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                             -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                             -1, -1, -1, -1, -1, static_cast<char>(0xf0 - 1),
+                             static_cast<char>(0xe0 - 1),
+                             static_cast<char>(0xc0 - 1)));
+        prev_ = input;
+    }
+
+    __attribute__((target("avx2"))) bool finish()
+    {
+        auto const error = _mm256_or_si256(error_, prev_incomplete_);
+        return _mm256_testz_si256(error, error) != 0;
+    }
+};
+
+}    // namespace detail
+
+/// Validate thirty-two bytes at a time, skipping ASCII sixty-four at a time
+__attribute__((target("avx2"))) inline bool
+validate_avx2(unsigned char const* p, std::size_t n)
+{
+    detail::avx2_state state;
+    while (n >= 64) {
+        auto const a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+        auto const b =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) == 0) {
+            state.check(b);
+        } else {
+            state.check(a);
+            state.check(b);
+        }
+        p += 64;
+        n -= 64;
+    }
+    while (n >= 32) {
+        state.check(
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)));
+        p += 32;
+        n -= 32;
+    }
+    if (n > 0) {
+        // The last bytes, padded with ASCII
+        alignas(32) unsigned char last[32] = {};
+        std::memcpy(last, p, n);
+        state.check(_mm256_load_si256(reinterpret_cast<__m256i const*>(last)));
+    }
+    return state.finish();
+}
+#endif
+
+/// Returns `true` if the CPU can run kernels of the instruction set
+inline bool supported(isa set) noexcept
+{
+    switch (set) {
+    case isa::scalar:
+        return true;
+#if WEBSOCKET_STREAM_X86_UTF8
+    case isa::avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+/** Returns the kernel for an instruction set.
+
+    The instruction set must be @ref supported.
+*/
+inline function_type get(isa set) noexcept
+{
+#if WEBSOCKET_STREAM_X86_UTF8
+    if (set == isa::avx2)
+        return &validate_avx2;
+#endif
+    (void)set;
+    return &validate_scalar;
+}
+
+/// Returns the widest instruction set the CPU supports
+inline isa best() noexcept
+{
+    return supported(isa::avx2) ? isa::avx2 : isa::scalar;
+}
+
+/// Returns the kernel used to validate text, chosen on the first call
+inline function_type active() noexcept
+{
+    static function_type const f = get(best());
+    return f;
+}
+
+/// Validate complete UTF-8 text with the active kernel
+inline bool validate(unsigned char const* p, std::size_t n)
+{
+    // Short text is not worth a vector block
+    if (n < 64)
+        return validate_scalar(p, n);
+    return active()(p, n);
+}
+
+}    // namespace utf8_kernel
+
+#if WEBSOCKET_STREAM_REPLACES_UTF8 && !BOOST_BEAST_DOXYGEN
+namespace detail {
+
+// The definitions Beast's utf8_checker.ipp would provide. A code point
+// split across calls is kept in cp_, with need_ bytes still to come,
+// and checked as far as it goes, to fail fast as Autobahn expects.
+
+inline void utf8_checker::reset()
+{
+    need_ = 0;
+    p_ = cp_;
+}
+
+inline bool utf8_checker::finish()
+{
+    auto const success = need_ == 0;
+    reset();
+    return success;
+}
+
+inline bool utf8_checker::write(std::uint8_t const* in, std::size_t size)
+{
+    auto const end = in + size;
+
+    // Finish an incomplete code point
+    if (need_ > 0) {
+        auto n = (std::min)(size, need_);
+        need_ -= n;
+        while (n--)
+            *p_++ = *in++;
+        if (!utf8_kernel::sequence_valid(
+                cp_, static_cast<std::size_t>(p_ - cp_)))
+            return false;
+        if (need_ > 0)
+            return true;
+        p_ = cp_;
+    }
+
+    // Hold back the last code point, which may be incomplete
+    auto last = end;
+    for (int i = 0; i < 4 && last > in; ++i)
+        if ((*--last & 0xc0) != 0x80)
+            break;
+    if (!utf8_kernel::validate(in, static_cast<std::size_t>(last - in)))
+        return false;
+
+    auto const n = static_cast<std::size_t>(end - last);
+    if (n == 0)
+        return true;
+    auto const len = utf8_kernel::sequence_length(*last);
+    if (len == 0 || n > len || !utf8_kernel::sequence_valid(last, n))
+        return false;
+    if (n < len) {
+        need_ = len - n;
+        while (last < end)
+            *p_++ = *last++;
+    }
+    return true;
+}
+
+inline bool check_utf8(char const* p, std::size_t n)
+{
+    utf8_checker c;
+    if (!c.write(reinterpret_cast<std::uint8_t const*>(p), n))
+        return false;
+    return c.finish();
+}
+
+}    // namespace detail
+#endif
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !UTF8_KERNEL_HPP
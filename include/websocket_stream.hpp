@@ -5,24 +5,413 @@
 #ifndef WEBSOCKET_STREAM_HPP
 #define WEBSOCKET_STREAM_HPP
 
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/beast/core/buffers_cat.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coalescing_stream.hpp"
+#include "gather_write.hpp"
 #include "websocket_stream_base.hpp"
 
 namespace boost {
 namespace beast {
 namespace websocket {
 
-template <class Derived>
+template <class Derived, class Executor = net::any_io_executor>
 class websocket_stream
-    : public websocket_stream_base
+    : public basic_websocket_stream_base<Executor>
 #if !BOOST_BEAST_DOXYGEN
     , private stream_base
 #endif
 {
+    using base_type = basic_websocket_stream_base<Executor>;
+
+    // A message queued by async_send, owned or pre-encoded
+    struct send_entry
+    {
+        std::string message;
+        shared_frame frame;
+        bool binary;
+        typename base_type::io_handler_type handler;
+    };
+
+    std::vector<send_entry> send_queue_;
+    std::size_t send_head_ = 0;
+    std::size_t send_bytes_ = 0;
+    bool sending_ = false;
+    bool corked_ = false;
+
+    // The header of a gathered write, see gather_writes
+    unsigned char gather_header_[shared_frame::max_header_size];
+    bool gather_writes_ = false;
+
+    // The timer which checks for traffic, see hibernate_after. The
+    // pending wait shares it, and finds `self` null once the stream is
+    // gone.
+    struct idle_state
+    {
+        net::basic_waitable_timer<std::chrono::steady_clock,
+                                  net::wait_traits<std::chrono::steady_clock>,
+                                  Executor>
+            timer;
+        std::chrono::steady_clock::duration idle;
+        websocket_stream* self;
+
+        idle_state(Executor const& ex, websocket_stream* stream)
+            : timer(ex), idle(), self(stream)
+        {
+        }
+    };
+
+    std::shared_ptr<idle_state> idle_;
+    std::size_t idle_operations_ = 0;
+    std::size_t hibernated_operations_ = 0;
+    bool hibernated_ = false;
+
+    // The state of async_read_many: the caller waiting for a batch, and
+    // the result of a read which outlived the call that started it
+    struct read_many_state
+    {
+        receive_ring* ring = nullptr;
+        std::vector<receive_ring::message>* batch = nullptr;
+        std::size_t first = 0;
+        typename base_type::io_handler_type handler;
+        receive_ring::message carried;
+        bool has_carried = false;
+        bool reading = false;
+        error_code ec;
+    };
+
+    read_many_state read_many_;
+
+    // The state of async_write_batch: the messages, the frames of a
+    // gathered write, and the caller
+    struct write_batch_state
+    {
+        span<batch_message const> messages;
+        std::size_t next = 0;
+        std::size_t bytes = 0;
+        bool binary = false;
+        bool writing = false;
+        detail::batch_encoder encoder;
+        typename base_type::io_handler_type handler;
+    };
+
+    write_batch_state write_batch_;
+
+    // Payloads of a gathered batch up to this size are copied next to
+    // their headers rather than given a buffer of their own
+    static std::size_t constexpr batch_copy_limit = 1024;
+
     // Access the derived class, this is part of
     // the Curiously Recurring Template Pattern idiom.
     Derived& derived() { return static_cast<Derived&>(*this); }
 
+    // Start an operation on the underlying stream, with the handler
+    // memory of this stream bound to the final completion handler.
+    template <class Signature, class CompletionToken, class Operation>
+    auto initiate(CompletionToken& token, Operation&& op)
+    {
+        return net::async_initiate<CompletionToken, Signature>(
+            [this](auto handler, auto op) {
+                op(derived().ws(),
+                   bind_handler_memory(std::move(handler),
+                                       this->handler_memory_));
+            },
+            token, std::forward<Operation>(op));
+    }
+
+    // Write the message at the head of the queue. While more messages
+    // wait behind it the transport is corked, so the whole run of
+    // messages goes out in as few writes as possible.
+    void do_send()
+    {
+        if (!corked_ && send_queue_.size() - send_head_ > 1) {
+            corked_ = true;
+            coalescing_layer().cork();
+        }
+        if (sending_ || send_head_ == send_queue_.size())
+            return;
+        sending_ = true;
+        auto& e = send_queue_[send_head_];
+        if (e.frame && can_send_frame(e.frame)) {
+            // The bytes are final, write them under the WebSocket layer
+            return net::async_write(
+                coalescing_layer(), e.frame.frame(),
+                bind_handler_memory(
+                    [this](error_code ec, std::size_t) {
+                        auto const& frame = send_queue_[send_head_].frame;
+                        on_send(ec, ec ? 0 : frame.payload_size());
+                    },
+                    this->handler_memory_));
+        }
+        derived().ws().binary(e.binary);
+        derived().ws().async_write(
+            e.frame ? e.frame.payload() : net::buffer(e.message),
+            bind_handler_memory(
+                [this](error_code ec, std::size_t n) { on_send(ec, n); },
+                this->handler_memory_));
+    }
+
+    // True if frames may be written under the WebSocket layer: this is
+    // a server, whose frames are unmasked, and no close has begun
+    bool can_write_frames()
+    {
+        return this->role_ == role_type::server && derived().ws().is_open();
+    }
+
+    // True if the encoded bytes of a shared_frame may be written as they
+    // are: the frame is unmasked, compressed as this stream would compress
+    // it, and no close has begun.
+    bool can_send_frame(shared_frame const& frame)
+    {
+        if (!can_write_frames())
+            return false;
+        auto const c = this->compression();
+        if (!c.known)
+            return false;
+        if (!frame.compressed())
+            return !c.enabled;
+        return c.enabled && c.no_context_takeover &&
+               frame.params() == c.params;
+    }
+
+    void on_send(error_code ec, std::size_t bytes_transferred)
+    {
+        auto e = std::move(send_queue_[send_head_]);
+        if (++send_head_ == send_queue_.size()) {
+            send_queue_.clear();
+            send_head_ = 0;
+        } else if (send_head_ >= 64 && send_head_ * 2 >= send_queue_.size()) {
+            // Reclaim the front of the queue under sustained load
+            send_queue_.erase(send_queue_.begin(),
+                              send_queue_.begin() + send_head_);
+            send_head_ = 0;
+        }
+        send_bytes_ -= e.frame ? e.frame.payload_size() : e.message.size();
+        sending_ = false;
+        if (corked_ && send_head_ == send_queue_.size()) {
+            corked_ = false;
+            coalescing_layer().uncork();
+        }
+        do_send();
+        std::move(e.handler)(ec, bytes_transferred);
+    }
+
+    // True if a file may follow its frame header with sendfile: the
+    // frame is written unmasked and uncompressed straight to a socket
+    bool can_sendfile()
+    {
+#if defined(__linux__)
+        if (this->use_ssl_ || !can_write_frames())
+            return false;
+        auto const c = this->compression();
+        return c.known && !c.enabled;
+#else
+        return false;
+#endif
+    }
+
+    // Write a message. When gathered writes are on and the frame is
+    // unmasked and uncompressed, its header and the caller's buffers go
+    // under the WebSocket layer in one write, instead of being copied
+    // through the write buffer.
+    template <class ConstBufferSequence, class Handler>
+    void start_write(ConstBufferSequence const& buffers, Handler&& handler)
+    {
+        auto const c = this->compression();
+        if (!gather_writes_ || !can_write_frames() || !c.known || c.enabled)
+            return derived().ws().async_write(buffers,
+                                              std::forward<Handler>(handler));
+        auto const n = detail::encode_frame_header(
+            gather_header_, derived().ws().binary(), false,
+            buffer_bytes(buffers));
+        auto& layer = coalescing_layer();
+        layer.async_write_some(
+            buffers_cat(net::const_buffer(gather_header_, n), buffers),
+            detail::gather_write_handler<
+                typename std::decay<Handler>::type,
+                typename std::decay_t<decltype(layer)>::executor_type>(
+                std::forward<Handler>(handler), layer.get_executor(), n));
+    }
+
+    // Write the batch as one gathered write of frames encoded here
+    void write_batch_gathered()
+    {
+        auto& s = write_batch_;
+        s.encoder.encode(s.messages, this->use_ssl_ ? std::size_t(-1)
+                                                    : batch_copy_limit);
+        auto const& buffers = s.encoder.buffers();
+        coalescing_layer().async_write_some(
+            span<net::const_buffer const>(buffers.data(), buffers.size()),
+            bind_handler_memory(
+                [this](error_code ec, std::size_t n) {
+                    auto& s = write_batch_;
+                    auto const headers = s.encoder.header_size();
+                    if (ec)
+                        s.bytes = n > headers ? n - headers : 0;
+                    on_write_batch(ec);
+                },
+                this->handler_memory_));
+    }
+
+    // Write the next message of a batch through the WebSocket layer
+    void write_batch_next()
+    {
+        auto& s = write_batch_;
+        auto const& m = s.messages.data()[s.next];
+        derived().ws().binary(m.binary);
+        derived().ws().async_write(
+            m.payload,
+            bind_handler_memory(
+                [this](error_code ec, std::size_t n) {
+                    auto& s = write_batch_;
+                    s.bytes += n;
+                    if (!ec && ++s.next < s.messages.size())
+                        return write_batch_next();
+                    derived().ws().binary(s.binary);
+                    coalescing_layer().uncork();
+                    on_write_batch(ec);
+                },
+                this->handler_memory_));
+    }
+
+    void on_write_batch(error_code ec)
+    {
+        auto& s = write_batch_;
+        s.writing = false;
+        s.messages = {};
+        auto handler = std::move(s.handler);
+        std::move(handler)(ec, s.bytes);
+    }
+
+    // Read a message, sizing the reads with the read size policy
+    template <class DynamicBuffer, class Handler>
+    void start_read(DynamicBuffer& buffer, Handler&& handler)
+    {
+        detail::adaptive_read_op<typename Derived::stream_type, DynamicBuffer,
+                                 typename std::decay<Handler>::type>(
+            std::forward<Handler>(handler), derived().ws(), buffer,
+            this->read_size_)
+            .start();
+    }
+
+    // Receive the next message of a batch. The handler keeps the stream
+    // alive, as the read may go on after the caller was answered.
+    void read_next()
+    {
+        read_many_.reading = true;
+        auto h = [this, self = derived().weak_from_this().lock()](
+                     error_code ec, receive_ring::message message) {
+            on_read_many(ec, message);
+        };
+        detail::receive_op<websocket_stream, decltype(h)>(
+            std::move(h), *this, *read_many_.ring)
+            .start();
+    }
+
+    void on_read_many(error_code ec, receive_ring::message message)
+    {
+        auto& s = read_many_;
+        s.reading = false;
+        if (!s.handler) {
+            // The caller was answered, the next call takes the result
+            if (ec) {
+                s.ec = ec;
+            } else {
+                s.carried = message;
+                s.has_carried = true;
+            }
+            return;
+        }
+        if (!ec) {
+            s.batch->push_back(message);
+            return read_next();
+        }
+        if (s.batch->size() > s.first) {
+            // Deliver the messages first
+            s.ec = ec;
+            ec = {};
+        }
+        auto h = std::move(s.handler);
+        auto const n = s.batch->size() - s.first;
+        s.batch = nullptr;
+        std::move(h)(ec, n);
+    }
+
+    // Called by the coalescing layer as a read goes to the transport.
+    // The bytes at hand are used up, so a batch which holds messages is
+    // complete; its handler is posted, as this runs inside the read.
+    static void on_transport_read(void* context)
+    {
+        auto& self = *static_cast<websocket_stream*>(context);
+        auto& s = self.read_many_;
+        if (!s.handler || s.batch->size() == s.first)
+            return;
+        auto const n = s.batch->size() - s.first;
+        s.batch = nullptr;
+        net::post(self.derived().get_executor(),
+                  beast::bind_front_handler(std::move(s.handler),
+                                            error_code{}, n));
+    }
+
+    void start_idle_timer()
+    {
+        auto& state = *idle_;
+        state.timer.expires_after(state.idle);
+        state.timer.async_wait([state = idle_](error_code ec) {
+            if (!ec && state->self)
+                state->self->on_idle_timer();
+        });
+    }
+
+    void on_idle_timer()
+    {
+        auto const n = coalescing_layer().operation_count();
+        if (n == idle_operations_ && !hibernating())
+            hibernate();
+        idle_operations_ = n;
+        start_idle_timer();
+    }
+
+    void stop_idle_timer()
+    {
+        if (!idle_)
+            return;
+        idle_->self = nullptr;
+        idle_->timer.cancel();
+        idle_.reset();
+    }
+
+  protected:
+    // Route the control frames of the underlying stream through this
+    // stream, called once by the derived constructor. The callback holds
+    // only a pointer, which std::function stores without allocating.
+    void attach_control_frames()
+    {
+        derived().ws().control_callback(
+            [this](frame_type kind, string_view payload) {
+                this->on_control_frame(kind, payload);
+            });
+    }
+
   public:
+    using typename base_type::executor_type;
+    using typename base_type::handler_type;
+    using typename base_type::io_handler_type;
+    using typename base_type::lowest_layer_type;
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) || BOOST_BEAST_DOXYGEN
+    template <class T>
+    using awaitable = typename base_type::template awaitable<T>;
+#endif
+
+    ~websocket_stream() { stop_idle_timer(); }
+
     //--------------------------------------------------------------------------
 
     virtual executor_type get_executor() noexcept override
@@ -35,7 +424,13 @@ class websocket_stream
         return beast::get_lowest_layer(derived().ws());
     }
 
-    auto& next_layer() noexcept { return derived().ws().next_layer(); }
+    auto& next_layer() noexcept
+    {
+        return derived().ws().next_layer().next_layer();
+    }
+
+    /// Returns the layer which coalesces writes, see @ref coalescing_stream
+    auto& coalescing_layer() noexcept { return derived().ws().next_layer(); }
 
     virtual bool is_open() noexcept override
     {
@@ -62,12 +457,16 @@ class websocket_stream
         return const_cast<close_reason&>(derived().ws().reason());
     }
 
-    virtual std::size_t read_size_hint(
-        std::size_t initial_size = +tcp_frame_size) override
+    virtual std::size_t read_size_hint(std::size_t initial_size) override
     {
         return derived().ws().read_size_hint(initial_size);
     }
 
+    std::size_t read_size_hint()
+    {
+        return derived().ws().read_size_hint(this->read_size_.hint());
+    }
+
     template <class DynamicBuffer
 #if !BOOST_BEAST_DOXYGEN
               ,
@@ -136,12 +535,12 @@ class websocket_stream
     virtual void control_callback(
         std::function<void(frame_type, string_view)> cb) override
     {
-        return derived().ws().control_callback(cb);
+        this->observe_control_frames(std::move(cb));
     }
 
     virtual void control_callback() override
     {
-        return derived().ws().control_callback();
+        this->control_observer_ = control_observer();
     }
 
     virtual void read_message_max(std::size_t amount) override
@@ -169,6 +568,10 @@ class websocket_stream
         return derived().ws().write_buffer_bytes();
     }
 
+    virtual void gather_writes(bool value) override { gather_writes_ = value; }
+
+    virtual bool gather_writes() override { return gather_writes_; }
+
     virtual void text(bool value) override
     {
         return derived().ws().text(value);
@@ -178,24 +581,28 @@ class websocket_stream
 
     virtual void handshake(string_view host, string_view target) override
     {
+        this->role_ = role_type::client;
         return derived().ws().handshake(host, target);
     }
 
     virtual void handshake(response_type& res, string_view host,
                            string_view target) override
     {
+        this->role_ = role_type::client;
         return derived().ws().handshake(res, host, target);
     }
 
     virtual void handshake(string_view host, string_view target,
                            error_code& ec) override
     {
+        this->role_ = role_type::client;
         return derived().ws().handshake(host, target, ec);
     }
 
     virtual void handshake(response_type& res, string_view host,
                            string_view target, error_code& ec) override
     {
+        this->role_ = role_type::client;
         return derived().ws().handshake(res, host, target, ec);
     }
 
@@ -206,7 +613,11 @@ class websocket_stream
                     HandshakeHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_handshake(host, target, handler);
+        this->role_ = role_type::client;
+        return initiate<void(error_code)>(
+            handler, [host, target](auto& ws, auto h) {
+                ws.async_handshake(host, target, std::move(h));
+            });
     }
 
     template <BOOST_BEAST_ASYNC_TPARAM1 HandshakeHandler =
@@ -216,7 +627,11 @@ class websocket_stream
                     HandshakeHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_handshake(res, host, target, handler);
+        this->role_ = role_type::client;
+        return initiate<void(error_code)>(
+            handler, [&res, host, target](auto& ws, auto h) {
+                ws.async_handshake(res, host, target, std::move(h));
+            });
     }
 
     virtual void accept() override { return derived().ws().accept(); }
@@ -253,6 +668,7 @@ class websocket_stream
     template <class Body, class Allocator>
     void accept(http::request<Body, http::basic_fields<Allocator>> const& req)
     {
+        this->negotiate_compression(req);
         return derived().ws().accept(req);
     }
 
@@ -260,6 +676,7 @@ class websocket_stream
     void accept(http::request<Body, http::basic_fields<Allocator>> const& req,
                 error_code& ec)
     {
+        this->negotiate_compression(req);
         return derived().ws().accept(req, ec);
     }
 
@@ -269,7 +686,15 @@ class websocket_stream
     async_accept(AcceptHandler&& handler =
                      net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_accept(handler);
+        return initiate<void(error_code)>(
+            handler, [](auto& ws, auto h) {
+                ws.async_accept(std::move(h));
+            });
+    }
+
+    virtual void async_accept(handler_type handler) override
+    {
+        return derived().ws().async_accept(std::move(handler));
     }
 
     template <class ConstBufferSequence,
@@ -287,7 +712,10 @@ class websocket_stream
 #endif
     )
     {
-        return derived().ws().async_accept(buffers, handler);
+        return initiate<void(error_code)>(
+            handler, [buffers](auto& ws, auto h) {
+                ws.async_accept(buffers, std::move(h));
+            });
     }
 
     template <class Body, class Allocator,
@@ -298,7 +726,18 @@ class websocket_stream
                  AcceptHandler&& handler =
                      net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_accept(req, handler);
+        this->negotiate_compression(req);
+        return initiate<void(error_code)>(
+            handler, [&req](auto& ws, auto h) {
+                ws.async_accept(req, std::move(h));
+            });
+    }
+
+    virtual void async_accept(http::request<http::string_body> const& req,
+                              handler_type handler) override
+    {
+        this->negotiate_compression(req);
+        return derived().ws().async_accept(req, std::move(handler));
     }
 
     virtual void close(close_reason const& cr) override
@@ -318,16 +757,27 @@ class websocket_stream
                 CloseHandler&& handler =
                     net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_close(cr, handler);
+        return initiate<void(error_code)>(
+            handler, [cr](auto& ws, auto h) {
+                ws.async_close(cr, std::move(h));
+            });
+    }
+
+    virtual void async_close(close_reason const& cr,
+                             handler_type handler) override
+    {
+        return derived().ws().async_close(cr, std::move(handler));
     }
 
     virtual void ping(ping_data const& payload) override
     {
+        this->pings_.on_ping(payload);
         return derived().ws().ping(payload);
     }
 
     virtual void ping(ping_data const& payload, error_code& ec) override
     {
+        this->pings_.on_ping(payload);
         return derived().ws().ping(payload, ec);
     }
 
@@ -338,7 +788,18 @@ class websocket_stream
                WriteHandler&& handler =
                    net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_ping(payload, handler);
+        return initiate<void(error_code)>(
+            handler, [this, payload](auto& ws, auto h) {
+                this->pings_.on_ping(payload);
+                ws.async_ping(payload, std::move(h));
+            });
+    }
+
+    virtual void async_ping(ping_data const& payload,
+                            handler_type handler) override
+    {
+        this->pings_.on_ping(payload);
+        return derived().ws().async_ping(payload, std::move(handler));
     }
 
     virtual void pong(ping_data const& payload) override
@@ -358,7 +819,10 @@ class websocket_stream
                WriteHandler&& handler =
                    net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_pong(payload, handler);
+        return initiate<void(error_code)>(
+            handler, [payload](auto& ws, auto h) {
+                ws.async_pong(payload, std::move(h));
+            });
     }
 
     template <class DynamicBuffer>
@@ -381,7 +845,64 @@ class websocket_stream
                ReadHandler&& handler =
                    net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_read(buffer, handler);
+        return initiate<void(error_code, std::size_t)>(
+            handler, [this, &buffer](auto&, auto h) {
+                start_read(buffer, std::move(h));
+            });
+    }
+
+    virtual void async_read(flat_buffer& buffer,
+                            io_handler_type handler) override
+    {
+        start_read(buffer, std::move(handler));
+    }
+
+    virtual void async_read(pooled_buffer& buffer,
+                            io_handler_type handler) override
+    {
+        start_read(buffer, std::move(handler));
+    }
+
+    virtual void async_read(spill_buffer& buffer,
+                            io_handler_type handler) override
+    {
+        start_read(buffer, std::move(handler));
+    }
+
+    //--------------------------------------------------------------------------
+
+    using base_type::async_read_many;
+
+    virtual void async_read_many(receive_ring& ring,
+                                 std::vector<receive_ring::message>& batch,
+                                 io_handler_type handler) override
+    {
+        auto& s = read_many_;
+        BOOST_ASSERT(!s.handler);
+        BOOST_ASSERT(!s.ring || s.ring == &ring);
+        if (!s.ring) {
+            auto& layer = coalescing_layer();
+            layer.read_hook(&on_transport_read, this);
+            // Batches are cut where the bytes at hand run out, so have
+            // more than a read of websocket::stream at hand
+            if (layer.read_ahead() == 0)
+                layer.read_ahead(64 * 1024);
+        }
+        s.ring = &ring;
+        s.batch = &batch;
+        s.first = batch.size();
+        if (s.has_carried) {
+            batch.push_back(s.carried);
+            s.has_carried = false;
+        }
+        if (s.ec)
+            return net::post(derived().get_executor(),
+                             beast::bind_front_handler(
+                                 std::move(handler), std::exchange(s.ec, {}),
+                                 std::size_t(0)));
+        s.handler = std::move(handler);
+        if (!s.reading)
+            read_next();
     }
 
     //--------------------------------------------------------------------------
@@ -407,7 +928,17 @@ class websocket_stream
                     ReadHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_read_some(buffer, limit, handler);
+        return initiate<void(error_code, std::size_t)>(
+            handler, [&buffer, limit](auto& ws, auto h) {
+                ws.async_read_some(buffer, limit, std::move(h));
+            });
+    }
+
+    virtual void async_read_some(flat_buffer& buffer, std::size_t limit,
+                                 io_handler_type handler) override
+    {
+        return derived().ws().async_read_some(buffer, limit,
+                                              std::move(handler));
     }
 
     //--------------------------------------------------------------------------
@@ -432,7 +963,16 @@ class websocket_stream
                     ReadHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_read_some(buffers, handler);
+        return initiate<void(error_code, std::size_t)>(
+            handler, [buffers](auto& ws, auto h) {
+                ws.async_read_some(buffers, std::move(h));
+            });
+    }
+
+    virtual void async_read_some(net::mutable_buffer const& buffers,
+                                 io_handler_type handler) override
+    {
+        return derived().ws().async_read_some(buffers, std::move(handler));
     }
 
     template <class ConstBufferSequence>
@@ -455,7 +995,16 @@ class websocket_stream
                 WriteHandler&& handler =
                     net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_write(buffers, handler);
+        return initiate<void(error_code, std::size_t)>(
+            handler, [this, buffers](auto&, auto h) {
+                start_write(buffers, std::move(h));
+            });
+    }
+
+    virtual void async_write(net::const_buffer const& buffers,
+                             io_handler_type handler) override
+    {
+        start_write(buffers, std::move(handler));
     }
 
     template <class ConstBufferSequence>
@@ -479,18 +1028,242 @@ class websocket_stream
                      WriteHandler&& handler =
                          net::default_completion_token_t<executor_type>{})
     {
-        return derived().ws().async_write_some(fin, buffers, handler);
+        return initiate<void(error_code, std::size_t)>(
+            handler, [fin, buffers](auto& ws, auto h) {
+                ws.async_write_some(fin, buffers, std::move(h));
+            });
+    }
+
+    virtual void async_write_some(bool fin, net::const_buffer const& buffers,
+                                  io_handler_type handler) override
+    {
+        return derived().ws().async_write_some(fin, buffers,
+                                               std::move(handler));
+    }
+
+    //--------------------------------------------------------------------------
+
+    using base_type::async_write_file;
+
+    virtual void async_write_file(int fd, bool close_fd, std::uint64_t offset,
+                                  std::size_t length,
+                                  io_handler_type handler) override
+    {
+        detail::file_source file(fd, close_fd);
+        error_code ec;
+        if (length == base_type::rest_of_file)
+            length = detail::file_rest(fd, offset, ec);
+        detail::write_file_op<typename Derived::stream_type, io_handler_type>(
+            std::move(handler), derived().ws(), std::move(file), offset,
+            length, can_sendfile())
+            .start(ec);
+    }
+
+    //--------------------------------------------------------------------------
+
+    using base_type::async_write_batch;
+
+    virtual void async_write_batch(span<batch_message const> messages,
+                                   io_handler_type handler) override
+    {
+        auto& s = write_batch_;
+        BOOST_ASSERT(!s.writing);
+        if (messages.empty())
+            return net::post(derived().get_executor(),
+                             beast::bind_front_handler(std::move(handler),
+                                                       error_code{},
+                                                       std::size_t(0)));
+        s.messages = messages;
+        s.next = 0;
+        s.bytes = 0;
+        s.writing = true;
+        s.handler = std::move(handler);
+        auto const c = this->compression();
+        if (can_write_frames() && c.known && !c.enabled) {
+            for (auto const& m : messages)
+                s.bytes += m.payload.size();
+            return write_batch_gathered();
+        }
+        // Masked or compressed frames are left to the WebSocket layer,
+        // with the transport corked so that they are written together
+        s.binary = derived().ws().binary();
+        coalescing_layer().cork();
+        write_batch_next();
+    }
+
+    //--------------------------------------------------------------------------
+
+    using base_type::async_send;
+
+    virtual void async_send(std::string message,
+                            io_handler_type handler) override
+    {
+        send_bytes_ += message.size();
+        send_queue_.push_back({std::move(message), shared_frame{},
+                               derived().ws().binary(), std::move(handler)});
+        do_send();
+    }
+
+    virtual void async_send(shared_frame frame,
+                            io_handler_type handler) override
+    {
+        send_bytes_ += frame.payload_size();
+        auto const binary = frame.binary();
+        send_queue_.push_back(
+            {std::string{}, std::move(frame), binary, std::move(handler)});
+        do_send();
+    }
+
+    virtual std::size_t send_queue_depth() const noexcept override
+    {
+        return send_queue_.size() - send_head_;
+    }
+
+    virtual std::size_t send_queue_bytes() const noexcept override
+    {
+        return send_bytes_;
+    }
+
+    //--------------------------------------------------------------------------
+
+    virtual void hibernate_after(
+        std::chrono::steady_clock::duration idle) override
+    {
+        if (idle <= std::chrono::steady_clock::duration::zero())
+            return stop_idle_timer();
+        if (!idle_) {
+            idle_ = std::make_shared<idle_state>(derived().get_executor(),
+                                                 this);
+            idle_->idle = idle;
+            idle_operations_ = coalescing_layer().operation_count();
+            return start_idle_timer();
+        }
+        // Takes effect when the current period ends
+        idle_->idle = idle;
+    }
+
+    virtual void hibernate() override
+    {
+        coalescing_layer().shrink_to_fit();
+        if (send_head_ == send_queue_.size()) {
+            std::vector<send_entry>().swap(send_queue_);
+            send_head_ = 0;
+        }
+        if (!write_batch_.writing)
+            write_batch_.encoder.shrink_to_fit();
+        this->handler_memory_.shrink_to_fit();
+        hibernated_ = true;
+        hibernated_operations_ = coalescing_layer().operation_count();
+    }
+
+    virtual bool hibernating() override
+    {
+        return hibernated_ &&
+               hibernated_operations_ == coalescing_layer().operation_count();
+    }
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) || BOOST_BEAST_DOXYGEN
+    //--------------------------------------------------------------------------
+
+    awaitable<void> co_accept()
+    {
+        return async_accept(net::use_awaitable_t<executor_type>{});
+    }
+
+    awaitable<void> co_accept(error_code& ec)
+    {
+        return async_accept(
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class Body, class Allocator>
+    awaitable<void> co_accept(
+        http::request<Body, http::basic_fields<Allocator>> const& req)
+    {
+        return async_accept(req, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class Body, class Allocator>
+    awaitable<void> co_accept(
+        http::request<Body, http::basic_fields<Allocator>> const& req,
+        error_code& ec)
+    {
+        return async_accept(
+            req,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    awaitable<void> co_close(close_reason const& cr)
+    {
+        return async_close(cr, net::use_awaitable_t<executor_type>{});
     }
+
+    awaitable<void> co_close(close_reason const& cr, error_code& ec)
+    {
+        return async_close(
+            cr,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    awaitable<void> co_ping(ping_data const& payload)
+    {
+        return async_ping(payload, net::use_awaitable_t<executor_type>{});
+    }
+
+    awaitable<void> co_ping(ping_data const& payload, error_code& ec)
+    {
+        return async_ping(
+            payload,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class DynamicBuffer>
+    awaitable<std::size_t> co_read(DynamicBuffer& buffer)
+    {
+        return async_read(buffer, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class DynamicBuffer>
+    awaitable<std::size_t> co_read(DynamicBuffer& buffer, error_code& ec)
+    {
+        return async_read(
+            buffer,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    template <class ConstBufferSequence>
+    awaitable<std::size_t> co_write(ConstBufferSequence const& buffers)
+    {
+        return async_write(buffers, net::use_awaitable_t<executor_type>{});
+    }
+
+    template <class ConstBufferSequence>
+    awaitable<std::size_t> co_write(ConstBufferSequence const& buffers,
+                                    error_code& ec)
+    {
+        return async_write(
+            buffers,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+#endif
 };
 
 //------------------------------------------------------------------------------
 
 // Handles a plain WebSocket connection
-class plain_websocket_stream
-    : public websocket_stream<plain_websocket_stream>
-    , public std::enable_shared_from_this<plain_websocket_stream>
+template <class Executor = net::any_io_executor>
+class basic_plain_websocket_stream
+    : public websocket_stream<basic_plain_websocket_stream<Executor>, Executor>
+    , public std::enable_shared_from_this<
+          basic_plain_websocket_stream<Executor>>
 {
-    websocket::stream<beast::tcp_stream> ws_;
+  public:
+    using next_layer_type = beast::basic_stream<net::ip::tcp, Executor>;
+
+    using stream_type = websocket::stream<coalescing_stream<next_layer_type>>;
+
+  private:
+    stream_type ws_;
 
   public:
     // Create the plain_websocket_stream
@@ -500,24 +1273,35 @@ class plain_websocket_stream
     //    use_ssl_ = false;
     //}
     template <class... Args>
-    explicit plain_websocket_stream(Args&&... args)
+    explicit basic_plain_websocket_stream(Args&&... args)
         : ws_(std::forward<Args>(args)...)
     {
-        use_ssl_ = false;
+        this->use_ssl_ = false;
+        this->attach_control_frames();
     }
 
     // Called by the base class
-    websocket::stream<beast::tcp_stream>& ws() { return ws_; }
+    stream_type& ws() { return ws_; }
 };
 
+using plain_websocket_stream = basic_plain_websocket_stream<>;
+
 //------------------------------------------------------------------------------
 
 // Handles an SSL WebSocket connection
-class ssl_websocket_stream
-    : public websocket_stream<ssl_websocket_stream>
-    , public std::enable_shared_from_this<ssl_websocket_stream>
+template <class Executor = net::any_io_executor>
+class basic_ssl_websocket_stream
+    : public websocket_stream<basic_ssl_websocket_stream<Executor>, Executor>
+    , public std::enable_shared_from_this<basic_ssl_websocket_stream<Executor>>
 {
-    websocket::stream<beast::ssl_stream<beast::tcp_stream>> ws_;
+  public:
+    using next_layer_type =
+        beast::ssl_stream<beast::basic_stream<net::ip::tcp, Executor>>;
+
+    using stream_type = websocket::stream<coalescing_stream<next_layer_type>>;
+
+  private:
+    stream_type ws_;
 
   public:
     // Create the ssl_websocket_stream
@@ -528,19 +1312,19 @@ class ssl_websocket_stream
     //    use_ssl_ = true;
     //}
     template <class... Args>
-    explicit ssl_websocket_stream(Args&&... args)
+    explicit basic_ssl_websocket_stream(Args&&... args)
         : ws_(std::forward<Args>(args)...)
     {
-        use_ssl_ = true;
+        this->use_ssl_ = true;
+        this->attach_control_frames();
     }
 
     // Called by the base class
-    websocket::stream<beast::ssl_stream<beast::tcp_stream>>& ws()
-    {
-        return ws_;
-    }
+    stream_type& ws() { return ws_; }
 };
 
+using ssl_websocket_stream = basic_ssl_websocket_stream<>;
+
 }    // namespace websocket
 }    // namespace beast
 }    // namespace boost
@@ -5,44 +5,166 @@
 #ifndef WEBSOCKET_STREAM_BASE_HPP
 #define WEBSOCKET_STREAM_BASE_HPP
 
-#if 1
+// Define WEBSOCKET_STREAM_USE_TS_EXECUTOR to make the polymorphic
+// Networking TS executor the default, as in earlier versions. It must
+// be defined before any Asio header is included.
+#if defined(WEBSOCKET_STREAM_USE_TS_EXECUTOR)
 #ifndef BOOST_ASIO_USE_TS_EXECUTOR_AS_DEFAULT
 #define BOOST_ASIO_USE_TS_EXECUTOR_AS_DEFAULT
 #endif
 #include <boost/asio/executor.hpp>
-#else
+#endif
+// Must be seen before any Beast WebSocket header, see mask_kernel.hpp
+#include "mask_kernel.hpp"
+#include "utf8_kernel.hpp"
+#include "mask_prng.hpp"
 #include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/redirect_error.hpp>
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#include <utility>    // used but not included by awaitable.hpp in 1.74
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #endif
+#include <boost/beast/core/flat_buffer.hpp>
 #include <boost/beast/core/tcp_stream.hpp>
+#include <boost/beast/http/string_body.hpp>
 #include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket/detail/pmd_extension.hpp>
 #include <boost/beast/websocket/option.hpp>
 #include <boost/beast/websocket/rfc6455.hpp>
 #include <boost/beast/websocket/stream.hpp>
 #include <boost/beast/websocket/stream_base.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "control_observer.hpp"
+#include "file_message.hpp"
+#include "pooled_buffer.hpp"
+#include "read_size_policy.hpp"
+#include "receive_ring.hpp"
+#include "shared_frame.hpp"
+#include "spill_buffer.hpp"
+#include "websocket_stream_handler.hpp"
+#include "websocket_stream_memory.hpp"
+#include "write_batch.hpp"
 
 namespace boost {
 namespace beast {
 namespace websocket {
 
-class websocket_stream_base
+/** The interface shared by the plain and SSL WebSocket streams.
+
+    @tparam Executor The executor type of the underlying `basic_stream`,
+    used to dispatch completion handlers. The default, `net::any_io_executor`,
+    matches `beast::tcp_stream`. A concrete type such as
+    `net::strand<net::io_context::executor_type>` is never copied into a
+    polymorphic wrapper, so dispatching handlers does not allocate. Handlers
+    passed to the type-erased operations must then have no associated
+    executor, or one convertible to `Executor`.
+
+    Operations started through the stream allocate their state from a
+    @ref handler_memory owned by the stream, unless the completion handler
+    has an associated allocator of its own. Once a session has warmed up,
+    a read followed by a write makes no call to the global allocator.
+*/
+template <class Executor = net::any_io_executor>
+class basic_websocket_stream_base
 {
-    static std::size_t constexpr tcp_frame_size = 1536;
-
   protected:
     bool use_ssl_;
 
-  public:
-    using lowest_layer_type = tcp_stream;
+    // Set to client by the handshake functions. Only a server may send
+    // the unmasked bytes of a shared_frame.
+    role_type role_ = role_type::server;
 
-#if 1
-    using executor_type = net::executor;
-#else
-    using executor_type = net::any_io_executor;
+    // The compression of sent messages, recorded by the accept functions
+    // which are given the client's request.
+    send_compression compression_;
+
+    // Serves the state of every asynchronous operation started through
+    // this stream whose handler has no allocator of its own.
+    handler_memory handler_memory_;
+
+    // Sizes the first read of each message from the recent messages
+    read_size_policy read_size_;
+
+    // Called on each control frame, see observe_control_frames
+    control_observer control_observer_;
+
+    // Times the pings sent by this stream
+    ping_tracker pings_;
+
+#if !BOOST_BEAST_DOXYGEN
+    // Keeps the static helpers out of overload resolution
+    // for the type-erased member operations.
+    template <class WebsocketStream>
+    using enable_if_stream_t = typename std::enable_if<std::is_base_of<
+        basic_websocket_stream_base, WebsocketStream>::value>::type;
 #endif
 
-    websocket_stream_base() : use_ssl_(false) {}
+  public:
+    using lowest_layer_type = basic_stream<net::ip::tcp, Executor>;
+
+    using executor_type = Executor;
+
+    /// The type-erased handler taken by the virtual accept, close and ping
+    using handler_type = any_stream_handler<void(error_code), executor_type>;
+
+    /// The type-erased handler taken by the virtual read and write
+    using io_handler_type =
+        any_stream_handler<void(error_code, std::size_t), executor_type>;
 
-    virtual ~websocket_stream_base() {}
+  protected:
+    // Type-erase a completion handler for one of the virtual operations
+    template <class Erased, class Handler>
+    Erased erase(Handler&& handler)
+    {
+        return Erased(
+            bind_handler_memory(std::forward<Handler>(handler), handler_memory_),
+            get_executor());
+    }
+
+    // Record the permessage-deflate settings the server answers `req`
+    // with, by running the negotiation beast runs on the same request.
+    template <class Body, class Allocator>
+    void negotiate_compression(
+        http::request<Body, http::basic_fields<Allocator>> const& req)
+    {
+        permessage_deflate o;
+        get_option(o);
+        detail::pmd_offer offer;
+        detail::pmd_offer config;
+        detail::pmd_read(offer, req);
+        http::basic_fields<Allocator> fields;
+        detail::pmd_negotiate(fields, config, offer, o);
+
+        compression_ = send_compression{};
+        compression_.known = true;
+        if (!config.accept)
+            return;
+        detail::pmd_normalize(config);
+        compression_.enabled = true;
+        compression_.no_context_takeover = config.server_no_context_takeover;
+        compression_.params.window_bits = config.server_max_window_bits;
+        compression_.params.level = o.compLevel;
+        compression_.params.mem_level = o.memLevel;
+    }
+
+    // Called on each control frame received by the underlying stream
+    void on_control_frame(frame_type kind, string_view payload)
+    {
+        if (kind == frame_type::pong)
+            pings_.on_pong(payload);
+        if (control_observer_)
+            control_observer_(kind, payload);
+    }
+
+  public:
+    basic_websocket_stream_base() : use_ssl_(false) {}
+
+    virtual ~basic_websocket_stream_base() {}
 
     virtual bool use_ssl() noexcept { return use_ssl_; }
 
@@ -125,8 +247,15 @@ class websocket_stream_base
         be used to calculate a more specific value. For example, when
         reading the first frame header of a message.
     */
-    virtual std::size_t read_size_hint(
-        std::size_t initial_size = +tcp_frame_size) = 0;
+    virtual std::size_t read_size_hint(std::size_t initial_size) = 0;
+
+    /** Returns a suggested maximum buffer size for the next call to read.
+
+        As the overload taking an initial size, with the initial size
+        given by the stream's @ref read_size_policy, which follows the
+        sizes of the messages recently received.
+    */
+    std::size_t read_size_hint() { return read_size_hint(read_size_.hint()); }
 
     /** Returns a suggested maximum buffer size for the next call to read.
 
@@ -291,6 +420,33 @@ class websocket_stream_base
     */
     virtual void control_callback() = 0;
 
+    /** Set a function to be called on each incoming control frame.
+
+        Like @ref control_callback, but the callable is stored inline by
+        a @ref control_observer, so neither setting it nor calling it
+        allocates. It replaces any callback set by @ref control_callback,
+        which stores its `std::function` in the same place. The observer
+        must not be replaced from inside its own call.
+
+        @param f The callable, invocable as
+        `void(frame_type kind, string_view payload)`, no larger than
+        @ref control_observer::capacity.
+    */
+    template <class Function>
+    void observe_control_frames(Function&& f)
+    {
+        control_observer_ = control_observer(std::forward<Function>(f));
+    }
+
+    /** Returns the round-trip times of the pings sent by this stream.
+
+        Every ping sent through this stream is timed, and so is the pong
+        which answers it, whether or not a control frame observer is set.
+        Pongs are seen by reads, so a sample completes during the read
+        which receives the answer.
+    */
+    ping_tracker const& ping_times() const noexcept { return pings_; }
+
     /** Set the maximum incoming message size option.
 
         Sets the largest permissible incoming message size. Message
@@ -313,6 +469,16 @@ class websocket_stream_base
     /// Returns the maximum incoming message size setting.
     virtual std::size_t read_message_max() = 0;
 
+    /** Returns the policy which sizes the reads of a message.
+
+        A complete message read with @ref async_read or @ref
+        async_receive is recorded by the policy. The reads of
+        @ref async_read prepare the size it suggests, instead of a fixed
+        1536 bytes, so a stream of small messages prepares small buffers
+        and a stream of bulk messages reads each in few calls.
+    */
+    read_size_policy& read_sizing() noexcept { return read_size_; }
+
     /** Set whether the PRNG is cryptographically secure
 
         This controls whether or not the source of pseudo-random
@@ -326,6 +492,12 @@ class websocket_stream_base
         has no effect.
         By default, newly constructed streams use a secure PRNG.
 
+        Unless WEBSOCKET_STREAM_BEAST_PRNG is defined, the secure PRNG
+        is the ChaCha20 generator of `mask_prng::secure_generate`, which
+        fills a per-thread buffer of keys several blocks at a time, so
+        that a key costs little more than one from the faster algorithm.
+        See mask_prng.hpp.
+
         If the WebSocket stream is used with an encrypted SSL or TLS
         next layer, if it is known to the application that intermediate
         proxies are not vulnerable to cache poisoning, or if the
@@ -370,6 +542,30 @@ class websocket_stream_base
     /// Returns the size of the write buffer.
     virtual std::size_t write_buffer_bytes() = 0;
 
+    /** Set the gathered write option.
+
+        When set, a message written with `async_write` by a server stream
+        whose messages are not compressed is sent as a single frame,
+        without passing through the write buffer. The frame header is
+        built in a small buffer owned by the stream, and the header and
+        the caller's buffers go to the transport in one gathered write.
+        On a plain stream the payload is then never copied in user
+        space, and on an SSL stream it is copied only when encrypted.
+
+        Other writes, and writes by a client or a stream which compresses
+        its messages, go through the write buffer as usual. A gathered
+        write must not be started while a message begun with
+        `async_write_some` is unfinished.
+
+        The default setting is off.
+
+        @param value `true` if messages should be written gathered.
+    */
+    virtual void gather_writes(bool value) = 0;
+
+    /// Returns `true` if the gathered write option is set.
+    virtual bool gather_writes() = 0;
+
     /** Set the text message write option.
 
         This controls whether or not outgoing message opcodes
@@ -731,7 +927,9 @@ class websocket_stream_base
                             net::default_completion_token_t<executor_type>{})
 
     {
-        return stream.ws().async_handshake(host, target, handler);
+        stream.role_ = role_type::client;
+        return stream.ws().async_handshake(
+            host, target, std::forward<HandshakeHandler>(handler));
     }
 
     /** Perform the WebSocket handshake asynchronously in the client role.
@@ -827,7 +1025,9 @@ class websocket_stream_base
                         HandshakeHandler&& handler =
                             net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_handshake(res, host, target, handler);
+        stream.role_ = role_type::client;
+        return stream.ws().async_handshake(
+            res, host, target, std::forward<HandshakeHandler>(handler));
     }
 
     //--------------------------------------------------------------------------
@@ -1077,6 +1277,7 @@ class websocket_stream_base
         WebsocketStream& stream,
         http::request<Body, http::basic_fields<Allocator>> const& req)
     {
+        stream.negotiate_compression(req);
         return stream.ws().accept(req);
     }
 
@@ -1123,6 +1324,7 @@ class websocket_stream_base
         http::request<Body, http::basic_fields<Allocator>> const& req,
         error_code& ec)
     {
+        stream.negotiate_compression(req);
         return stream.ws().accept(req, ec);
     }
 
@@ -1182,15 +1384,46 @@ class websocket_stream_base
     */
     template <class WebsocketStream,
               BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
         async_accept(WebsocketStream& stream,
                      AcceptHandler&& handler =
                          net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_accept(handler);
+        return stream.ws().async_accept(std::forward<AcceptHandler>(handler));
     }
 
+    /** Perform the WebSocket handshake asynchronously in the server role.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @see @ref async_accept(WebsocketStream&, AcceptHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
+    async_accept(AcceptHandler&& handler =
+                     net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<AcceptHandler, void(error_code)>(
+            [this](auto h) {
+                async_accept(erase<handler_type>(std::move(h)));
+            },
+            handler);
+    }
+
+    /// Type-erased entry point for @ref async_accept
+    virtual void async_accept(handler_type handler) = 0;
+
     /** Perform the WebSocket handshake asynchronously in the server role.
 
         This initiating function is used to asynchronously begin performing the
@@ -1254,7 +1487,12 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class ConstBufferSequence,
               BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(AcceptHandler) async_accept(
         WebsocketStream& stream, ConstBufferSequence const& buffers,
         AcceptHandler&& handler =
@@ -1266,7 +1504,8 @@ class websocket_stream_base
 #endif
     )
     {
-        return stream.ws().async_accept(buffers, handler);
+        return stream.ws().async_accept(
+            buffers, std::forward<AcceptHandler>(handler));
     }
 
     /** Perform the WebSocket handshake asynchronously in the server role.
@@ -1322,16 +1561,56 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class Body, class Allocator,
               BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(AcceptHandler) async_accept(
         WebsocketStream& stream,
         http::request<Body, http::basic_fields<Allocator>> const& req,
         AcceptHandler&& handler =
             net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_accept(req, handler);
+        stream.negotiate_compression(req);
+        return stream.ws().async_accept(
+            req, std::forward<AcceptHandler>(handler));
     }
 
+    /** Perform the WebSocket handshake asynchronously in the server role.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param req An object containing the HTTP Upgrade request.
+        Ownership is not transferred, the implementation will not access
+        this object from other threads.
+
+        @see @ref async_accept(WebsocketStream&, http::request const&,
+        AcceptHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM1 AcceptHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(AcceptHandler)
+    async_accept(http::request<http::string_body> const& req,
+                 AcceptHandler&& handler =
+                     net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<AcceptHandler, void(error_code)>(
+            [this](auto h, http::request<http::string_body> const* req) {
+                async_accept(*req, erase<handler_type>(std::move(h)));
+            },
+            handler, &req);
+    }
+
+    /// Type-erased entry point for @ref async_accept
+    virtual void async_accept(http::request<http::string_body> const& req,
+                              handler_type handler) = 0;
+
     //--------------------------------------------------------------------------
     //
     // Close Frames
@@ -1461,15 +1740,50 @@ class websocket_stream_base
     */
     template <class WebsocketStream,
               BOOST_BEAST_ASYNC_TPARAM1 CloseHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(CloseHandler)
         async_close(WebsocketStream& stream, close_reason const& cr,
                     CloseHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_close(cr, handler);
+        return stream.ws().async_close(cr, std::forward<CloseHandler>(handler));
     }
 
+    /** Send a websocket close control frame asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param cr The reason for the close.
+
+        @see @ref async_close(WebsocketStream&, close_reason const&,
+        CloseHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM1 CloseHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(CloseHandler)
+    async_close(close_reason const& cr,
+                CloseHandler&& handler =
+                    net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<CloseHandler, void(error_code)>(
+            [this](auto h, close_reason const& cr) {
+                async_close(cr, erase<handler_type>(std::move(h)));
+            },
+            handler, cr);
+    }
+
+    /// Type-erased entry point for @ref async_close
+    virtual void async_close(close_reason const& cr, handler_type handler) = 0;
+
     //--------------------------------------------------------------------------
     //
     // Ping/Pong Frames
@@ -1561,15 +1875,56 @@ class websocket_stream_base
     */
     template <class WebsocketStream,
               BOOST_BEAST_ASYNC_TPARAM1 WriteHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(WriteHandler)
         async_ping(WebsocketStream& stream, ping_data const& payload,
                    WriteHandler&& handler =
                        net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_ping(payload, handler);
+        static_cast<basic_websocket_stream_base&>(stream).pings_.on_ping(
+            payload);
+        return stream.ws().async_ping(
+            payload, std::forward<WriteHandler>(handler));
     }
 
+    /** Send a websocket ping control frame asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param payload The payload of the ping message, which may be empty.
+        The implementation will not access the contents of this object after
+        the initiating function returns.
+
+        @see @ref async_ping(WebsocketStream&, ping_data const&,
+        WriteHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM1 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT1(WriteHandler)
+    async_ping(ping_data const& payload,
+               WriteHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler, void(error_code)>(
+            [this](auto h, ping_data const& payload) {
+                async_ping(payload, erase<handler_type>(std::move(h)));
+            },
+            handler, payload);
+    }
+
+    /// Type-erased entry point for @ref async_ping
+    virtual void async_ping(ping_data const& payload,
+                            handler_type handler) = 0;
+
     /** Send a websocket pong control frame.
 
         This function is used to send a
@@ -1667,13 +2022,19 @@ class websocket_stream_base
     */
     template <class WebsocketStream,
               BOOST_BEAST_ASYNC_TPARAM1 WriteHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT1(WriteHandler)
         async_pong(WebsocketStream& stream, ping_data const& payload,
                    WriteHandler&& handler =
                        net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_pong(payload, handler);
+        return stream.ws().async_pong(
+            payload, std::forward<WriteHandler>(handler));
     }
 
     //--------------------------------------------------------------------------
@@ -1833,15 +2194,217 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class DynamicBuffer,
               BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
         async_read(WebsocketStream& stream, DynamicBuffer& buffer,
                    ReadHandler&& handler =
                        net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_read(buffer, handler);
+        return stream.ws().async_read(
+            buffer, std::forward<ReadHandler>(handler));
+    }
+
+    /** Read a complete message asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param buffer A dynamic buffer to append message data to.
+
+        @see @ref async_read(WebsocketStream&, DynamicBuffer&, ReadHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read(flat_buffer& buffer,
+               ReadHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, flat_buffer* buffer) {
+                async_read(*buffer, erase<io_handler_type>(std::move(h)));
+            },
+            handler, &buffer);
+    }
+
+    /// Type-erased entry point for @ref async_read
+    virtual void async_read(flat_buffer& buffer, io_handler_type handler) = 0;
+
+    /** Read a complete message asynchronously into a pooled buffer.
+
+        As the `flat_buffer` overload, except that the message is stored
+        in a block from the thread's @ref buffer_pool, so that reading
+        into a new buffer for every message does not allocate.
+
+        @param buffer A dynamic buffer to append message data to.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read(pooled_buffer& buffer,
+               ReadHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, pooled_buffer* buffer) {
+                async_read(*buffer, erase<io_handler_type>(std::move(h)));
+            },
+            handler, &buffer);
+    }
+
+    /// Type-erased entry point for @ref async_read with a pooled buffer
+    virtual void async_read(pooled_buffer& buffer,
+                            io_handler_type handler) = 0;
+
+    /** Read a complete message asynchronously into a spill buffer.
+
+        As the `flat_buffer` overload, except that a message larger than
+        the threshold of the buffer is moved into a temporary file, so
+        that a large upload does not raise the resident memory of the
+        process. The message may be as large as @ref read_message_max.
+
+        @param buffer A dynamic buffer to append message data to.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read(spill_buffer& buffer,
+               ReadHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, spill_buffer* buffer) {
+                async_read(*buffer, erase<io_handler_type>(std::move(h)));
+            },
+            handler, &buffer);
+    }
+
+    /// Type-erased entry point for @ref async_read with a spill buffer
+    virtual void async_read(spill_buffer& buffer,
+                            io_handler_type handler) = 0;
+
+    /** Receive a complete message into a ring asynchronously.
+
+        The message is read with @ref async_read_some into the free space
+        of `ring`, and the handler is given a view of it in place. The
+        view stays valid until it is passed to `receive_ring::release`,
+        so the payload is never copied out of the ring. Messages which
+        are still held keep their space; when no space is left the
+        operation fails with @ref error::buffer_overflow and the stream
+        should be closed, as the rest of the message is not read.
+
+        The program must ensure that no other read is performed until
+        this operation completes.
+
+        @param ring The ring to receive into. It must remain valid until
+        the handler is called, and so must its held messages until they
+        are released.
+
+        @param handler The completion handler to invoke when the operation
+        completes. The equivalent function signature of the handler must
+        be:
+        @code
+        void handler(
+            error_code const& ec,           // Result of operation
+            receive_ring::message message   // The message, if no error
+        );
+        @endcode
+    */
+    template <class ReceiveHandler =
+                  net::default_completion_token_t<executor_type>>
+    auto async_receive(receive_ring& ring,
+                       ReceiveHandler&& handler =
+                           net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReceiveHandler,
+                                   void(error_code, receive_ring::message)>(
+            [this](auto h, receive_ring* ring) {
+                detail::receive_op<basic_websocket_stream_base, decltype(h)>(
+                    std::move(h), *this, *ring)
+                    .start();
+            },
+            handler, &ring);
     }
 
+    /** Receive every complete message already buffered, asynchronously.
+
+        Messages are received into `ring` as by @ref async_receive, and a
+        view of each is appended to `batch`, in the order received. The
+        operation waits for the first message. It then goes on receiving
+        for as long as the bytes already read from the connection hold
+        more, and completes once the next message needs another read from
+        the transport, so a client which pipelines many small messages
+        costs one completion for all of those which arrived together.
+        Each view tells whether its message is text or binary. The first
+        call sets the coalescing layer to read ahead 64 KiB at a time,
+        unless it was set already, so that a batch is not cut at every
+        read of `websocket::stream`.
+
+        The read of the next message keeps going after the handler is
+        called. Its message, or its error, is handed to the next call,
+        so the same ring must be passed to every call, and no other read
+        may be performed on the stream once this function has been used.
+        An error met after some messages were received is reported by the
+        next call, after those messages.
+
+        The views stay valid until they are passed to
+        `receive_ring::release`. When the ring has no space left for a
+        message the operation fails with @ref error::buffer_overflow, as
+        @ref async_receive does. The ring should hold a whole batch, which
+        may be every message in the bytes read ahead, with their headers,
+        plus the message being received.
+
+        @param ring The ring to receive into. It must remain valid until
+        the handler is called, and so must its held messages until they
+        are released.
+
+        @param batch The container the views are appended to. It must
+        remain valid until the handler is called.
+
+        @param handler The completion handler to invoke when the operation
+        completes. The equivalent function signature of the handler must
+        be:
+        @code
+        void handler(
+            error_code const& ec,   // Result of operation
+            std::size_t count       // The number of views appended
+        );
+        @endcode
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_many(receive_ring& ring,
+                    std::vector<receive_ring::message>& batch,
+                    ReadHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, receive_ring* ring,
+                   std::vector<receive_ring::message>* batch) {
+                async_read_many(*ring, *batch,
+                                erase<io_handler_type>(std::move(h)));
+            },
+            handler, &ring, &batch);
+    }
+
+    /// Type-erased entry point for @ref async_read_many
+    virtual void async_read_many(receive_ring& ring,
+                                 std::vector<receive_ring::message>& batch,
+                                 io_handler_type handler) = 0;
+
     //--------------------------------------------------------------------------
 
     /** Read some message data.
@@ -2012,16 +2575,59 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class DynamicBuffer,
               BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
         async_read_some(WebsocketStream& stream, DynamicBuffer& buffer,
                         std::size_t limit,
                         ReadHandler&& handler =
                             net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_read_some(buffer, limit, handler);
+        return stream.ws().async_read_some(
+            buffer, limit, std::forward<ReadHandler>(handler));
     }
 
+    /** Read some message data asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param buffer A dynamic buffer to append message data to.
+
+        @param limit An upper limit on the number of bytes this function
+        will append into the buffer. If this value is zero, then a reasonable
+        size will be chosen automatically.
+
+        @see @ref async_read_some(WebsocketStream&, DynamicBuffer&,
+        std::size_t, ReadHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_some(flat_buffer& buffer, std::size_t limit,
+                    ReadHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, flat_buffer* buffer, std::size_t limit) {
+                async_read_some(*buffer, limit,
+                                erase<io_handler_type>(std::move(h)));
+            },
+            handler, &buffer, limit);
+    }
+
+    /// Type-erased entry point for @ref async_read_some
+    virtual void async_read_some(flat_buffer& buffer, std::size_t limit,
+                                 io_handler_type handler) = 0;
+
     //--------------------------------------------------------------------------
 
     /** Read some message data.
@@ -2191,16 +2797,57 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class MutableBufferSequence,
               BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
         async_read_some(WebsocketStream& stream,
                         MutableBufferSequence const& buffers,
                         ReadHandler&& handler =
                             net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_read_some(buffers, handler);
+        return stream.ws().async_read_some(
+            buffers, std::forward<ReadHandler>(handler));
     }
 
+    /** Read some message data asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param buffers The buffer into which message data will be placed.
+        The caller is responsible for ensuring that the memory locations
+        pointed to by the buffer remains valid until the completion handler
+        is called.
+
+        @see @ref async_read_some(WebsocketStream&,
+        MutableBufferSequence const&, ReadHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 ReadHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(ReadHandler)
+    async_read_some(net::mutable_buffer const& buffers,
+                    ReadHandler&& handler =
+                        net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<ReadHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, net::mutable_buffer const& buffers) {
+                async_read_some(buffers, erase<io_handler_type>(std::move(h)));
+            },
+            handler, buffers);
+    }
+
+    /// Type-erased entry point for @ref async_read_some
+    virtual void async_read_some(net::mutable_buffer const& buffers,
+                                 io_handler_type handler) = 0;
+
     //--------------------------------------------------------------------------
     //
     // Writing
@@ -2321,15 +2968,55 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class ConstBufferSequence,
               BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
         async_write(WebsocketStream& stream, ConstBufferSequence const& buffers,
                     WriteHandler&& handler =
                         net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_write(buffers, handler);
+        return stream.ws().async_write(
+            buffers, std::forward<WriteHandler>(handler));
     }
 
+    /** Write a complete message asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param buffers A buffer containing the entire message payload. The
+        caller is responsible for ensuring that the memory locations pointed
+        to by buffers remains valid until the completion handler is called.
+
+        @see @ref async_write(WebsocketStream&, ConstBufferSequence const&,
+        WriteHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write(net::const_buffer const& buffers,
+                WriteHandler&& handler =
+                    net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, net::const_buffer const& buffers) {
+                async_write(buffers, erase<io_handler_type>(std::move(h)));
+            },
+            handler, buffers);
+    }
+
+    /// Type-erased entry point for @ref async_write
+    virtual void async_write(net::const_buffer const& buffers,
+                             io_handler_type handler) = 0;
+
     /** Write some message data.
 
         This function is used to send part of a message.
@@ -2450,17 +3137,612 @@ class websocket_stream_base
     */
     template <class WebsocketStream, class ConstBufferSequence,
               BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
-                  net::default_completion_token_t<executor_type>>
+                  net::default_completion_token_t<executor_type>
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = enable_if_stream_t<WebsocketStream>
+#endif
+              >
     static BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
         async_write_some(WebsocketStream& stream, bool fin,
                          ConstBufferSequence const& buffers,
                          WriteHandler&& handler =
                              net::default_completion_token_t<executor_type>{})
     {
-        return stream.ws().async_write_some(fin, buffers, handler);
+        return stream.ws().async_write_some(
+            fin, buffers, std::forward<WriteHandler>(handler));
+    }
+
+    /** Write some message data asynchronously.
+
+        This overload type-erases the completion handler and starts the
+        operation through the virtual function of the same name, so one
+        instantiation of the composed operation per concrete stream serves
+        every handler type. The associated executor and allocator of the
+        handler are preserved.
+
+        @param fin `true` if this is the last part of the message.
+
+        @param buffers The buffer containing the message part to send. The
+        caller is responsible for ensuring that the memory locations pointed
+        to by buffers remains valid until the completion handler is called.
+
+        @see @ref async_write_some(WebsocketStream&, bool,
+        ConstBufferSequence const&, WriteHandler&&)
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_some(bool fin, net::const_buffer const& buffers,
+                     WriteHandler&& handler =
+                         net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, bool fin, net::const_buffer const& buffers) {
+                async_write_some(fin, buffers,
+                                 erase<io_handler_type>(std::move(h)));
+            },
+            handler, fin, buffers);
+    }
+
+    /// Type-erased entry point for @ref async_write_some
+    virtual void async_write_some(bool fin, net::const_buffer const& buffers,
+                                  io_handler_type handler) = 0;
+
+    //--------------------------------------------------------------------------
+    //
+    // File Writes
+    //
+    //--------------------------------------------------------------------------
+
+    /// Passed as the length to @ref async_write_file to send to the end
+    static std::size_t constexpr rest_of_file = std::size_t(-1);
+
+    /** Write a range of a file as one message asynchronously.
+
+        The message is text or binary according to the @ref binary
+        option. On a plain server stream without permessage-deflate the
+        frame is not masked or compressed, so the frame header is written
+        and the file follows with `sendfile`, from the page cache to the
+        socket without passing through user memory. Other streams read
+        the file in 64 KB blocks, each sent as a frame of the message, so
+        the file is never held in memory whole.
+
+        As with @ref async_write, only one write may be outstanding, and
+        the file must not change until the handler is called. If the file
+        ends before `length` bytes were sent, the operation fails with
+        `net::error::eof` and the stream must be closed, as the message
+        is incomplete.
+
+        @param fd The file, open for reading. It is not closed.
+
+        @param offset The position of the first byte to send.
+
+        @param length The number of bytes to send, or @ref rest_of_file.
+
+        @param handler The completion handler to invoke when the operation
+        completes. The equivalent function signature of the handler must
+        be:
+        @code
+        void handler(
+            error_code const& ec,           // Result of operation
+            std::size_t bytes_transferred   // Bytes of the file sent
+        );
+        @endcode
+        Regardless of whether the asynchronous operation completes
+        immediately or not, the handler will not be invoked from within
+        this function. Invocation of the handler will be performed in a
+        manner equivalent to using `net::post`.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_file(int fd, std::uint64_t offset, std::size_t length,
+                     WriteHandler&& handler =
+                         net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, int fd, std::uint64_t offset,
+                   std::size_t length) {
+                async_write_file(fd, false, offset, length,
+                                 erase<io_handler_type>(std::move(h)));
+            },
+            handler, fd, offset, length);
+    }
+
+    /** Write a range of a file as one message asynchronously.
+
+        As the overload taking a descriptor, except that the file is
+        opened by path, and closed when the operation completes.
+
+        @param path The path of the file.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_file(std::string const& path, std::uint64_t offset,
+                     std::size_t length,
+                     WriteHandler&& handler =
+                         net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, std::string const& path, std::uint64_t offset,
+                   std::size_t length) {
+                error_code ec;
+                auto const fd = detail::open_file(path.c_str(), ec);
+                if (ec)
+                    return net::post(get_executor(),
+                                     beast::bind_front_handler(
+                                         std::move(h), ec, std::size_t(0)));
+                async_write_file(fd, true, offset, length,
+                                 erase<io_handler_type>(std::move(h)));
+            },
+            handler, path, offset, length);
+    }
+
+    /** Type-erased entry point for @ref async_write_file.
+
+        @param close_fd `true` if the operation closes the file when it
+        completes.
+    */
+    virtual void async_write_file(int fd, bool close_fd, std::uint64_t offset,
+                                  std::size_t length,
+                                  io_handler_type handler) = 0;
+
+    /** Write a batch of complete messages asynchronously.
+
+        Each message of `messages` is sent as a single frame with its own
+        text or binary opcode, in order. A server stream without
+        permessage-deflate frames the whole batch at once and hands it to
+        its transport in one gathered write: one socket write for a batch
+        of small messages, and as few TLS records as the batch fills on an
+        SSL stream. Payloads of up to 1 KiB are copied next to their frame
+        headers, and larger ones are written from where they are, except
+        on an SSL stream, which copies all of them. Any other stream
+        writes the messages one after another with the transport corked,
+        so that those which fit go out together when the last is written.
+
+        The @ref binary option is left as it was. As with @ref async_write,
+        no other write may be outstanding until the handler is called.
+
+        @param messages The messages to send. The sequence and the
+        payloads it refers to must remain valid until the handler is
+        called.
+
+        @param handler The completion handler to invoke when the operation
+        completes. The equivalent function signature of the handler must
+        be:
+        @code
+        void handler(
+            error_code const& ec,           // Result of operation
+            std::size_t bytes_transferred   // Payload bytes of the batch
+        );
+        @endcode
+        Regardless of whether the asynchronous operation completes
+        immediately or not, the handler will not be invoked from within
+        this function. Invocation of the handler will be performed in a
+        manner equivalent to using `net::post`.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_write_batch(span<batch_message const> messages,
+                      WriteHandler&& handler =
+                          net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, span<batch_message const> messages) {
+                async_write_batch(messages,
+                                  erase<io_handler_type>(std::move(h)));
+            },
+            handler, messages);
+    }
+
+    /// Type-erased entry point for @ref async_write_batch
+    virtual void async_write_batch(span<batch_message const> messages,
+                                   io_handler_type handler) = 0;
+
+    //--------------------------------------------------------------------------
+    //
+    // Queued Writes
+    //
+    //--------------------------------------------------------------------------
+
+    /** Queue a message to be sent.
+
+        Only one write may be outstanding on a WebSocket stream. This
+        function may be called at any time instead: the message is moved
+        into a queue owned by the stream and written once the messages
+        ahead of it have been written. The opcode is taken from the
+        @ref binary option when the message is queued.
+
+        Messages queued while a write is in flight are coalesced by the
+        stream's transport layer, so a burst of small messages goes out in
+        a single socket write, and a single TLS record on an SSL stream.
+
+        Do not call @ref async_write or @ref async_write_some on a stream
+        which has messages queued.
+
+        @param message The message payload, taken by value.
+
+        @param handler The completion handler to invoke when the message
+        has been handed to the transport. The equivalent function signature
+        of the handler must be:
+        @code
+        void handler(
+            error_code const& ec,           // Result of operation
+            std::size_t bytes_transferred   // Payload bytes of the message
+        );
+        @endcode
+        Regardless of whether the asynchronous operation completes
+        immediately or not, the handler will not be invoked from within
+        this function. Invocation of the handler will be performed in a
+        manner equivalent to using `net::post`.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_send(std::string message,
+               WriteHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, std::string message) {
+                async_send(std::move(message),
+                           erase<io_handler_type>(std::move(h)));
+            },
+            handler, std::move(message));
+    }
+
+    /// Type-erased entry point for @ref async_send
+    virtual void async_send(std::string message, io_handler_type handler) = 0;
+
+    /** Queue a pre-encoded message to be sent.
+
+        This works as the overload taking a string, except that the
+        message is framed already and shared with other streams. A server
+        stream writes the encoded bytes straight to its transport when
+        they match its @ref compression: an uncompressed frame when
+        permessage-deflate is off, or a frame from `shared_frame::deflate`
+        with the stream's settings when server_no_context_takeover was
+        negotiated. Otherwise the payload is sent as an ordinary message.
+        Either way the message keeps its place in the queue.
+
+        @param frame The encoded message, see @ref shared_frame.
+
+        @param handler The completion handler to invoke when the message
+        has been handed to the transport. The equivalent function signature
+        of the handler must be:
+        @code
+        void handler(
+            error_code const& ec,           // Result of operation
+            std::size_t bytes_transferred   // Payload bytes of the message
+        );
+        @endcode
+        Regardless of whether the asynchronous operation completes
+        immediately or not, the handler will not be invoked from within
+        this function. Invocation of the handler will be performed in a
+        manner equivalent to using `net::post`.
+    */
+    template <BOOST_BEAST_ASYNC_TPARAM2 WriteHandler =
+                  net::default_completion_token_t<executor_type>>
+    BOOST_BEAST_ASYNC_RESULT2(WriteHandler)
+    async_send(shared_frame frame,
+               WriteHandler&& handler =
+                   net::default_completion_token_t<executor_type>{})
+    {
+        return net::async_initiate<WriteHandler,
+                                   void(error_code, std::size_t)>(
+            [this](auto h, shared_frame frame) {
+                async_send(std::move(frame),
+                           erase<io_handler_type>(std::move(h)));
+            },
+            handler, std::move(frame));
+    }
+
+    /// Type-erased entry point for @ref async_send
+    virtual void async_send(shared_frame frame, io_handler_type handler) = 0;
+
+    /// Returns the number of queued messages, including the one being written
+    virtual std::size_t send_queue_depth() const noexcept = 0;
+
+    /// Returns the payload bytes of the queued messages
+    virtual std::size_t send_queue_bytes() const noexcept = 0;
+
+    /** Returns how this server stream compresses the messages it sends.
+
+        The result of the permessage-deflate negotiation is known when the
+        stream was accepted with the client's request, or when the server
+        side of permessage-deflate is disabled. After `accept` without a
+        request it is not, and shared frames are then sent as payloads.
+    */
+    send_compression compression()
+    {
+        if (compression_.known)
+            return compression_;
+        permessage_deflate o;
+        get_option(o);
+        send_compression result;
+        result.known = !o.server_enable;
+        return result;
+    }
+
+    //--------------------------------------------------------------------------
+    //
+    // Hibernation
+    //
+    //--------------------------------------------------------------------------
+
+    /** Release per-connection memory when the stream has been idle.
+
+        Once set, the stream checks for traffic every `idle` period, on a
+        timer using its executor. When no read or write reached the
+        transport over a whole period, the stream hibernates as if by
+        @ref hibernate. A stream therefore hibernates between one and two
+        periods after its last traffic.
+
+        This function must be called on the stream's executor.
+
+        @param idle The idle period. Zero disables hibernation.
+    */
+    virtual void hibernate_after(std::chrono::steady_clock::duration idle) = 0;
+
+    /** Release the memory the stream does not need while idle.
+
+        The buffers of the write coalescing layer, the storage of the send
+        queue, the frames of the last @ref async_write_batch and the
+        recycled handler memory not held by a pending operation are freed. Each is allocated again when it is next
+        needed, so the stream wakes by itself on the next frame or write.
+
+        The read buffer of a message is owned by the caller; a
+        @ref pooled_buffer hands its memory back as soon as the message
+        is consumed. OpenSSL already frees its record buffers between
+        records, as Asio enables `SSL_MODE_RELEASE_BUFFERS`. Memory owned
+        by Beast and Asio, such as the permessage-deflate state and the
+        four 17 KB buffers of the SSL engine, is kept.
+
+        Measured with `bench/bench_hibernation.cpp` on a server holding
+        idle sessions which each sent a burst of 64 messages, including
+        the session object, a pending read and the hibernation timer:
+
+        @li plain stream: 79 KB awake, 5.5 KB hibernating
+        @li SSL stream: 161 KB awake, 89 KB hibernating
+    */
+    virtual void hibernate() = 0;
+
+    /// Returns `true` if the stream hibernated and has had no traffic since
+    virtual bool hibernating() = 0;
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT) || BOOST_BEAST_DOXYGEN
+    //--------------------------------------------------------------------------
+    //
+    // Coroutines
+    //
+    //--------------------------------------------------------------------------
+
+    /** The awaitable type returned by the `co_` operations.
+
+        These operations start the corresponding type-erased asynchronous
+        operation with `net::use_awaitable` and return the awaitable
+        directly, so awaiting one costs no coroutine frame beyond the
+        caller's. A stackless session only keeps its own frame alive while
+        it waits, instead of a whole stack as with `net::spawn`.
+
+        The overloads without an `error_code` throw `system_error` on
+        failure. The overloads taking an `error_code` store the error
+        instead, which suits loops that expect @ref error::closed.
+    */
+    template <class T>
+    using awaitable = net::awaitable<T, executor_type>;
+
+    /// Accept the WebSocket handshake, see @ref async_accept
+    awaitable<void> co_accept()
+    {
+        return async_accept(net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Accept the WebSocket handshake, see @ref async_accept
+    awaitable<void> co_accept(error_code& ec)
+    {
+        return async_accept(
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Respond to a WebSocket HTTP Upgrade request, see @ref async_accept
+    awaitable<void> co_accept(http::request<http::string_body> const& req)
+    {
+        return async_accept(req, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Respond to a WebSocket HTTP Upgrade request, see @ref async_accept
+    awaitable<void> co_accept(http::request<http::string_body> const& req,
+                              error_code& ec)
+    {
+        return async_accept(
+            req,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Send a websocket close control frame, see @ref async_close
+    awaitable<void> co_close(close_reason const& cr)
+    {
+        return async_close(cr, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Send a websocket close control frame, see @ref async_close
+    awaitable<void> co_close(close_reason const& cr, error_code& ec)
+    {
+        return async_close(
+            cr,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Send a websocket ping control frame, see @ref async_ping
+    awaitable<void> co_ping(ping_data const& payload)
+    {
+        return async_ping(payload, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Send a websocket ping control frame, see @ref async_ping
+    awaitable<void> co_ping(ping_data const& payload, error_code& ec)
+    {
+        return async_ping(
+            payload,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(flat_buffer& buffer)
+    {
+        return async_read(buffer, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(flat_buffer& buffer, error_code& ec)
+    {
+        return async_read(
+            buffer,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(pooled_buffer& buffer)
+    {
+        return async_read(buffer, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(pooled_buffer& buffer, error_code& ec)
+    {
+        return async_read(
+            buffer,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(spill_buffer& buffer)
+    {
+        return async_read(buffer, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Read a complete message, see @ref async_read
+    awaitable<std::size_t> co_read(spill_buffer& buffer, error_code& ec)
+    {
+        return async_read(
+            buffer,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Receive a complete message into a ring, see @ref async_receive
+    awaitable<receive_ring::message> co_receive(receive_ring& ring)
+    {
+        return async_receive(ring, net::use_awaitable_t<executor_type>{});
     }
+
+    /// Receive a complete message into a ring, see @ref async_receive
+    awaitable<receive_ring::message> co_receive(receive_ring& ring,
+                                                error_code& ec)
+    {
+        return async_receive(
+            ring,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Receive the buffered complete messages, see @ref async_read_many
+    awaitable<std::size_t> co_read_many(
+        receive_ring& ring, std::vector<receive_ring::message>& batch)
+    {
+        return async_read_many(ring, batch,
+                               net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Receive the buffered complete messages, see @ref async_read_many
+    awaitable<std::size_t> co_read_many(
+        receive_ring& ring, std::vector<receive_ring::message>& batch,
+        error_code& ec)
+    {
+        return async_read_many(
+            ring, batch,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Write a complete message, see @ref async_write
+    awaitable<std::size_t> co_write(net::const_buffer const& buffers)
+    {
+        return async_write(buffers, net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Write a complete message, see @ref async_write
+    awaitable<std::size_t> co_write(net::const_buffer const& buffers,
+                                    error_code& ec)
+    {
+        return async_write(
+            buffers,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Write a batch of complete messages, see @ref async_write_batch
+    awaitable<std::size_t> co_write_batch(span<batch_message const> messages)
+    {
+        return async_write_batch(messages,
+                                 net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Write a batch of complete messages, see @ref async_write_batch
+    awaitable<std::size_t> co_write_batch(span<batch_message const> messages,
+                                          error_code& ec)
+    {
+        return async_write_batch(
+            messages,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Write a range of a file as one message, see @ref async_write_file
+    awaitable<std::size_t> co_write_file(int fd, std::uint64_t offset,
+                                         std::size_t length)
+    {
+        return async_write_file(fd, offset, length,
+                                net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Write a range of a file as one message, see @ref async_write_file
+    awaitable<std::size_t> co_write_file(int fd, std::uint64_t offset,
+                                         std::size_t length, error_code& ec)
+    {
+        return async_write_file(
+            fd, offset, length,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+
+    /// Write a range of a file as one message, see @ref async_write_file
+    awaitable<std::size_t> co_write_file(std::string const& path,
+                                         std::uint64_t offset,
+                                         std::size_t length)
+    {
+        return async_write_file(path, offset, length,
+                                net::use_awaitable_t<executor_type>{});
+    }
+
+    /// Write a range of a file as one message, see @ref async_write_file
+    awaitable<std::size_t> co_write_file(std::string const& path,
+                                         std::uint64_t offset,
+                                         std::size_t length, error_code& ec)
+    {
+        return async_write_file(
+            path, offset, length,
+            net::redirect_error(net::use_awaitable_t<executor_type>{}, ec));
+    }
+#endif
 };
 
+/// The stream interface using the default executor
+using websocket_stream_base = basic_websocket_stream_base<>;
+
 }    // namespace websocket
 }    // namespace beast
 }    // namespace boost
@@ -0,0 +1,295 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef WEBSOCKET_STREAM_HANDLER_HPP
+#define WEBSOCKET_STREAM_HANDLER_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/assert.hpp>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+//------------------------------------------------------------------------------
+
+/** The memory interface seen through @ref any_stream_handler_allocator.
+
+    Implemented by the type-erased handler so that allocations made by
+    the composed operation are served by the allocator associated with
+    the original completion handler.
+*/
+class stream_handler_memory
+{
+  public:
+    virtual void* allocate(std::size_t size) = 0;
+    virtual void deallocate(void* p, std::size_t size) noexcept = 0;
+
+  protected:
+    ~stream_handler_memory() = default;
+};
+
+/** Allocator associated with an @ref any_stream_handler.
+
+    Forwards every allocation to the allocator associated with the
+    wrapped handler. A default constructed allocator, or one obtained
+    from an empty handler, uses `::operator new`.
+*/
+template <class T>
+class any_stream_handler_allocator
+{
+    template <class U>
+    friend class any_stream_handler_allocator;
+
+    stream_handler_memory* memory_;
+
+  public:
+    using value_type = T;
+
+    any_stream_handler_allocator() noexcept : memory_(nullptr) {}
+
+    explicit any_stream_handler_allocator(
+        stream_handler_memory* memory) noexcept
+        : memory_(memory)
+    {
+    }
+
+    template <class U>
+    any_stream_handler_allocator(
+        any_stream_handler_allocator<U> const& other) noexcept
+        : memory_(other.memory_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "over-aligned types are not supported");
+        if (!memory_)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(memory_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (!memory_)
+            return ::operator delete(p);
+        memory_->deallocate(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(any_stream_handler_allocator<U> const& other) const noexcept
+    {
+        return memory_ == other.memory_;
+    }
+
+    template <class U>
+    bool operator!=(any_stream_handler_allocator<U> const& other) const noexcept
+    {
+        return memory_ != other.memory_;
+    }
+};
+
+//------------------------------------------------------------------------------
+
+template <class Signature, class Executor>
+class any_stream_handler;
+
+/** A move-only, type-erased completion handler.
+
+    This is the handler type accepted by the virtual asynchronous
+    operations of @ref websocket_stream_base. Wrapping the caller's
+    handler in this type means the composed operations of the underlying
+    `websocket::stream` are instantiated once per concrete stream instead
+    of once per handler type.
+
+    The associated executor of the wrapped handler is preserved, using the
+    executor of the stream as a fallback, and so is its associated
+    allocator: the erased state itself and every allocation the composed
+    operation makes through @ref get_allocator are served by it.
+
+    As required for completion handlers, the erased state is released
+    before the wrapped handler is invoked.
+*/
+template <class Executor, class... Args>
+class any_stream_handler<void(Args...), Executor>
+{
+    struct impl_base : stream_handler_memory
+    {
+        virtual void invoke(Args... args) = 0;
+        virtual void destroy() noexcept = 0;
+        virtual Executor const& executor() const noexcept = 0;
+
+      protected:
+        ~impl_base() = default;
+    };
+
+    template <class Handler>
+    struct impl final : impl_base
+    {
+        // Storage unit used for allocations made through the handler
+        struct alignas(std::max_align_t) unit
+        {
+            unsigned char data[alignof(std::max_align_t)];
+        };
+
+        using handler_allocator_type = net::associated_allocator_t<Handler>;
+        using alloc_traits = typename std::allocator_traits<
+            handler_allocator_type>::template rebind_traits<impl>;
+        using unit_traits = typename std::allocator_traits<
+            handler_allocator_type>::template rebind_traits<unit>;
+
+        Handler h_;
+        Executor ex_;
+
+        template <class DeducedHandler>
+        impl(DeducedHandler&& h, Executor const& fallback)
+            : h_(std::forward<DeducedHandler>(h))
+            , ex_(net::get_associated_executor(h_, fallback))
+        {
+        }
+
+        template <class DeducedHandler>
+        static impl* create(DeducedHandler&& h, Executor const& fallback)
+        {
+            typename alloc_traits::allocator_type a(
+                net::get_associated_allocator(h));
+            impl* p = alloc_traits::allocate(a, 1);
+            try {
+                ::new (static_cast<void*>(p))
+                    impl(std::forward<DeducedHandler>(h), fallback);
+            } catch (...) {
+                alloc_traits::deallocate(a, p, 1);
+                throw;
+            }
+            return p;
+        }
+
+        void destroy() noexcept override
+        {
+            typename alloc_traits::allocator_type a(
+                net::get_associated_allocator(h_));
+            this->~impl();
+            alloc_traits::deallocate(a, this, 1);
+        }
+
+        void invoke(Args... args) override
+        {
+            // Release our state before the upcall
+            Handler h(std::move(h_));
+            destroy();
+            std::move(h)(std::forward<Args>(args)...);
+        }
+
+        Executor const& executor() const noexcept override { return ex_; }
+
+        void* allocate(std::size_t size) override
+        {
+            typename unit_traits::allocator_type a(
+                net::get_associated_allocator(h_));
+            return unit_traits::allocate(a, units(size));
+        }
+
+        void deallocate(void* p, std::size_t size) noexcept override
+        {
+            typename unit_traits::allocator_type a(
+                net::get_associated_allocator(h_));
+            unit_traits::deallocate(a, static_cast<unit*>(p), units(size));
+        }
+
+        static std::size_t units(std::size_t size) noexcept
+        {
+            return (size + sizeof(unit) - 1) / sizeof(unit);
+        }
+    };
+
+    impl_base* impl_ = nullptr;
+
+  public:
+    using executor_type = Executor;
+
+    using allocator_type = any_stream_handler_allocator<void>;
+
+    any_stream_handler() = default;
+
+    /** Wrap a completion handler.
+
+        @param handler The handler to wrap. It is decay-copied.
+
+        @param fallback The executor used to invoke the handler if it has
+        no associated executor, normally the executor of the stream.
+    */
+    template <class Handler
+#if !BOOST_BEAST_DOXYGEN
+              ,
+              class = typename std::enable_if<!std::is_same<
+                  typename std::decay<Handler>::type,
+                  any_stream_handler>::value>::type
+#endif
+              >
+    any_stream_handler(Handler&& handler, Executor const& fallback)
+        : impl_(impl<typename std::decay<Handler>::type>::create(
+              std::forward<Handler>(handler), fallback))
+    {
+    }
+
+    any_stream_handler(any_stream_handler&& other) noexcept
+        : impl_(std::exchange(other.impl_, nullptr))
+    {
+    }
+
+    any_stream_handler& operator=(any_stream_handler&& other) noexcept
+    {
+        if (this != &other) {
+            if (impl_)
+                impl_->destroy();
+            impl_ = std::exchange(other.impl_, nullptr);
+        }
+        return *this;
+    }
+
+    any_stream_handler(any_stream_handler const&) = delete;
+    any_stream_handler& operator=(any_stream_handler const&) = delete;
+
+    ~any_stream_handler()
+    {
+        if (impl_)
+            impl_->destroy();
+    }
+
+    /// Returns `true` if a handler is held
+    explicit operator bool() const noexcept { return impl_ != nullptr; }
+
+    /// Returns the associated executor of the wrapped handler
+    executor_type get_executor() const noexcept
+    {
+        BOOST_ASSERT(impl_);
+        return impl_->executor();
+    }
+
+    /// Returns an allocator forwarding to the wrapped handler's allocator
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(impl_);
+    }
+
+    /// Invoke the wrapped handler, leaving this object empty
+    void operator()(Args... args)
+    {
+        BOOST_ASSERT(impl_);
+        std::exchange(impl_, nullptr)->invoke(std::forward<Args>(args)...);
+    }
+};
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !WEBSOCKET_STREAM_HANDLER_HPP
@@ -0,0 +1,272 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef WEBSOCKET_STREAM_MEMORY_HPP
+#define WEBSOCKET_STREAM_MEMORY_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/handler_continuation_hook.hpp>
+#include <boost/asio/handler_invoke_hook.hpp>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** Recycling memory for the asynchronous operations of one stream.
+
+    Composed operations allocate their state through the allocator
+    associated with the completion handler, and free it before the
+    handler is invoked. A read followed by a write therefore allocates
+    and frees blocks of the same few sizes over and over. This class
+    keeps a small number of slots which remember their block; once each
+    slot has grown to the size it is asked for, allocations are served
+    without calling the global allocator.
+
+    Slots are claimed with an atomic flag, because Asio may free operation
+    state on a different thread than the one which allocated it. When all
+    slots are in use the request falls back to `::operator new`.
+*/
+class handler_memory
+{
+    // Blocks are sized in multiples of this, to absorb
+    // small differences between handler types.
+    static std::size_t constexpr granularity = 64;
+
+    struct slot
+    {
+        std::atomic<bool> in_use{false};
+        std::atomic<void*> data{nullptr};
+        std::size_t size = 0;
+    };
+
+  public:
+    /// The number of blocks which may be outstanding at once
+    static std::size_t constexpr slot_count = 8;
+
+    handler_memory() = default;
+
+    handler_memory(handler_memory const&) = delete;
+    handler_memory& operator=(handler_memory const&) = delete;
+
+    ~handler_memory()
+    {
+        for (auto& s : slots_)
+            ::operator delete(s.data.load(std::memory_order_relaxed));
+    }
+
+    void* allocate(std::size_t size)
+    {
+        // Prefer a free slot which is already large enough
+        for (auto& s : slots_) {
+            if (!acquire(s))
+                continue;
+            if (s.size >= size)
+                return s.data.load(std::memory_order_relaxed);
+            s.in_use.store(false, std::memory_order_release);
+        }
+
+        // Grow the first free slot
+        for (auto& s : slots_) {
+            if (!acquire(s))
+                continue;
+            auto const rounded =
+                (size + granularity - 1) / granularity * granularity;
+            void* p;
+            try {
+                p = ::operator new(rounded);
+            } catch (...) {
+                s.in_use.store(false, std::memory_order_release);
+                throw;
+            }
+            ::operator delete(s.data.load(std::memory_order_relaxed));
+            s.data.store(p, std::memory_order_relaxed);
+            s.size = rounded;
+            return p;
+        }
+
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p, std::size_t) noexcept
+    {
+        for (auto& s : slots_) {
+            if (s.data.load(std::memory_order_relaxed) == p) {
+                s.in_use.store(false, std::memory_order_release);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+    /// Free the blocks of the slots which are not in use
+    void shrink_to_fit() noexcept
+    {
+        for (auto& s : slots_) {
+            if (!acquire(s))
+                continue;
+            ::operator delete(s.data.load(std::memory_order_relaxed));
+            s.data.store(nullptr, std::memory_order_relaxed);
+            s.size = 0;
+            s.in_use.store(false, std::memory_order_release);
+        }
+    }
+
+  private:
+    static bool acquire(slot& s) noexcept
+    {
+        return !s.in_use.load(std::memory_order_relaxed) &&
+               !s.in_use.exchange(true, std::memory_order_acquire);
+    }
+
+    slot slots_[slot_count];
+};
+
+//------------------------------------------------------------------------------
+
+/** An allocator which draws from a @ref handler_memory.
+
+    A default constructed allocator uses `::operator new`.
+*/
+template <class T>
+class handler_allocator
+{
+    template <class U>
+    friend class handler_allocator;
+
+    handler_memory* memory_;
+
+  public:
+    using value_type = T;
+
+    handler_allocator() noexcept : memory_(nullptr) {}
+
+    explicit handler_allocator(handler_memory* memory) noexcept
+        : memory_(memory)
+    {
+    }
+
+    template <class U>
+    handler_allocator(handler_allocator<U> const& other) noexcept
+        : memory_(other.memory_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "over-aligned types are not supported");
+        if (!memory_)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(memory_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (!memory_)
+            return ::operator delete(p);
+        memory_->deallocate(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(handler_allocator<U> const& other) const noexcept
+    {
+        return memory_ == other.memory_;
+    }
+
+    template <class U>
+    bool operator!=(handler_allocator<U> const& other) const noexcept
+    {
+        return memory_ != other.memory_;
+    }
+};
+
+//------------------------------------------------------------------------------
+
+/** A completion handler whose default allocator is a @ref handler_memory.
+
+    If the wrapped handler has its own associated allocator, that
+    allocator is used instead. The associated executor and the invocation
+    and continuation hooks are forwarded to the wrapped handler.
+*/
+template <class Handler>
+class memory_bound_handler
+{
+    Handler h_;
+    handler_memory* memory_;
+
+  public:
+    using allocator_type =
+        net::associated_allocator_t<Handler, handler_allocator<void>>;
+
+    template <class DeducedHandler>
+    memory_bound_handler(DeducedHandler&& h, handler_memory& memory)
+        : h_(std::forward<DeducedHandler>(h)), memory_(&memory)
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return net::get_associated_allocator(
+            h_, handler_allocator<void>(memory_));
+    }
+
+    Handler const& handler() const noexcept { return h_; }
+
+    template <class... Args>
+    void operator()(Args&&... args)
+    {
+        h_(std::forward<Args>(args)...);
+    }
+
+    template <class Function>
+    friend void asio_handler_invoke(Function&& f, memory_bound_handler* p)
+    {
+        using net::asio_handler_invoke;
+        asio_handler_invoke(f, std::addressof(p->h_));
+    }
+
+    friend bool asio_handler_is_continuation(memory_bound_handler* p)
+    {
+        using net::asio_handler_is_continuation;
+        return asio_handler_is_continuation(std::addressof(p->h_));
+    }
+};
+
+/// Bind the memory of a stream to a completion handler
+template <class Handler>
+memory_bound_handler<typename std::decay<Handler>::type> bind_handler_memory(
+    Handler&& handler, handler_memory& memory)
+{
+    return memory_bound_handler<typename std::decay<Handler>::type>(
+        std::forward<Handler>(handler), memory);
+}
+
+}    // namespace websocket
+}    // namespace beast
+
+namespace asio {
+
+template <class Handler, class Executor>
+struct associated_executor<
+    beast::websocket::memory_bound_handler<Handler>, Executor>
+{
+    using type = typename associated_executor<Handler, Executor>::type;
+
+    static type get(beast::websocket::memory_bound_handler<Handler> const& h,
+                    Executor const& ex = Executor()) noexcept
+    {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+};
+
+}    // namespace asio
+}    // namespace boost
+
+#endif    // !WEBSOCKET_STREAM_MEMORY_HPP
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2021 nineKnight (mikezhen0707 at gmail dot com)
+//
+
+#ifndef WRITE_BATCH_HPP
+#define WRITE_BATCH_HPP
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/span.hpp>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "shared_frame.hpp"
+
+namespace boost {
+namespace beast {
+namespace websocket {
+
+/** A message of a batch, see `websocket_stream_base::async_write_batch`.
+
+    The payload is referenced, not copied, and must remain valid until
+    the write of the batch completes.
+*/
+struct batch_message
+{
+    /// The payload of the message
+    net::const_buffer payload;
+
+    /// `true` for a binary message, `false` for a text message
+    bool binary = false;
+};
+
+namespace detail {
+
+// Frames a batch of messages as final, unmasked, uncompressed frames,
+// for a server to write in one gathered write. Headers and payloads up
+// to `copy_limit` bytes are copied into one block, which a larger
+// payload interrupts with a buffer of its own, so a batch of small
+// messages is a single buffer.
+class batch_encoder
+{
+    flat_buffer data_;
+    std::vector<net::const_buffer> buffers_;
+    std::size_t header_size_ = 0;
+
+  public:
+    void encode(span<batch_message const> messages, std::size_t copy_limit)
+    {
+        std::size_t size = 0;
+        for (auto const& m : messages) {
+            size += shared_frame::max_header_size;
+            if (m.payload.size() <= copy_limit)
+                size += m.payload.size();
+        }
+        data_.clear();
+        buffers_.clear();
+        header_size_ = 0;
+        auto const begin = static_cast<unsigned char*>(data_.prepare(size).data());
+        auto run = begin;
+        auto p = begin;
+        for (auto const& m : messages) {
+            auto const n = m.payload.size();
+            auto const header = encode_frame_header(p, m.binary, false, n);
+            header_size_ += header;
+            p += header;
+            if (n <= copy_limit) {
+                if (n > 0)
+                    std::memcpy(p, m.payload.data(), n);
+                p += n;
+                continue;
+            }
+            buffers_.emplace_back(run, static_cast<std::size_t>(p - run));
+            buffers_.push_back(m.payload);
+            run = p;
+        }
+        if (p != run)
+            buffers_.emplace_back(run, static_cast<std::size_t>(p - run));
+    }
+
+    // The buffers of the encoded batch, valid until the next encode
+    std::vector<net::const_buffer> const& buffers() const noexcept
+    {
+        return buffers_;
+    }
+
+    // The total size of the frame headers
+    std::size_t header_size() const noexcept { return header_size_; }
+
+    void shrink_to_fit()
+    {
+        data_.clear();
+        data_.shrink_to_fit();
+        std::vector<net::const_buffer>().swap(buffers_);
+    }
+};
+
+}    // namespace detail
+
+}    // namespace websocket
+}    // namespace beast
+}    // namespace boost
+
+#endif    // !WRITE_BATCH_HPP